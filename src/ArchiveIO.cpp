@@ -1,385 +1,1031 @@
-/*
-Copyright (c), Helios
-All rights reserved.
-
-Distributed under a permissive license. See COPYING.txt for details.
-*/
-
-#include "stdafx.h"
-#include "ArchiveIO.h"
-#include "CryptoFilter.h"
-#include "serialization/fso.generated.h"
-#include "BoundedStreamFilter.h"
-#include "LzmaFilter.h"
-#include "serialization/ImplementedDS.h"
-#include "NullStream.h"
-#include "System/Transactions.h"
-#include "HashFilter.h"
-#include "StreamProcessor.h"
-
-const Algorithm default_crypto_algorithm = Algorithm::Twofish;
-using zstreams::Stream;
-
-ArchiveKeys::ArchiveKeys(size_t key_size, size_t iv_size){
-	this->init(key_size, iv_size);
-}
-
-void ArchiveKeys::init(size_t key_size, size_t iv_size, bool randomize){
-	this->size = 0;
-	for (auto &i : this->keys){
-		i.resize(key_size);
-		this->size += key_size;
-		if (randomize)
-			random_number_generator->GenerateBlock(i.data(), i.size());
-	}
-	for (auto &i : this->ivs){
-		i.resize(iv_size);
-		this->size += iv_size;
-		if (randomize)
-			random_number_generator->GenerateBlock(i.data(), i.size());
-	}
-	zekvok_assert(this->size <= 4096 / 8 - 42);
-}
-
-const CryptoPP::SecByteBlock &ArchiveKeys::get_key(size_t i) const{
-	if (i > array_size(this->keys))
-		throw IncorrectImplementationException();
-	return this->keys[i];
-}
-
-const CryptoPP::SecByteBlock &ArchiveKeys::get_iv(size_t i) const{
-	if (i > array_size(this->ivs))
-		throw IncorrectImplementationException();
-	return this->ivs[i];
-}
-
-ArchiveKeys::ArchiveKeys(std::istream &stream, RsaKeyPair &keypair){
-	this->init(CryptoPP::Twofish::MAX_KEYLENGTH, CryptoPP::Twofish::BLOCKSIZE, false);
-
-	auto &private_key = keypair.get_private_key();
-
-	CryptoPP::RSA::PrivateKey priv;
-	{
-		CryptoPP::ArraySource source(static_cast<const byte *>(&private_key[0]), private_key.size(), true);
-		priv.Load(source);
-	}
-
-	CryptoPP::SecByteBlock buffer(this->size);
-	{
-		auto n = 4096 / 8;
-
-		typedef CryptoPP::RSAES<CryptoPP::OAEP<CryptoPP::SHA>>::Decryptor decryptor_t;
-		typedef CryptoPP::PK_DecryptorFilter filter_t;
-		decryptor_t dec(priv);
-		CryptoPP::SecByteBlock temp(n);
-		stream.read(reinterpret_cast<char *>(temp.data()), temp.size());
-		auto read = stream.gcount();
-		if (read != temp.size())
-			throw RsaBlockDecryptionException("Not enough bytes read from RSA block.");
-		try{
-			auto sink = new CryptoPP::ArraySink(buffer.data(), buffer.size());
-			auto filter = new filter_t(*random_number_generator, dec, sink);
-			CryptoPP::ArraySource(temp.data(), temp.size(), true, filter);
-		}catch (...){
-			throw RsaBlockDecryptionException("Invalid data in RSA block.");
-		}
-	}
-
-	size_t offset = 0;
-	for (size_t i = 0; i < this->key_count; i++){
-		auto &key = this->keys[i];
-		auto &iv = this->ivs[i];
-		memcpy(key.data(), buffer.data() + offset, key.size());
-		offset += key.size();
-		memcpy(iv.data(), buffer.data() + offset, iv.size());
-		offset += iv.size();
-	}
-}
-
-std::unique_ptr<ArchiveKeys> ArchiveKeys::create_and_save(zstreams::Sink &stream, RsaKeyPair *keypair){
-	std::unique_ptr<ArchiveKeys> ret;
-	if (keypair){
-		ret = make_unique(new ArchiveKeys(CryptoPP::Twofish::MAX_KEYLENGTH, CryptoPP::Twofish::BLOCKSIZE));
-
-		CryptoPP::RSA::PublicKey pub;
-		auto &public_key = keypair->get_public_key();
-		{
-			CryptoPP::ArraySource source((const byte *)&public_key[0], public_key.size(), true);
-			pub.Load(source);
-		}
-
-		typedef CryptoPP::RSAES<CryptoPP::OAEP<CryptoPP::SHA>>::Encryptor encryptor_t;
-		typedef CryptoPP::PK_EncryptorFilter filter_t;
-
-		encryptor_t enc(pub);
-		CryptoPP::SecByteBlock buffer(ret->get_size());
-		size_t offset = 0;
-		for (size_t i = 0; i < ret->key_count; i++){
-			auto &key = ret->get_key(i);
-			auto &iv = ret->get_iv(i);
-			memcpy(buffer.data() + offset, key.data(), key.size());
-			offset += key.size();
-			memcpy(buffer.data() + offset, iv.data(), iv.size());
-			offset += iv.size();
-		}
-		boost::iostreams::stream<zstreams::SynchronousSink> sink(stream);
-		CryptoPP::ArraySource(buffer.data(), buffer.size(), true, new filter_t(*random_number_generator, enc, new CryptoPP::FileSink(sink)));
-	}
-	return ret;
-}
-
-ArchiveReader::ArchiveReader(const path_t &path, const path_t *encrypted_fso, RsaKeyPair *keypair):
-		path(path),
-		manifest_offset(-1),
-		keypair(keypair),
-		manifest_size(0){
-	if (!boost::filesystem::exists(path) || !boost::filesystem::is_regular_file(path))
-		throw FileNotFoundException(path);
-}
-
-bool ArchiveReader::get_key_iv(CryptoPP::SecByteBlock &key, CryptoPP::SecByteBlock &iv, KeyIndices index){
-	if (!this->keypair)
-		return false;
-	if (!this->archive_keys){
-		auto stream = this->get_stream();
-		this->archive_keys.reset(new ArchiveKeys(*stream, *this->keypair));
-	}
-	key = this->archive_keys->get_key((size_t)index);
-	iv = this->archive_keys->get_iv((size_t)index);
-	return true;
-}
-
-std::unique_ptr<std::istream> ArchiveReader::get_stream(){
-	auto ret = make_unique(static_cast<std::istream *>(new boost::filesystem::ifstream(path, std::ios::binary)));
-	if (!*ret)
-		throw FileNotFoundException(path);
-	return ret;
-}
-
-std::shared_ptr<VersionManifest> ArchiveReader::read_manifest(){
-	auto stream = this->get_stream();
-	if (this->manifest_offset < 0){
-		const int uint64_length = sizeof(std::uint64_t);
-		std::int64_t start = -uint64_length - sha256_digest_length;
-		stream->seekg(start, std::ios::end);
-		char temp[uint64_length];
-		stream->read(temp, uint64_length);
-		if (stream->gcount() != uint64_length)
-			throw ArchiveReadException("Invalid data: File is too small to possibly be valid");
-		deserialize_fixed_le_int(this->manifest_size, temp);
-		start -= this->manifest_size;
-		stream->seekg(start, std::ios::end);
-		this->manifest_offset = stream->tellg();
-	}else
-		stream->seekg(this->manifest_offset);
-	{
-		zstreams::StreamPipeline pipeline;
-		Stream<zstreams::StdStreamSource> source(stream, pipeline);
-		Stream<zstreams::BoundedSource> bounded(*source, this->manifest_size);
-		Stream<zstreams::LzmaSource> lzma(*bounded);
-		boost::iostreams::stream<zstreams::SynchronousSource> sync_source(*lzma);
-
-		ImplementedDeserializerStream ds(sync_source);
-		this->version_manifest.reset(ds.full_deserialization<VersionManifest>(config::include_typehashes));
-		if (!this->version_manifest)
-			throw ArchiveReadException("Invalid data: Error during manifest deserialization");
-	}
-
-	this->base_objects_offset = this->manifest_offset - this->version_manifest->archive_metadata.entries_size_in_archive;
-	this->stream_ids = this->version_manifest->archive_metadata.stream_ids;
-	this->stream_sizes = this->version_manifest->archive_metadata.stream_sizes;
-
-	return this->version_manifest;
-}
-
-std::vector<std::shared_ptr<FileSystemObject>> ArchiveReader::read_base_objects(){
-	if (!this->version_manifest)
-		this->read_manifest();
-	zekvok_assert(this->version_manifest);
-	decltype(this->base_objects) ret;
-	ret.reserve(this->version_manifest->archive_metadata.entry_sizes.size());
-	auto stream = this->get_stream();
-	stream->seekg(this->base_objects_offset);
-	{
-		zstreams::StreamPipeline pipeline;
-		Stream<zstreams::StdStreamSource> source(stream, pipeline);
-		Stream<zstreams::BoundedSource> bounded(*source, this->manifest_offset - this->base_objects_offset);
-		zstreams::Source *stream2 = &*bounded;
-		Stream<zstreams::CryptoSource> crypto;
-		if (this->keypair){
-			CryptoPP::SecByteBlock key, iv;
-			zekvok_assert(this->get_key_iv(key, iv, KeyIndices::FileObjectDataKey));
-			crypto = zstreams::CryptoSource::create(default_crypto_algorithm, *stream2, &key, &iv);
-			stream2 = &*crypto;
-		}
-		Stream<zstreams::LzmaSource> lzma(*stream2);
-
-		for (const auto &s : this->version_manifest->archive_metadata.entry_sizes){
-			Stream<zstreams::BoundedSource> bounded2(*lzma, s);
-			boost::iostreams::stream<zstreams::SynchronousSource> sync_source(*bounded2);
-			ImplementedDeserializerStream ds(sync_source);
-			std::shared_ptr<FileSystemObject> fso(ds.full_deserialization<FileSystemObject>(config::include_typehashes));
-			if (!fso)
-				throw ArchiveReadException("Invalid data: Error during FSO deserialization");
-			ret.push_back(fso);
-		}
-	}
-	this->base_objects = std::move(ret);
-	return this->base_objects;
-}
-
-void ArchiveReader::read_everything(read_everything_co_t::push_type &sink){
-	if (!this->version_manifest)
-		this->read_manifest();
-	auto ptr = this->get_stream();
-	auto file_data_start = this->keypair ? 4096 / 8 : 0;
-	ptr->seekg(file_data_start);
-
-	zstreams::StreamPipeline pipeline;
-	Stream<zstreams::StdStreamSource> source(ptr, pipeline);
-	Stream<zstreams::BoundedSource> bounded(*source, this->base_objects_offset - file_data_start);
-	zstreams::Source *stream = &*bounded;
-
-	Stream<zstreams::CryptoSource> crypto;
-	if (this->keypair){
-		CryptoPP::SecByteBlock key, iv;
-		zekvok_assert(this->get_key_iv(key, iv, KeyIndices::FileDataKey));
-		crypto = zstreams::CryptoSource::create(default_crypto_algorithm, *stream, &key, &iv);
-		stream = &*crypto;
-	}
-	Stream<zstreams::LzmaSource> lzma(*stream);
-
-	zekvok_assert(this->stream_ids.size() == this->stream_sizes.size());
-	std::uint64_t accumulated_skip = 0;
-	for (size_t i = 0; i < this->stream_ids.size(); i++){
-		ArchivePart part(this->stream_ids[i], &*lzma, this->stream_sizes[i], accumulated_skip);
-		sink(&part);
-		part.check_skip(accumulated_skip);
-	}
-}
-
-ArchiveReader::read_everything_co_t::pull_type ArchiveReader::read_everything(){
-	return read_everything_co_t::pull_type([this](read_everything_co_t::push_type &sink){
-		this->read_everything(sink);
-	});
-}
-
-ArchiveWriter::ArchiveWriter(KernelTransaction &tx, const path_t &path, RsaKeyPair *keypair):
-		state(State::Initial),
-		tx(tx),
-		keypair(keypair),
-		any_file(false){
-	std::unique_ptr<std::ostream> ptr(new boost::iostreams::stream<TransactedFileSink>(this->tx, path.c_str()));
-	this->stream = Stream<zstreams::StdStreamSink>(ptr, this->pipeline);
-}
-
-void ArchiveWriter::process(const std::function<void()> &callback){
-	std::shared_ptr<zstreams::HashSink<CryptoPP::SHA256>::digest_t> complete_hash;
-	{
-		Stream<zstreams::HashSink<CryptoPP::SHA256>> overall_hash(*this->stream);
-		this->nested_stream = &*overall_hash;
-		this->keys = ArchiveKeys::create_and_save(*overall_hash, this->keypair);
-		this->archive_key_index = 0;
-		this->initial_fso_offset = 0;
-
-		callback();
-		zekvok_assert(this->state == State::ManifestWritten);
-		this->state = State::Final;
-
-		complete_hash = overall_hash->get_digest();
-	}
-
-	boost::iostreams::stream<zstreams::SynchronousSink> sync_sink(*this->stream);
-	sync_sink.write(reinterpret_cast<const char *>(complete_hash->data()), complete_hash->size());
-}
-
-void ArchiveWriter::add_files(const std::vector<FileQueueElement> &files){
-	zekvok_assert(this->state == State::Initial);
-	this->state = State::FilesWritten;
-	Stream<zstreams::ByteCounterSink> counter(*this->nested_stream, this->initial_fso_offset);
-	zstreams::Sink *stream = &*counter;
-	Stream<zstreams::CryptoSink> crypto;
-	if (this->keypair){
-		crypto = zstreams::CryptoSink::create(default_crypto_algorithm, *stream, &this->keys->get_key(this->archive_key_index), &this->keys->get_iv(this->archive_key_index));
-		this->archive_key_index++;
-		stream = &*crypto;
-	}
-	
-	bool mt = true;
-	Stream<zstreams::LzmaSink> lzma(*stream, &mt, 1);
-
-	for (auto &fqe : files){
-		std::uint64_t size;
-		auto fso = fqe.fso;
-		std::wcout << fso->get_unmapped_path() << std::endl;
-		auto stream2 = fso->open_for_exclusive_read(size);
-
-		this->stream_ids.push_back(fqe.stream_id);
-		this->stream_sizes.push_back(size);
-
-		std::shared_ptr<zstreams::HashSink<CryptoPP::SHA256>::digest_t> digest;
-		{
-			auto &pipeline = lzma->get_pipeline();
-			Stream<zstreams::StdStreamSource> stdstream(stream2, pipeline);
-			Stream<zstreams::HashSource<CryptoPP::SHA256>> hash(*stdstream);
-			if (size)
-				hash->copy_to(*lzma);
-			digest = hash->get_digest();
-		}
-		fso->set_hash(*digest);
-		this->any_file = true;
-	}
-}
-
-void ArchiveWriter::add_base_objects(const std::vector<FileSystemObject *> &base_objects){
-	zekvok_assert(this->state == State::FilesWritten);
-	this->state = State::FsosWritten;
-	this->entries_size_in_archive = 0;
-
-	Stream<zstreams::ByteCounterSink> counter(*this->nested_stream, this->entries_size_in_archive);
-	zstreams::Sink *stream = &*counter;
-	Stream<zstreams::CryptoSink> crypto;
-	if (this->keypair){
-		crypto = zstreams::CryptoSink::create(default_crypto_algorithm, *stream, &keys->get_key(this->archive_key_index), &keys->get_iv(this->archive_key_index));
-		this->archive_key_index++;
-		stream = &*crypto;
-	}
-		
-	bool mt = true;
-	Stream<zstreams::LzmaSink> lzma(*stream, &mt, 8);
-
-	for (auto i : base_objects){
-		zstreams::streamsize_t bytes_processed = 0;
-		{
-			Stream<zstreams::ByteCounterSink> counter2(*lzma, bytes_processed);
-			boost::iostreams::stream<zstreams::SynchronousSink> sync_sink(*counter2);
-			SerializerStream ss(sync_sink);
-			ss.full_serialization(*i, config::include_typehashes);
-		}
-		this->base_object_entry_sizes.push_back(bytes_processed);
-	}
-}
-
-void ArchiveWriter::add_version_manifest(VersionManifest &manifest){
-	zekvok_assert(this->state == State::FsosWritten);
-	this->state = State::ManifestWritten;
-	zstreams::streamsize_t manifest_length = 0;
-	{
-		Stream<zstreams::ByteCounterSink> counter(*this->nested_stream, manifest_length);
-		
-		bool mt = true;
-
-		manifest.archive_metadata.entry_sizes = std::move(this->base_object_entry_sizes);
-		manifest.archive_metadata.stream_ids = std::move(this->stream_ids);
-		manifest.archive_metadata.stream_sizes = std::move(this->stream_sizes);
-		manifest.archive_metadata.entries_size_in_archive = this->entries_size_in_archive;
-
-		Stream<zstreams::LzmaSink> lzma(*counter, &mt, 8);
-		boost::iostreams::stream<zstreams::SynchronousSink> sync_sink(*lzma);
-		SerializerStream ss(sync_sink);
-		ss.full_serialization(manifest, config::include_typehashes);
-	}
-	auto s_manifest_length = serialize_fixed_le_int(manifest_length);
-	boost::iostreams::stream<zstreams::SynchronousSink> sync_sink(*this->nested_stream);
-	sync_sink.write(reinterpret_cast<const char *>(s_manifest_length.data()), s_manifest_length.size());
-}
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "ArchiveIO.h"
+#include "CryptoFilter.h"
+#include "serialization/fso.generated.h"
+#include "BoundedStreamFilter.h"
+#include "LzmaFilter.h"
+#include "CompressionFilter.h"
+#include "serialization/ImplementedDS.h"
+#include "NullStream.h"
+#include "System/Transactions.h"
+#include "HashFilter.h"
+#include "TeeFilter.h"
+#include "SegmentWriter.h"
+#include "StreamProcessor.h"
+#include "MemoryStream.h"
+#include "BatchHasher.h"
+#include "Xxh3.h"
+
+const Algorithm default_crypto_algorithm = Algorithm::Twofish;
+const std::uint64_t large_segment_threshold = BufferPool::large_size * 4;
+using zstreams::Stream;
+// Archives may be read and written from several threads at once (see
+// BackupSystem::recompress()), but the random number generator isn't
+// thread-safe.
+static std::mutex random_number_generator_mutex;
+
+ArchiveKeys::ArchiveKeys(size_t key_size, size_t iv_size){
+	this->init(key_size, iv_size);
+}
+
+void ArchiveKeys::init(size_t key_size, size_t iv_size, bool randomize){
+	LOCK_MUTEX(random_number_generator_mutex);
+	this->size = 0;
+	for (auto &i : this->keys){
+		i.resize(key_size);
+		this->size += key_size;
+		if (randomize)
+			random_number_generator->GenerateBlock(i.data(), i.size());
+	}
+	for (auto &i : this->ivs){
+		i.resize(iv_size);
+		this->size += iv_size;
+		if (randomize)
+			random_number_generator->GenerateBlock(i.data(), i.size());
+	}
+	zekvok_assert(this->size <= 4096 / 8 - 42);
+}
+
+const CryptoPP::SecByteBlock &ArchiveKeys::get_key(size_t i) const{
+	if (i > array_size(this->keys))
+		throw IncorrectImplementationException();
+	return this->keys[i];
+}
+
+const CryptoPP::SecByteBlock &ArchiveKeys::get_iv(size_t i) const{
+	if (i > array_size(this->ivs))
+		throw IncorrectImplementationException();
+	return this->ivs[i];
+}
+
+ArchiveKeys::ArchiveKeys(std::istream &stream, RsaKeyPair &keypair){
+	this->init(CryptoPP::Twofish::MAX_KEYLENGTH, CryptoPP::Twofish::BLOCKSIZE, false);
+
+	auto &private_key = keypair.get_private_key();
+
+	CryptoPP::RSA::PrivateKey priv;
+	{
+		CryptoPP::ArraySource source(static_cast<const byte *>(&private_key[0]), private_key.size(), true);
+		priv.Load(source);
+	}
+
+	CryptoPP::SecByteBlock buffer(this->size);
+	{
+		auto n = 4096 / 8;
+
+		typedef CryptoPP::RSAES<CryptoPP::OAEP<CryptoPP::SHA>>::Decryptor decryptor_t;
+		typedef CryptoPP::PK_DecryptorFilter filter_t;
+		decryptor_t dec(priv);
+		CryptoPP::SecByteBlock temp(n);
+		stream.read(reinterpret_cast<char *>(temp.data()), temp.size());
+		auto read = stream.gcount();
+		if (read != temp.size())
+			throw RsaBlockDecryptionException("Not enough bytes read from RSA block.");
+		try{
+			LOCK_MUTEX(random_number_generator_mutex);
+			auto sink = new CryptoPP::ArraySink(buffer.data(), buffer.size());
+			auto filter = new filter_t(*random_number_generator, dec, sink);
+			CryptoPP::ArraySource(temp.data(), temp.size(), true, filter);
+		}catch (...){
+			throw RsaBlockDecryptionException("Invalid data in RSA block.");
+		}
+	}
+
+	size_t offset = 0;
+	for (size_t i = 0; i < this->key_count; i++){
+		auto &key = this->keys[i];
+		auto &iv = this->ivs[i];
+		memcpy(key.data(), buffer.data() + offset, key.size());
+		offset += key.size();
+		memcpy(iv.data(), buffer.data() + offset, iv.size());
+		offset += iv.size();
+	}
+}
+
+std::unique_ptr<ArchiveKeys> ArchiveKeys::create_and_save(zstreams::Sink &stream, RsaKeyPair *keypair){
+	std::unique_ptr<ArchiveKeys> ret;
+	if (keypair){
+		ret = make_unique(new ArchiveKeys(CryptoPP::Twofish::MAX_KEYLENGTH, CryptoPP::Twofish::BLOCKSIZE));
+
+		CryptoPP::RSA::PublicKey pub;
+		auto &public_key = keypair->get_public_key();
+		{
+			CryptoPP::ArraySource source((const byte *)&public_key[0], public_key.size(), true);
+			pub.Load(source);
+		}
+
+		typedef CryptoPP::RSAES<CryptoPP::OAEP<CryptoPP::SHA>>::Encryptor encryptor_t;
+		typedef CryptoPP::PK_EncryptorFilter filter_t;
+
+		encryptor_t enc(pub);
+		CryptoPP::SecByteBlock buffer(ret->get_size());
+		size_t offset = 0;
+		for (size_t i = 0; i < ret->key_count; i++){
+			auto &key = ret->get_key(i);
+			auto &iv = ret->get_iv(i);
+			memcpy(buffer.data() + offset, key.data(), key.size());
+			offset += key.size();
+			memcpy(buffer.data() + offset, iv.data(), iv.size());
+			offset += iv.size();
+		}
+		boost::iostreams::stream<zstreams::SynchronousSink> sink(stream);
+		LOCK_MUTEX(random_number_generator_mutex);
+		CryptoPP::ArraySource(buffer.data(), buffer.size(), true, new filter_t(*random_number_generator, enc, new CryptoPP::FileSink(sink)));
+	}
+	return ret;
+}
+
+ArchiveReader::ArchiveReader(const path_t &path, const path_t *encrypted_fso, RsaKeyPair *keypair):
+		path(path),
+		manifest_offset(-1),
+		keypair(keypair),
+		manifest_size(0),
+		dictionary_reader(nullptr){
+	if (!boost::filesystem::exists(path) || !boost::filesystem::is_regular_file(path))
+		throw FileNotFoundException(path);
+}
+
+bool ArchiveReader::get_key_iv(CryptoPP::SecByteBlock &key, CryptoPP::SecByteBlock &iv, KeyIndices index){
+	if (!this->keypair)
+		return false;
+	if (!this->archive_keys){
+		auto stream = this->get_stream();
+		this->archive_keys.reset(new ArchiveKeys(*stream, *this->keypair));
+	}
+	key = this->archive_keys->get_key((size_t)index);
+	iv = this->archive_keys->get_iv((size_t)index);
+	return true;
+}
+
+std::unique_ptr<std::istream> ArchiveReader::get_stream(){
+	auto ret = make_unique(static_cast<std::istream *>(new boost::filesystem::ifstream(path, std::ios::binary)));
+	if (!*ret)
+		throw FileNotFoundException(path);
+	return ret;
+}
+
+std::shared_ptr<VersionManifest> ArchiveReader::read_manifest(){
+	auto stream = this->get_stream();
+	if (this->manifest_offset < 0){
+		const int uint64_length = sizeof(std::uint64_t);
+		std::int64_t start = -uint64_length - sha256_digest_length;
+		stream->seekg(start, std::ios::end);
+		char temp[uint64_length];
+		stream->read(temp, uint64_length);
+		if (stream->gcount() != uint64_length)
+			throw ArchiveReadException("Invalid data: File is too small to possibly be valid");
+		deserialize_fixed_le_int(this->manifest_size, temp);
+		start -= this->manifest_size;
+		stream->seekg(start, std::ios::end);
+		this->manifest_offset = stream->tellg();
+	}else
+		stream->seekg(this->manifest_offset);
+	{
+		zstreams::StreamPipeline pipeline;
+		Stream<zstreams::StdStreamSource> source(stream, pipeline);
+		Stream<zstreams::BoundedSource> bounded(*source, this->manifest_size);
+		Stream<zstreams::LzmaSource> lzma(*bounded);
+		boost::iostreams::stream<zstreams::SynchronousSource> sync_source(*lzma);
+
+		ImplementedDeserializerStream ds(sync_source);
+		this->version_manifest.reset(ds.full_deserialization<VersionManifest>(config::include_typehashes));
+		if (!this->version_manifest)
+			throw ArchiveReadException("Invalid data: Error during manifest deserialization");
+
+		// Older archives have nothing after the manifest, and archives whose
+		// file data is a single stream don't have a block index.
+		auto &metadata = this->version_manifest->archive_metadata;
+		if (sync_source.peek() != std::char_traits<char>::eof()){
+			ImplementedDeserializerStream ds2(sync_source);
+			metadata.codecs.reset(ds2.full_deserialization<ArchiveCodecs>(config::include_typehashes));
+			if (!metadata.codecs)
+				throw ArchiveReadException("Invalid data: Error during codec deserialization");
+		}else
+			metadata.codecs = std::make_shared<ArchiveCodecs>();
+		this->get_codec(metadata.codecs->file_data);
+		this->get_codec(metadata.codecs->base_objects);
+		if (sync_source.peek() != std::char_traits<char>::eof()){
+			ImplementedDeserializerStream ds3(sync_source);
+			std::shared_ptr<ArchiveBlockIndex> index(ds3.full_deserialization<ArchiveBlockIndex>(config::include_typehashes));
+			if (!index)
+				throw ArchiveReadException("Invalid data: Error during block index deserialization");
+			metadata.block_index = index;
+		}
+		if (sync_source.peek() != std::char_traits<char>::eof()){
+			ImplementedDeserializerStream ds4(sync_source);
+			metadata.stored_data.reset(ds4.full_deserialization<ArchiveStoredData>(config::include_typehashes));
+			if (!metadata.stored_data)
+				throw ArchiveReadException("Invalid data: Error during stored data deserialization");
+		}
+		if (sync_source.peek() != std::char_traits<char>::eof()){
+			ImplementedDeserializerStream ds5(sync_source);
+			metadata.primed_data.reset(ds5.full_deserialization<ArchivePrimedData>(config::include_typehashes));
+			auto &primed = metadata.primed_data;
+			if (!primed)
+				throw ArchiveReadException("Invalid data: Error during primed data deserialization");
+			auto n = primed->compressed_sizes.size();
+			if (primed->dictionary_versions.size() != n || primed->dictionary_stream_ids.size() != n || n > this->version_manifest->archive_metadata.stream_ids.size())
+				throw ArchiveReadException("Invalid data: Inconsistent primed data");
+		}
+		if (sync_source.peek() != std::char_traits<char>::eof()){
+			ImplementedDeserializerStream ds6(sync_source);
+			metadata.encryption.reset(ds6.full_deserialization<ArchiveEncryption>(config::include_typehashes));
+			auto &encryption = metadata.encryption;
+			if (!encryption)
+				throw ArchiveReadException("Invalid data: Error during encryption mode deserialization");
+			// Only the chunked modes are recorded. CBC with no chunks is a
+			// placeholder that comes before the fingerprints (see
+			// ArchiveWriter::add_version_manifest()).
+			if (encryption->mode == (std::uint32_t)CryptoMode::Cbc && !encryption->chunk_size)
+				encryption.reset();
+			else{
+				if (encryption->mode == (std::uint32_t)CryptoMode::Cbc || encryption->mode >= (std::uint32_t)CryptoMode::Count)
+					throw ArchiveReadException("Invalid data: Archive uses an unknown encryption mode");
+				if (!encryption->chunk_size || encryption->chunk_size > max_crypto_chunk_size)
+					throw ArchiveReadException("Invalid data: Invalid encryption chunk size");
+			}
+		}
+		if (sync_source.peek() != std::char_traits<char>::eof()){
+			ImplementedDeserializerStream ds7(sync_source);
+			metadata.fingerprints.reset(ds7.full_deserialization<ArchiveFingerprints>(config::include_typehashes));
+			auto &fingerprints = metadata.fingerprints;
+			if (!fingerprints)
+				throw ArchiveReadException("Invalid data: Error during fingerprint deserialization");
+			auto &ids = fingerprints->stream_ids;
+			if (fingerprints->digests.size() != ids.size() * fingerprint_length || std::adjacent_find(ids.begin(), ids.end(), std::greater_equal<stream_id_t>()) != ids.end())
+				throw ArchiveReadException("Invalid data: Inconsistent fingerprints");
+		}
+	}
+
+	this->base_objects_offset = this->manifest_offset - this->version_manifest->archive_metadata.entries_size_in_archive;
+	this->stream_ids = this->version_manifest->archive_metadata.stream_ids;
+	this->stream_sizes = this->version_manifest->archive_metadata.stream_sizes;
+
+	return this->version_manifest;
+}
+
+Codec ArchiveReader::get_codec(std::uint32_t value) const{
+	if (value >= (std::uint32_t)Codec::Count)
+		throw ArchiveReadException("Invalid data: Archive uses an unknown codec");
+	return (Codec)value;
+}
+
+std::vector<std::shared_ptr<FileSystemObject>> ArchiveReader::read_base_objects(){
+	if (!this->version_manifest)
+		this->read_manifest();
+	zekvok_assert(this->version_manifest);
+	decltype(this->base_objects) ret;
+	ret.reserve(this->version_manifest->archive_metadata.entry_sizes.size());
+	auto stream = this->get_stream();
+	stream->seekg(this->base_objects_offset);
+	{
+		zstreams::StreamPipeline pipeline;
+		Stream<zstreams::StdStreamSource> source(stream, pipeline);
+		Stream<zstreams::BoundedSource> bounded(*source, this->manifest_offset - this->base_objects_offset);
+		zstreams::Source *stream2 = &*bounded;
+		Stream<zstreams::CryptoSource> crypto;
+		if (this->keypair){
+			CryptoPP::SecByteBlock key, iv;
+			zekvok_assert(this->get_key_iv(key, iv, KeyIndices::FileObjectDataKey));
+			auto &encryption = this->version_manifest->archive_metadata.encryption;
+			if (encryption)
+				crypto = zstreams::CryptoSource::create_chunked((CryptoMode)encryption->mode, *stream2, &key, &iv, encryption->chunk_size, 0);
+			else
+				crypto = zstreams::CryptoSource::create(default_crypto_algorithm, *stream2, &key, &iv);
+			stream2 = &*crypto;
+		}
+		auto codec = this->get_codec(this->version_manifest->archive_metadata.codecs->base_objects);
+		auto decompressor = zstreams::create_decompressor(codec, *stream2);
+
+		for (const auto &s : this->version_manifest->archive_metadata.entry_sizes){
+			Stream<zstreams::BoundedSource> bounded2(*decompressor, s);
+			boost::iostreams::stream<zstreams::SynchronousSource> sync_source(*bounded2);
+			ImplementedDeserializerStream ds(sync_source);
+			std::shared_ptr<FileSystemObject> fso(ds.full_deserialization<FileSystemObject>(config::include_typehashes));
+			if (!fso)
+				throw ArchiveReadException("Invalid data: Error during FSO deserialization");
+			this->set_fingerprints(*fso);
+			ret.push_back(fso);
+		}
+	}
+	this->base_objects = std::move(ret);
+	return this->base_objects;
+}
+
+void ArchiveReader::set_fingerprints(FileSystemObject &fso){
+	if (!this->version_manifest)
+		this->read_manifest();
+	auto &fingerprints = this->version_manifest->archive_metadata.fingerprints;
+	if (!fingerprints)
+		return;
+	fingerprint_t fingerprint;
+	for (auto i : fso.get_iterator())
+		if (!i->is_directoryish() && fingerprints->find(fingerprint, i->get_stream_id()))
+			static_cast<FilishFso *>(i)->set_fingerprint(fingerprint);
+}
+
+// Decodes the file data of an archive. If the archive has a block index,
+// skipping forward past the start of a block restarts decoding at that block,
+// rather than decoding everything in between. Stored files can be read
+// starting from anywhere. Primed files are decoded whole, in memory, since
+// each needs its own dictionary.
+class ArchiveFileData{
+	ArchiveReader &reader;
+	std::int64_t start;
+	std::unique_ptr<zstreams::StreamPipeline> pipeline;
+	Stream<zstreams::Source> source,
+		bounded,
+		crypto,
+		bounded_plaintext,
+		decompressor,
+		primed_source;
+	buffer_t primed_file;
+	zstreams::Source *current;
+	bool reading_stored;
+	// Offset into the uncompressed data of the next byte current will produce.
+	std::uint64_t position;
+
+	void open(std::uint64_t offset, std::uint64_t uncompressed_offset, bool compressed, const std::vector<std::uint64_t> &block_sizes = {}, std::uint64_t block_size = 0);
+	void open_primed(std::uint64_t offset);
+	void close();
+	std::uint64_t get_compressed_end() const;
+public:
+	ArchiveFileData(ArchiveReader &reader);
+	~ArchiveFileData(){
+		this->close();
+	}
+	// Returns a source positioned at the given offset into the uncompressed
+	// data. Offsets may not decrease from one call to the next.
+	zstreams::Source *seek(std::uint64_t offset);
+	void advance(std::uint64_t bytes){
+		this->position += bytes;
+	}
+};
+
+ArchiveFileData::ArchiveFileData(ArchiveReader &reader):
+		reader(reader),
+		start(reader.keypair ? 4096 / 8 : 0),
+		current(nullptr),
+		reading_stored(false),
+		position(0){}
+
+void ArchiveFileData::close(){
+	this->current = nullptr;
+	this->primed_source = Stream<zstreams::Source>();
+	this->primed_file.clear();
+	this->decompressor = Stream<zstreams::Source>();
+	this->bounded_plaintext = Stream<zstreams::Source>();
+	this->crypto = Stream<zstreams::Source>();
+	this->bounded = Stream<zstreams::Source>();
+	this->source = Stream<zstreams::Source>();
+	this->pipeline.reset();
+}
+
+std::uint64_t ArchiveFileData::get_compressed_end() const{
+	auto &metadata = this->reader.version_manifest->archive_metadata;
+	if (metadata.stored_data)
+		return metadata.stored_data->offset;
+	if (metadata.primed_data)
+		return metadata.primed_data->offset;
+	return this->reader.base_objects_offset - this->start;
+}
+
+void ArchiveFileData::open(std::uint64_t offset, std::uint64_t uncompressed_offset, bool compressed, const std::vector<std::uint64_t> &block_sizes, std::uint64_t block_size){
+	this->close();
+	auto data_offset = offset;
+	std::uint64_t discard = 0,
+		first_chunk = 0;
+	CryptoPP::SecByteBlock key, iv;
+	auto ptr = this->reader.get_stream();
+	auto &encryption = this->reader.version_manifest->archive_metadata.encryption;
+	if (this->reader.keypair && encryption){
+		zekvok_assert(this->reader.get_key_iv(key, iv, KeyIndices::FileDataKey));
+		// In the chunked modes, decryption can start at any chunk.
+		first_chunk = offset / encryption->chunk_size;
+		discard = offset % encryption->chunk_size;
+		offset = first_chunk * (encryption->chunk_size + crypto_tag_size);
+	}else if (this->reader.keypair){
+		zekvok_assert(this->reader.get_key_iv(key, iv, KeyIndices::FileDataKey));
+		// In CBC mode, decryption can start at any cipher block by using the
+		// previous one as the IV.
+		discard = offset % iv.size();
+		offset -= discard;
+		if (offset){
+			ptr->seekg(this->start + offset - iv.size());
+			ptr->read((char *)iv.data(), iv.size());
+			if (ptr->gcount() != iv.size())
+				throw ArchiveReadException("Invalid data: Block index points past the end of the file data");
+		}
+	}
+	ptr->seekg(this->start + offset);
+
+	this->pipeline = make_unique(new zstreams::StreamPipeline);
+	this->source = Stream<zstreams::StdStreamSource>(ptr, *this->pipeline);
+	this->bounded = Stream<zstreams::BoundedSource>(*this->source, this->reader.base_objects_offset - this->start - offset);
+	zstreams::Source *stream = &*this->bounded;
+	if (this->reader.keypair){
+		if (encryption)
+			this->crypto = zstreams::CryptoSource::create_chunked((CryptoMode)encryption->mode, *stream, &key, &iv, encryption->chunk_size, first_chunk);
+		else
+			this->crypto = zstreams::CryptoSource::create(default_crypto_algorithm, *stream, &key, &iv);
+		stream = &*this->crypto;
+		if (discard){
+			Stream<zstreams::BoundedSource> temp(*stream, discard);
+			temp->discard_rest();
+		}
+	}
+	this->position = uncompressed_offset;
+	this->reading_stored = !compressed;
+	if (!compressed){
+		this->current = stream;
+		return;
+	}
+	// Keep the decompressor from reading into the stored and primed data.
+	auto &metadata = this->reader.version_manifest->archive_metadata;
+	if (metadata.stored_data || metadata.primed_data){
+		this->bounded_plaintext = Stream<zstreams::BoundedSource>(*stream, this->get_compressed_end() - data_offset);
+		stream = &*this->bounded_plaintext;
+	}
+	auto codec = this->reader.get_codec(this->reader.version_manifest->archive_metadata.codecs->file_data);
+	this->decompressor = zstreams::create_decompressor(codec, *stream, block_sizes, block_size);
+	this->current = &*this->decompressor;
+}
+
+void ArchiveFileData::open_primed(std::uint64_t offset){
+	auto &reader = this->reader;
+	auto &primed = *reader.version_manifest->archive_metadata.primed_data;
+	auto n = primed.compressed_sizes.size();
+	auto first = reader.stream_ids.size() - n;
+	auto uncompressed_offset = primed.uncompressed_offset;
+	auto compressed_offset = primed.offset;
+	size_t i = 0;
+	for (; i < n && uncompressed_offset < offset; i++){
+		uncompressed_offset += reader.stream_sizes[first + i];
+		compressed_offset += primed.compressed_sizes[i];
+	}
+	if (i == n || uncompressed_offset != offset)
+		throw ArchiveReadException("Invalid data: Primed files can only be read from their start");
+
+	this->open(compressed_offset, offset, false);
+	this->reading_stored = false;
+	buffer_t compressed;
+	{
+		Stream<zstreams::BoundedSource> bounded(*this->current, primed.compressed_sizes[i]);
+		Stream<zstreams::MemorySink> sink(compressed, *this->pipeline);
+		bounded->copy_to(*sink);
+	}
+	buffer_t dictionary;
+	auto version = primed.dictionary_versions[i];
+	if (version != invalid_version_number){
+		if (!reader.dictionary_reader)
+			throw ArchiveReadException("Primed files can't be read without the rest of the backup");
+		reader.dictionary_reader->read(dictionary, version, primed.dictionary_stream_ids[i]);
+	}
+	auto codec = reader.get_codec(reader.version_manifest->archive_metadata.codecs->file_data);
+	this->primed_file = zstreams::decompress_with_dictionary(codec, compressed, reader.stream_sizes[first + i], dictionary);
+	this->primed_source = Stream<zstreams::MemorySource>(this->primed_file.data(), this->primed_file.size(), *this->pipeline);
+	this->current = &*this->primed_source;
+}
+
+zstreams::Source *ArchiveFileData::seek(std::uint64_t offset){
+	zekvok_assert(!this->current || offset >= this->position);
+	auto &metadata = this->reader.version_manifest->archive_metadata;
+	auto &index = metadata.block_index;
+	auto &stored = metadata.stored_data;
+	auto &primed = metadata.primed_data;
+	if (primed && primed->compressed_sizes.size() && offset >= primed->uncompressed_offset){
+		this->open_primed(offset);
+		return this->current;
+	}
+	if (stored && offset >= stored->uncompressed_offset){
+		if (!this->reading_stored || offset != this->position)
+			this->open(stored->offset + (offset - stored->uncompressed_offset), offset, false);
+	}else if (index && index->block_offsets.size()){
+		auto block = index->find_block(offset);
+		auto uncompressed_offset = index->uncompressed_offsets[block];
+		if (!this->current || uncompressed_offset > this->position){
+			// The blocks from here on are decoded in parallel.
+			auto &offsets = index->block_offsets;
+			std::vector<std::uint64_t> block_sizes;
+			for (auto i = block; i < offsets.size(); i++){
+				auto end = i + 1 < offsets.size() ? offsets[i + 1] : this->get_compressed_end();
+				block_sizes.push_back(end - offsets[i]);
+			}
+			this->open(offsets[block], uncompressed_offset, true, block_sizes, index->block_size);
+		}
+	}else if (!this->current)
+		this->open(0, 0, true);
+	if (offset > this->position){
+		Stream<zstreams::BoundedSource> temp(*this->current, offset - this->position);
+		temp->discard_rest();
+		this->position = offset;
+	}
+	return this->current;
+}
+
+zstreams::Source *ArchiveReader::ArchivePart::read(){
+	auto source = this->file_data->seek(this->offset);
+	this->created_source = zstreams::Stream<zstreams::BoundedSource>(*source, this->stream_length);
+	return &*this->created_source;
+}
+
+void ArchiveReader::ArchivePart::finish(){
+	if (this->was_skipped || !this->created_source)
+		return;
+	std::uint64_t written = 0;
+	this->created_source->set_bytes_written_dst(written);
+	this->created_source = zstreams::Stream<zstreams::Source>();
+	this->file_data->advance(written);
+}
+
+void ArchiveReader::read_everything(read_everything_co_t::push_type &sink){
+	if (!this->version_manifest)
+		this->read_manifest();
+
+	ArchiveFileData file_data(*this);
+
+	zekvok_assert(this->stream_ids.size() == this->stream_sizes.size());
+	std::uint64_t offset = 0;
+	for (size_t i = 0; i < this->stream_ids.size(); i++){
+		ArchivePart part(this->stream_ids[i], &file_data, this->stream_sizes[i], offset);
+		sink(&part);
+		part.finish();
+		offset += this->stream_sizes[i];
+	}
+}
+
+ArchiveReader::read_everything_co_t::pull_type ArchiveReader::read_everything(){
+	return read_everything_co_t::pull_type([this](read_everything_co_t::push_type &sink){
+		this->read_everything(sink);
+	});
+}
+
+ArchiveStreamReader::ArchiveStreamReader(const path_getter_t &get_path, RsaKeyPair *keypair):
+		get_path(get_path),
+		keypair(keypair){}
+
+std::shared_ptr<VersionManifest> ArchiveStreamReader::get_manifest(version_number_t version){
+	auto &ret = this->manifests[version];
+	if (!ret)
+		ret = ArchiveReader(this->get_path(version), nullptr, this->keypair).read_manifest();
+	return ret;
+}
+
+void ArchiveStreamReader::read(buffer_t &dst, version_number_t version, stream_id_t stream_id){
+	auto &cursor = this->cursors[version];
+	if (!cursor.parts || !*cursor.parts || cursor.parts->get()->get_stream_id() > stream_id){
+		cursor.parts.reset();
+		cursor.reader.reset(new ArchiveReader(this->get_path(version), nullptr, this->keypair));
+		cursor.reader->set_dictionary_reader(this);
+		cursor.parts.reset(new ArchiveReader::read_everything_co_t::pull_type(cursor.reader->read_everything()));
+	}
+	auto &parts = *cursor.parts;
+	for (; parts; parts()){
+		auto part = parts.get();
+		if (part->get_stream_id() < stream_id){
+			part->skip();
+			continue;
+		}
+		if (part->get_stream_id() > stream_id)
+			break;
+		dst.clear();
+		{
+			const size_t chunk_size = 1 << 16;
+			zstreams::SynchronousSourceImpl source(*part->read());
+			while (true){
+				auto size = dst.size();
+				dst.resize(size + chunk_size);
+				auto read = source.read((char *)&dst[size], chunk_size);
+				dst.resize(size + (size_t)std::max<std::streamsize>(read, 0));
+				if (read <= 0)
+					break;
+			}
+		}
+		parts();
+		return;
+	}
+	throw ArchiveReadException("Invalid data: A primed file refers to a stream that doesn't exist");
+}
+
+unsigned ArchiveStreamReader::get_priming_depth(version_number_t version, stream_id_t stream_id, std::set<version_number_t> &versions){
+	unsigned ret = 0;
+	while (true){
+		versions.insert(version);
+		auto &metadata = this->get_manifest(version)->archive_metadata;
+		auto &ids = metadata.stream_ids;
+		auto it = std::find(ids.begin(), ids.end(), stream_id);
+		if (it == ids.end())
+			throw ArchiveReadException("Invalid data: A primed file refers to a stream that doesn't exist");
+		auto &primed = metadata.primed_data;
+		auto index = primed ? primed->find_file(it - ids.begin(), ids.size()) : -1;
+		if (index < 0)
+			break;
+		ret++;
+		auto next_version = primed->dictionary_versions[(size_t)index];
+		if (next_version == invalid_version_number)
+			break;
+		// Dictionaries always come from earlier versions, so this ends.
+		if (next_version >= version)
+			throw ArchiveReadException("Invalid data: A primed file refers to a later version");
+		version = next_version;
+		stream_id = primed->dictionary_stream_ids[(size_t)index];
+	}
+	return ret;
+}
+
+ArchiveWriter::ArchiveWriter(KernelTransaction &tx, const path_t &path, RsaKeyPair *keypair):
+		state(State::Initial),
+		tx(tx),
+		keypair(keypair),
+		any_file(false),
+		block_size(0),
+		file_data_codec(Codec::Lzma),
+		base_objects_codec(Codec::Lzma),
+		compression_level(CompressionLevel::Normal),
+		file_data_level(-1),
+		multithreaded(true),
+		large_segment_size(BufferPool::large_size),
+		dictionary_reader(nullptr),
+		crypto_mode(CryptoMode::Cbc){
+	std::unique_ptr<std::ostream> ptr(new boost::iostreams::stream<TransactedFileSink>(this->tx, path.c_str(), false));
+	this->stream = Stream<zstreams::StdStreamSink>(ptr, this->pipeline);
+}
+
+// The mode is recorded after the manifest, so archives in CBC mode don't need
+// to record it.
+bool ArchiveWriter::writes_encryption_mode() const{
+	return this->keypair && this->crypto_mode != CryptoMode::Cbc;
+}
+
+// Each call uses the next key.
+Stream<zstreams::CryptoSink> ArchiveWriter::create_crypto_sink(zstreams::Sink &stream){
+	auto i = this->archive_key_index++;
+	return zstreams::CryptoSink::create(this->crypto_mode, default_crypto_algorithm, stream, &this->keys->get_key(i), &this->keys->get_iv(i));
+}
+
+void ArchiveWriter::process(const std::function<void()> &callback){
+	std::shared_ptr<zstreams::HashSink<CryptoPP::SHA256>::digest_t> complete_hash;
+	{
+		Stream<zstreams::HashSink<CryptoPP::SHA256>> overall_hash(*this->stream);
+		this->nested_stream = &*overall_hash;
+		this->keys = ArchiveKeys::create_and_save(*overall_hash, this->keypair);
+		this->archive_key_index = 0;
+		this->initial_fso_offset = 0;
+
+		callback();
+		zekvok_assert(this->state == State::ManifestWritten);
+		this->state = State::Final;
+
+		complete_hash = overall_hash->get_digest();
+	}
+
+	zstreams::SegmentWriter writer(*this->stream);
+	writer.write(complete_hash->data(), complete_hash->size());
+}
+
+// Finds the stream that each block starts in.
+static std::shared_ptr<ArchiveBlockIndex> make_block_index(
+		std::uint64_t block_size,
+		const zstreams::CompressorSink::blocks_t &blocks,
+		const std::vector<stream_id_t> &stream_ids,
+		const std::vector<std::uint64_t> &stream_sizes){
+	auto ret = std::make_shared<ArchiveBlockIndex>();
+	ret->block_size = block_size;
+	size_t stream = 0;
+	std::uint64_t stream_start = 0;
+	for (auto &block : blocks){
+		while (stream < stream_sizes.size() && stream_start + stream_sizes[stream] <= block.uncompressed_offset)
+			stream_start += stream_sizes[stream++];
+		ret->block_offsets.push_back(block.offset);
+		ret->uncompressed_offsets.push_back(block.uncompressed_offset);
+		ret->first_stream_ids.push_back(stream < stream_ids.size() ? stream_ids[stream] : invalid_stream_id);
+	}
+	return ret;
+}
+
+void ArchiveWriter::add_files(const std::vector<FileQueueElement> &files){
+	BatchHasher hasher;
+	this->write_file_data(files, [this, &hasher](zstreams::Sink &sink, const FileQueueElement &fqe){ this->add_file(sink, fqe, hasher); });
+	hasher.flush();
+}
+
+void ArchiveWriter::copy_files(ArchiveReader &reader, const std::function<ContentFilter(stream_id_t)> &get_filter){
+	if (!reader.version_manifest)
+		reader.read_manifest();
+	auto &stored = reader.version_manifest->archive_metadata.stored_data;
+	auto &primed = reader.version_manifest->archive_metadata.primed_data;
+	std::vector<FileQueueElement> files;
+	std::uint64_t offset = 0;
+	for (size_t i = 0; i < reader.stream_ids.size(); i++){
+		auto id = reader.stream_ids[i];
+		auto primed_index = primed ? primed->find_file(i, reader.stream_ids.size()) : -1;
+		if (primed_index >= 0){
+			auto j = (size_t)primed_index;
+			files.push_back({ nullptr, id, false, ContentFilter::None, true, primed->dictionary_versions[j], primed->dictionary_stream_ids[j] });
+		}else{
+			bool is_stored = stored && offset >= stored->uncompressed_offset;
+			files.push_back({ nullptr, id, is_stored, is_stored ? ContentFilter::None : get_filter(id) });
+		}
+		offset += reader.stream_sizes[i];
+	}
+
+	auto parts = reader.read_everything();
+	this->write_file_data(files, [this, &parts](zstreams::Sink &sink, const FileQueueElement &fqe){
+		zekvok_assert(parts && parts.get()->get_stream_id() == fqe.stream_id);
+		// The source belongs to the reader's pipeline, so it's read
+		// synchronously rather than connected to the sink.
+		std::uint64_t size = 0;
+		{
+			zstreams::SynchronousSourceImpl source(*parts.get()->read());
+			zstreams::SegmentWriter writer(sink);
+			while (true){
+				auto span = writer.get_span();
+				auto read = source.read((char *)span.data, span.size);
+				if (read <= 0)
+					break;
+				writer.commit((size_t)read);
+				size += read;
+			}
+		}
+		this->stream_ids.push_back(fqe.stream_id);
+		this->stream_sizes.push_back(size);
+		this->any_file = true;
+		parts();
+	});
+}
+
+void ArchiveWriter::write_file_data(const std::vector<FileQueueElement> &files, const file_writer_t &write_file){
+	zekvok_assert(this->state == State::Initial);
+	this->state = State::FilesWritten;
+	Stream<zstreams::ByteCounterSink> counter(*this->nested_stream, this->initial_fso_offset);
+	zstreams::Sink *stream = &*counter;
+	Stream<zstreams::CryptoSink> crypto;
+	if (this->keypair){
+		crypto = this->create_crypto_sink(*stream);
+		stream = &*crypto;
+	}
+	
+	auto first_primed = std::find_if(files.begin(), files.end(), [](const FileQueueElement &fqe){ return fqe.primed; });
+	zekvok_assert(std::all_of(first_primed, files.end(), [](const FileQueueElement &fqe){ return fqe.primed; }));
+	auto first_stored = std::find_if(files.begin(), first_primed, [](const FileQueueElement &fqe){ return fqe.stored; });
+	zekvok_assert(std::all_of(first_stored, first_primed, [](const FileQueueElement &fqe){ return fqe.stored; }));
+
+	// Each run of files that use the same filter gets a compressor of its
+	// own. Their outputs are simply concatenated, and their blocks are added
+	// to the index.
+	zstreams::CompressorSink::blocks_t blocks;
+	zstreams::streamsize_t compressed_size = 0;
+	std::uint64_t uncompressed_size = 0;
+	bool use_filters = zstreams::codec_supports_filters(this->file_data_codec);
+	auto get_filter = [use_filters](const FileQueueElement &fqe){
+		return use_filters ? fqe.filter : ContentFilter::None;
+	};
+	auto group_begin = files.begin();
+	do{
+		auto filter = group_begin != first_stored ? get_filter(*group_begin) : ContentFilter::None;
+		auto group_end = group_begin;
+		while (group_end != first_stored && get_filter(*group_end) == filter)
+			++group_end;
+
+		zstreams::streamsize_t group_size;
+		std::shared_ptr<zstreams::CompressorSink::blocks_t> group_blocks;
+		{
+			Stream<zstreams::ByteCounterSink> counter2(*stream, group_size);
+			bool mt = this->multithreaded;
+			auto compressor = this->file_data_level < 0 ?
+				zstreams::create_compressor(this->file_data_codec, *counter2, &mt, this->compression_level, filter) :
+				zstreams::create_compressor(this->file_data_codec, *counter2, &mt, this->file_data_level, filter);
+			compressor->set_block_size(this->block_size);
+			group_blocks = compressor->get_blocks();
+			for (auto i = group_begin; i != group_end; ++i)
+				write_file(*compressor, *i);
+		}
+		for (auto &block : *group_blocks)
+			blocks.push_back({ compressed_size + block.offset, uncompressed_size + block.uncompressed_offset });
+		compressed_size += group_size;
+		uncompressed_size = 0;
+		for (auto size : this->stream_sizes)
+			uncompressed_size += size;
+		group_begin = group_end;
+	}while (group_begin != first_stored);
+	if (this->block_size)
+		this->block_index = make_block_index(this->block_size, blocks, this->stream_ids, this->stream_sizes);
+
+	// The objects after the manifest are told apart by their position, and
+	// the fingerprints come last, so the stored and primed data are always
+	// recorded, even if they're empty. See add_version_manifest().
+	// Sinks don't pass on the end of the stream, so the stored files can be
+	// written to the same crypto stream, right after the compressed data.
+	// This also marks where the compressed data ends if there are primed
+	// files but no stored ones.
+	this->stored_data = std::make_shared<ArchiveStoredData>();
+	this->stored_data->offset = compressed_size;
+	this->stored_data->uncompressed_offset = uncompressed_size;
+	for (auto i = first_stored; i != first_primed; ++i)
+		write_file(*stream, *i);
+
+	this->primed_data = std::make_shared<ArchivePrimedData>();
+	this->primed_data->offset = compressed_size;
+	this->primed_data->uncompressed_offset = 0;
+	for (auto size : this->stream_sizes)
+		this->primed_data->uncompressed_offset += size;
+	// Stored files take as much space in the file data as they have data.
+	this->primed_data->offset += this->primed_data->uncompressed_offset - uncompressed_size;
+	for (auto i = first_primed; i != files.end(); ++i)
+		this->write_primed_file(*stream, *i, write_file);
+}
+
+void ArchiveWriter::write_primed_file(zstreams::Sink &sink, const FileQueueElement &fqe, const file_writer_t &write_file){
+	buffer_t data,
+		dictionary;
+	{
+		Stream<zstreams::MemorySink> memory(data, sink.get_pipeline());
+		write_file(*memory, fqe);
+	}
+	auto version = this->dictionary_reader ? fqe.dictionary_version : invalid_version_number;
+	if (version != invalid_version_number){
+		try{
+			this->dictionary_reader->read(dictionary, version, fqe.dictionary_stream_id);
+		}catch (std::exception &e){
+			std::cout << "The previous contents of the file could not be read (" << e.what() << "). It will be compressed without them.\n";
+			dictionary.clear();
+			version = invalid_version_number;
+		}
+	}
+	auto level = this->file_data_level >= 0 ? this->file_data_level : zstreams::get_codec_level(this->file_data_codec, this->compression_level);
+	auto compressed = zstreams::compress_with_dictionary(this->file_data_codec, level, data, dictionary);
+	zstreams::SegmentWriter writer(sink);
+	writer.write(compressed.data(), compressed.size());
+	this->primed_data->compressed_sizes.push_back(compressed.size());
+	this->primed_data->dictionary_versions.push_back(version);
+	this->primed_data->dictionary_stream_ids.push_back(version != invalid_version_number ? fqe.dictionary_stream_id : invalid_stream_id);
+}
+
+void ArchiveWriter::add_file(zstreams::Sink &sink, const FileQueueElement &fqe, BatchHasher &hasher){
+	std::uint64_t size;
+	auto fso = fqe.fso;
+	std::wcout << fso->get_unmapped_path() << std::endl;
+	auto stream2 = fso->open_for_exclusive_read(size);
+
+	this->stream_ids.push_back(fqe.stream_id);
+	this->stream_sizes.push_back(size);
+
+	if (size <= BatchHasher::max_file_size){
+		// Small files are read whole and hashed in batches, rather than
+		// through a pipeline of their own.
+		buffer_t data;
+		BatchHasher::read(data, *stream2, size);
+		{
+			zstreams::SegmentWriter writer(sink);
+			writer.write(data.data(), data.size());
+		}
+		hasher.add(*fso, std::move(data));
+		this->any_file = true;
+		return;
+	}
+
+	{
+		auto &pipeline = sink.get_pipeline();
+		Stream<zstreams::NullSink> hash_null(pipeline),
+			fingerprint_null(pipeline);
+		Stream<zstreams::HashSink<CryptoPP::SHA256>> hash(*hash_null);
+		Stream<zstreams::HashSink<Xxh3_128>> fingerprint_sink(*fingerprint_null);
+		Stream<zstreams::TeeSink> tee(sink);
+		tee->add_branch(*hash);
+		tee->add_branch(*fingerprint_sink);
+		Stream<zstreams::StdStreamSource> stdstream(stream2, pipeline);
+		if (size >= large_segment_threshold){
+			stdstream->set_segment_size(this->large_segment_size);
+			// Hash big files in parallel with the compression, rather than
+			// on the thread that reads them.
+			hash->set_fusion_allowed(false);
+		}
+		if (size)
+			stdstream->copy_to(*tee);
+		// The sink goes on to the next file, so only the branches end here.
+		tee->end_branches();
+		fso->set_hash(*hash->get_digest());
+		fso->set_fingerprint(*fingerprint_sink->get_digest());
+	}
+	this->any_file = true;
+}
+
+void ArchiveWriter::add_base_objects(const std::vector<FileSystemObject *> &base_objects){
+	zekvok_assert(this->state == State::FilesWritten);
+	this->state = State::FsosWritten;
+	this->entries_size_in_archive = 0;
+
+	// Hardlinks and unmodified files share their streams with other files, so
+	// the fingerprints are gathered by stream first.
+	std::map<stream_id_t, fingerprint_t> fingerprints;
+	for (auto base_object : base_objects){
+		for (auto fso : base_object->get_iterator()){
+			if (fso->is_directoryish() || fso->get_stream_id() == invalid_stream_id)
+				continue;
+			auto &fingerprint = static_cast<FilishFso *>(fso)->get_fingerprint();
+			if (fingerprint.valid)
+				fingerprints[fso->get_stream_id()] = fingerprint.digest;
+		}
+	}
+	this->fingerprints = std::make_shared<ArchiveFingerprints>();
+	for (auto &kv : fingerprints)
+		this->fingerprints->add(kv.first, kv.second);
+
+	Stream<zstreams::ByteCounterSink> counter(*this->nested_stream, this->entries_size_in_archive);
+	zstreams::Sink *stream = &*counter;
+	Stream<zstreams::CryptoSink> crypto;
+	if (this->keypair){
+		crypto = this->create_crypto_sink(*stream);
+		stream = &*crypto;
+	}
+		
+	bool mt = this->multithreaded;
+	auto level = this->compression_level == CompressionLevel::Maximum ? CompressionLevel::Maximum : CompressionLevel::High;
+	auto compressor = zstreams::create_compressor(this->base_objects_codec, *stream, &mt, level);
+
+	zstreams::SegmentWriter writer(*compressor);
+	for (auto i : base_objects){
+		auto start = writer.get_bytes_written();
+		{
+			zstreams::SegmentOStream stream(writer);
+			SerializerStream ss(stream);
+			ss.full_serialization(*i, config::include_typehashes);
+		}
+		this->base_object_entry_sizes.push_back(writer.get_bytes_written() - start);
+	}
+}
+
+void ArchiveWriter::add_version_manifest(VersionManifest &manifest){
+	zekvok_assert(this->state == State::FsosWritten);
+	this->state = State::ManifestWritten;
+	zstreams::streamsize_t manifest_length = 0;
+	{
+		Stream<zstreams::ByteCounterSink> counter(*this->nested_stream, manifest_length);
+		
+		bool mt = true;
+
+		manifest.archive_metadata.entry_sizes = std::move(this->base_object_entry_sizes);
+		manifest.archive_metadata.stream_ids = std::move(this->stream_ids);
+		manifest.archive_metadata.stream_sizes = std::move(this->stream_sizes);
+		manifest.archive_metadata.entries_size_in_archive = this->entries_size_in_archive;
+		// The objects after the manifest are told apart by their position, so
+		// if there's stored data, there must be a block index before it, even
+		// if it's empty. Likewise, primed data always has stored data before
+		// it, and the fingerprints have everything else (see
+		// write_file_data()). Archives that aren't in a chunked mode get a
+		// placeholder encryption mode, which the reader discards.
+		if (this->stored_data && !this->block_index)
+			this->block_index = std::make_shared<ArchiveBlockIndex>();
+		zekvok_assert(this->primed_data && this->fingerprints);
+		manifest.archive_metadata.block_index = this->block_index;
+		manifest.archive_metadata.stored_data = this->stored_data;
+		manifest.archive_metadata.primed_data = this->primed_data;
+		manifest.archive_metadata.fingerprints = this->fingerprints;
+		auto encryption = std::make_shared<ArchiveEncryption>();
+		encryption->mode = (std::uint32_t)CryptoMode::Cbc;
+		manifest.archive_metadata.encryption.reset();
+		if (this->writes_encryption_mode()){
+			encryption->mode = (std::uint32_t)this->crypto_mode;
+			encryption->chunk_size = (std::uint32_t)default_crypto_chunk_size;
+			manifest.archive_metadata.encryption = encryption;
+		}
+
+		Stream<zstreams::LzmaSink> lzma(*counter, &mt, 8);
+		zstreams::SegmentWriter writer(*lzma);
+		zstreams::SegmentOStream stream(writer);
+		SerializerStream ss(stream);
+		ss.full_serialization(manifest, config::include_typehashes);
+		// See ArchiveReader::read_manifest().
+		ArchiveCodecs codecs;
+		codecs.file_data = (std::uint32_t)this->file_data_codec;
+		codecs.base_objects = (std::uint32_t)this->base_objects_codec;
+		SerializerStream ss2(stream);
+		ss2.full_serialization(codecs, config::include_typehashes);
+		if (this->block_index){
+			SerializerStream ss3(stream);
+			ss3.full_serialization(*this->block_index, config::include_typehashes);
+		}
+		if (this->stored_data){
+			SerializerStream ss4(stream);
+			ss4.full_serialization(*this->stored_data, config::include_typehashes);
+		}
+		if (this->primed_data){
+			SerializerStream ss5(stream);
+			ss5.full_serialization(*this->primed_data, config::include_typehashes);
+		}
+		SerializerStream ss6(stream);
+		ss6.full_serialization(*encryption, config::include_typehashes);
+		SerializerStream ss7(stream);
+		ss7.full_serialization(*this->fingerprints, config::include_typehashes);
+	}
+	auto s_manifest_length = serialize_fixed_le_int(manifest_length);
+	zstreams::SegmentWriter writer(*this->nested_stream);
+	writer.write(s_manifest_length.data(), s_manifest_length.size());
+}
@@ -1,162 +1,276 @@
-/*
-Copyright (c), Helios
-All rights reserved.
-
-Distributed under a permissive license. See COPYING.txt for details.
-*/
-
-#pragma once
-
-#include "StreamProcessor.h"
-#include "BoundedStreamFilter.h"
-
-class RsaKeyPair;
-class KernelTransaction;
-class VersionManifest;
-class FileSystemObject;
-class FilishFso;
-
-enum class KeyIndices{
-	FileDataKey = 0,
-	FileObjectDataKey,
-	//ManifestKey,
-	KeyCount,
-};
-
-class ArchiveKeys{
-public:
-	static const size_t key_count = static_cast<size_t>(KeyIndices::KeyCount);
-private:
-	size_t size;
-	CryptoPP::SecByteBlock keys[key_count];
-	CryptoPP::SecByteBlock ivs[key_count];
-	void init(size_t key_size, size_t iv_size, bool = true);
-public:
-	ArchiveKeys(std::istream &, RsaKeyPair &keypair);
-	ArchiveKeys(size_t key_size, size_t iv_size);
-	const CryptoPP::SecByteBlock &get_key(size_t) const;
-	const CryptoPP::SecByteBlock &get_iv(size_t) const;
-	size_t get_size() const{
-		return this->size;
-	}
-	static std::unique_ptr<ArchiveKeys> create_and_save(zstreams::Sink &, RsaKeyPair *keypair);
-};
-
-class ArchiveReader{
-public:
-	class ArchivePart{
-		std::uint64_t stream_id,
-			skip_bytes,
-			stream_length;
-		zstreams::Source *source;
-		bool was_skipped;
-		zstreams::Stream<zstreams::Source> created_source;
-	public:
-		ArchivePart(std::uint64_t stream_id, zstreams::Source *source, std::uint64_t stream_length, std::uint64_t skip_bytes){
-			this->stream_id = stream_id;
-			this->skip_bytes = skip_bytes;
-			this->stream_length = stream_length;
-			this->source = source;
-			this->was_skipped = false;
-		}
-		ArchivePart(const ArchivePart &old) = delete;
-		const ArchivePart &operator=(const ArchivePart &old) = delete;
-		ArchivePart(const ArchivePart &&old) = delete;
-		const ArchivePart &operator=(const ArchivePart &&old) = delete;
-		void skip(){
-			this->was_skipped = true;
-		}
-		void check_skip(std::uint64_t &skipped){
-			if (this->was_skipped || !this->created_source){
-				skipped += this->stream_length;
-				return;
-			}
-
-			std::uint64_t written = 0;
-			this->created_source->set_bytes_written_dst(written);
-			this->created_source = zstreams::Stream<zstreams::Source>();
-			skipped = this->stream_length - written;
-		}
-		zstreams::Source *read(){
-			if (this->skip_bytes){
-				zstreams::Stream<zstreams::BoundedSource> temp(*this->source, this->skip_bytes);
-				temp->discard_rest();
-				this->skip_bytes = 0;
-			}
-			this->created_source = zstreams::Stream<zstreams::BoundedSource>(*this->source, this->stream_length);
-			return &*this->created_source;
-		}
-		std::uint64_t get_stream_id() const{
-			return this->stream_id;
-		}
-	};
-	typedef boost::coroutines::asymmetric_coroutine<ArchivePart *> read_everything_co_t;
-private:
-	//std::deque<input_filter_generator_t> filters;
-	path_t path;
-	std::shared_ptr<VersionManifest> version_manifest;
-	std::vector<std::shared_ptr<FileSystemObject>> base_objects;
-	std::int64_t manifest_offset;
-	std::uint64_t manifest_size,
-		base_objects_offset;
-	std::vector<stream_id_t> stream_ids;
-	std::vector<std::uint64_t> stream_sizes;
-	RsaKeyPair *keypair;
-	std::unique_ptr<ArchiveKeys> archive_keys;
-
-	void read_everything(read_everything_co_t::push_type &);
-	std::unique_ptr<std::istream> get_stream();
-	bool get_key_iv(CryptoPP::SecByteBlock &key, CryptoPP::SecByteBlock &iv, KeyIndices);
-public:
-	ArchiveReader(const path_t &archive, const path_t *encrypted_fso, RsaKeyPair *keypair);
-	std::shared_ptr<VersionManifest> read_manifest();
-	std::vector<std::shared_ptr<FileSystemObject>> read_base_objects();
-	std::vector<std::shared_ptr<FileSystemObject>> get_base_objects(){
-		return std::move(this->read_base_objects());
-	}
-	read_everything_co_t::pull_type read_everything();
-	std::uint64_t get_file_data_size() const{
-		return this->base_objects_offset;
-	}
-	std::uint64_t get_base_objects_size() const{
-		return this->manifest_offset - this->base_objects_offset;
-	}
-	std::uint64_t get_manifest_size() const{
-		return this->manifest_size;
-	}
-};
-
-class ArchiveWriter{
-	enum class State{
-		Initial,
-		FilesWritten,
-		FsosWritten,
-		ManifestWritten,
-		Final,
-	};
-	State state;
-	KernelTransaction &tx;
-	zstreams::StreamPipeline pipeline;
-	zstreams::Stream<zstreams::StdStreamSink> stream;
-	std::vector<stream_id_t> stream_ids;
-	std::vector<std::uint64_t> stream_sizes;
-	bool any_file;
-	zstreams::streamsize_t initial_fso_offset;
-	std::uint64_t entries_size_in_archive;
-	std::vector<std::uint64_t> base_object_entry_sizes;
-	RsaKeyPair *keypair;
-	zstreams::Sink *nested_stream;
-	std::unique_ptr<ArchiveKeys> keys;
-	size_t archive_key_index;
-
-public:
-	ArchiveWriter(KernelTransaction &tx, const path_t &, RsaKeyPair *keypair);
-	void process(const std::function<void()> &callback);
-	struct FileQueueElement{
-		FilishFso *fso;
-		stream_id_t stream_id;
-	};
-	void add_files(const std::vector<FileQueueElement> &files);
-	void add_base_objects(const std::vector<FileSystemObject *> &base_objects);
-	void add_version_manifest(VersionManifest &manifest);
-};
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#include "StreamProcessor.h"
+#include "BoundedStreamFilter.h"
+#include "CompressionFilter.h"
+
+class RsaKeyPair;
+class KernelTransaction;
+class VersionManifest;
+class FileSystemObject;
+class FilishFso;
+class ArchiveBlockIndex;
+class ArchiveStoredData;
+class ArchivePrimedData;
+class ArchiveEncryption;
+class ArchiveFingerprints;
+class ArchiveFileData;
+class ArchiveStreamReader;
+class BatchHasher;
+enum class Algorithm;
+enum class CryptoMode;
+namespace zstreams{
+class CryptoSink;
+}
+
+extern const Algorithm default_crypto_algorithm;
+// Files at least this big are read in large segments.
+extern const std::uint64_t large_segment_threshold;
+
+enum class KeyIndices{
+	FileDataKey = 0,
+	FileObjectDataKey,
+	//ManifestKey,
+	KeyCount,
+};
+
+class ArchiveKeys{
+public:
+	static const size_t key_count = static_cast<size_t>(KeyIndices::KeyCount);
+private:
+	size_t size;
+	CryptoPP::SecByteBlock keys[key_count];
+	CryptoPP::SecByteBlock ivs[key_count];
+	void init(size_t key_size, size_t iv_size, bool = true);
+public:
+	ArchiveKeys(std::istream &, RsaKeyPair &keypair);
+	ArchiveKeys(size_t key_size, size_t iv_size);
+	const CryptoPP::SecByteBlock &get_key(size_t) const;
+	const CryptoPP::SecByteBlock &get_iv(size_t) const;
+	size_t get_size() const{
+		return this->size;
+	}
+	static std::unique_ptr<ArchiveKeys> create_and_save(zstreams::Sink &, RsaKeyPair *keypair);
+};
+
+class ArchiveReader{
+public:
+	class ArchivePart{
+		std::uint64_t stream_id,
+			offset,
+			stream_length;
+		ArchiveFileData *file_data;
+		bool was_skipped;
+		zstreams::Stream<zstreams::Source> created_source;
+	public:
+		ArchivePart(std::uint64_t stream_id, ArchiveFileData *file_data, std::uint64_t stream_length, std::uint64_t offset){
+			this->stream_id = stream_id;
+			this->offset = offset;
+			this->stream_length = stream_length;
+			this->file_data = file_data;
+			this->was_skipped = false;
+		}
+		ArchivePart(const ArchivePart &old) = delete;
+		const ArchivePart &operator=(const ArchivePart &old) = delete;
+		ArchivePart(const ArchivePart &&old) = delete;
+		const ArchivePart &operator=(const ArchivePart &&old) = delete;
+		void skip(){
+			this->was_skipped = true;
+		}
+		void finish();
+		zstreams::Source *read();
+		std::uint64_t get_stream_id() const{
+			return this->stream_id;
+		}
+	};
+	typedef boost::coroutines::asymmetric_coroutine<ArchivePart *> read_everything_co_t;
+private:
+	friend class ArchiveFileData;
+	friend class ArchiveWriter;
+	//std::deque<input_filter_generator_t> filters;
+	path_t path;
+	std::shared_ptr<VersionManifest> version_manifest;
+	std::vector<std::shared_ptr<FileSystemObject>> base_objects;
+	std::int64_t manifest_offset;
+	std::uint64_t manifest_size,
+		base_objects_offset;
+	std::vector<stream_id_t> stream_ids;
+	std::vector<std::uint64_t> stream_sizes;
+	RsaKeyPair *keypair;
+	std::unique_ptr<ArchiveKeys> archive_keys;
+	ArchiveStreamReader *dictionary_reader;
+
+	Codec get_codec(std::uint32_t) const;
+	void read_everything(read_everything_co_t::push_type &);
+	std::unique_ptr<std::istream> get_stream();
+	bool get_key_iv(CryptoPP::SecByteBlock &key, CryptoPP::SecByteBlock &iv, KeyIndices);
+public:
+	ArchiveReader(const path_t &archive, const path_t *encrypted_fso, RsaKeyPair *keypair);
+	// Files primed with the contents of other versions can't be read without
+	// one.
+	void set_dictionary_reader(ArchiveStreamReader *reader){
+		this->dictionary_reader = reader;
+	}
+	std::shared_ptr<VersionManifest> read_manifest();
+	std::vector<std::shared_ptr<FileSystemObject>> read_base_objects();
+	// Gives the files under fso the fingerprints recorded in the manifest,
+	// which the FSOs don't store themselves. read_base_objects() already does
+	// this for the objects it reads.
+	void set_fingerprints(FileSystemObject &fso);
+	std::vector<std::shared_ptr<FileSystemObject>> get_base_objects(){
+		return std::move(this->read_base_objects());
+	}
+	read_everything_co_t::pull_type read_everything();
+	std::uint64_t get_file_data_size() const{
+		return this->base_objects_offset;
+	}
+	std::uint64_t get_base_objects_size() const{
+		return this->manifest_offset - this->base_objects_offset;
+	}
+	std::uint64_t get_manifest_size() const{
+		return this->manifest_size;
+	}
+};
+
+// Reads the contents of single streams from the versions of a backup, to
+// serve as dictionaries for primed files. Each version is read through a
+// single ArchiveReader for as long as the requested streams go forward, so
+// the streams of a version are cheapest to read in increasing id order.
+class ArchiveStreamReader{
+public:
+	typedef std::function<path_t(version_number_t)> path_getter_t;
+private:
+	struct Cursor{
+		std::unique_ptr<ArchiveReader> reader;
+		std::unique_ptr<ArchiveReader::read_everything_co_t::pull_type> parts;
+	};
+	path_getter_t get_path;
+	RsaKeyPair *keypair;
+	std::map<version_number_t, Cursor> cursors;
+	std::map<version_number_t, std::shared_ptr<VersionManifest>> manifests;
+
+	std::shared_ptr<VersionManifest> get_manifest(version_number_t);
+public:
+	ArchiveStreamReader(const path_getter_t &get_path, RsaKeyPair *keypair);
+	ArchiveStreamReader(const ArchiveStreamReader &) = delete;
+	void operator=(const ArchiveStreamReader &) = delete;
+	void read(buffer_t &dst, version_number_t, stream_id_t);
+	// How many primed streams must be decoded in turn to read the stream,
+	// counting itself. Zero if it isn't primed. The versions that would be
+	// read are added to versions.
+	unsigned get_priming_depth(version_number_t, stream_id_t, std::set<version_number_t> &versions);
+};
+
+class ArchiveWriter{
+	enum class State{
+		Initial,
+		FilesWritten,
+		FsosWritten,
+		ManifestWritten,
+		Final,
+	};
+	State state;
+	KernelTransaction &tx;
+	zstreams::StreamPipeline pipeline;
+	zstreams::Stream<zstreams::StdStreamSink> stream;
+	std::vector<stream_id_t> stream_ids;
+	std::vector<std::uint64_t> stream_sizes;
+	bool any_file;
+	zstreams::streamsize_t initial_fso_offset;
+	std::uint64_t entries_size_in_archive;
+	std::vector<std::uint64_t> base_object_entry_sizes;
+	RsaKeyPair *keypair;
+	zstreams::Sink *nested_stream;
+	std::unique_ptr<ArchiveKeys> keys;
+	size_t archive_key_index;
+	std::uint64_t block_size;
+	std::shared_ptr<ArchiveBlockIndex> block_index;
+	std::shared_ptr<ArchiveStoredData> stored_data;
+	Codec file_data_codec,
+		base_objects_codec;
+	CompressionLevel compression_level;
+	int file_data_level;
+	bool multithreaded;
+	size_t large_segment_size;
+	ArchiveStreamReader *dictionary_reader;
+	std::shared_ptr<ArchivePrimedData> primed_data;
+	std::shared_ptr<ArchiveFingerprints> fingerprints;
+	CryptoMode crypto_mode;
+
+	bool writes_encryption_mode() const;
+	zstreams::Stream<zstreams::CryptoSink> create_crypto_sink(zstreams::Sink &);
+public:
+	ArchiveWriter(KernelTransaction &tx, const path_t &, RsaKeyPair *keypair);
+	// Zero means that the file data is written as a single stream.
+	void set_block_size(std::uint64_t size){
+		this->block_size = size;
+	}
+	// The manifest is always compressed with LZMA.
+	void set_codecs(Codec file_data, Codec base_objects){
+		this->file_data_codec = file_data;
+		this->base_objects_codec = base_objects;
+	}
+	// Applies to the file data and the base objects. The latter are always
+	// compressed at least at CompressionLevel::High.
+	void set_compression_level(CompressionLevel level){
+		this->compression_level = level;
+	}
+	// Overrides the compression level for the file data, in the codec's own
+	// scale (see create_compressor()). Negative values undo the override.
+	void set_file_data_level(int level){
+		this->file_data_level = level;
+	}
+	void set_multithreaded(bool multithreaded){
+		this->multithreaded = multithreaded;
+	}
+	// The segment size used to read files of at least
+	// large_segment_threshold bytes.
+	void set_large_segment_size(size_t size){
+		this->large_segment_size = size;
+	}
+	// Where the dictionaries of primed files are read from.
+	void set_dictionary_reader(ArchiveStreamReader *reader){
+		this->dictionary_reader = reader;
+	}
+	// Only matters if the archive is encrypted.
+	void set_crypto_mode(CryptoMode mode){
+		this->crypto_mode = mode;
+	}
+	void process(const std::function<void()> &callback);
+	struct FileQueueElement{
+		FilishFso *fso;
+		stream_id_t stream_id;
+		// Stored files are written without compression, after all the
+		// compressed ones. They must come last in the queue.
+		bool stored;
+		// Consecutive files with the same filter are compressed together.
+		ContentFilter filter;
+		// Primed files are compressed one by one, each primed with the
+		// contents of a stream from an earlier version, which should be
+		// similar to it (e.g. an older copy of the same file). They're
+		// written after the stored ones, so they must come last.
+		bool primed;
+		version_number_t dictionary_version;
+		stream_id_t dictionary_stream_id;
+	};
+	void add_files(const std::vector<FileQueueElement> &files);
+	// Like add_files(), but the file data is taken from an existing archive,
+	// in the same order and with the same stream ids. Files that were stored
+	// are stored again, and primed files are primed again with the same
+	// dictionaries. get_filter() is called for the rest.
+	void copy_files(ArchiveReader &, const std::function<ContentFilter(stream_id_t)> &get_filter);
+	void add_base_objects(const std::vector<FileSystemObject *> &base_objects);
+	void add_version_manifest(VersionManifest &manifest);
+private:
+	typedef std::function<void(zstreams::Sink &, const FileQueueElement &)> file_writer_t;
+	void write_file_data(const std::vector<FileQueueElement> &files, const file_writer_t &);
+	void write_primed_file(zstreams::Sink &, const FileQueueElement &, const file_writer_t &);
+	void add_file(zstreams::Sink &, const FileQueueElement &, BatchHasher &);
+};
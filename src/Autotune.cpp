@@ -0,0 +1,338 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "Autotune.h"
+#include "ArchiveIO.h"
+#include "CryptoFilter.h"
+#include "HashFilter.h"
+#include "MemoryStream.h"
+#include "NullStream.h"
+#include "AutoHandle.h"
+#include "Utility.h"
+#include "Exception.h"
+#include "serialization/fso.generated.h"
+
+using zstreams::Stream;
+
+typedef std::chrono::high_resolution_clock tuning_clock;
+
+static double seconds_since(const tuning_clock::time_point &start){
+	return std::chrono::duration_cast<std::chrono::duration<double>>(tuning_clock::now() - start).count();
+}
+
+// The sample is made up of the first max_sample_per_file bytes of randomly
+// chosen files, up to sample_size bytes, so that it covers many files.
+const size_t sample_size = 32 << 20;
+const size_t max_sample_per_file = 1 << 20;
+// Segment sizes are compared on the biggest file no bigger than this.
+const std::uint64_t max_segment_test_size = 64 << 20;
+// The levels that are tried, from fastest to strongest.
+static const int lzma_levels[] = { 0, 1, 3, 6, 8, 9 };
+static const int zstd_levels[] = { 1, 3, 6, 9, 13, 16, 19 };
+static const size_t segment_sizes[] = { BufferPool::medium_size, BufferPool::large_size };
+static const size_t queue_depths[] = { 4, 16, 64 };
+
+struct TuningFile{
+	path_t path;
+	std::uint64_t size;
+};
+
+struct LevelResult{
+	int level;
+	// Bytes of input per second, on a single thread.
+	double speed;
+	// Compressed size over uncompressed size.
+	double ratio;
+};
+
+static void print_speed(const char *what, double bytes_per_second){
+	std::cout << what << ": " << std::fixed << std::setprecision(1) << bytes_per_second / (1 << 20) << " MiB/s\n";
+}
+
+static void find_files(std::vector<TuningFile> &dst, std::uint64_t &total_size, const path_t &source){
+	boost::system::error_code error;
+	if (boost::filesystem::is_regular_file(source, error)){
+		TuningFile file = { source, boost::filesystem::file_size(source, error) };
+		if (error)
+			return;
+		dst.push_back(file);
+		total_size += file.size;
+		return;
+	}
+	for (boost::filesystem::recursive_directory_iterator i(source, error), e; !error && i != e; i.increment(error)){
+		if (!boost::filesystem::is_regular_file(i->status()))
+			continue;
+		TuningFile file = { i->path(), boost::filesystem::file_size(i->path(), error) };
+		if (error){
+			error.clear();
+			continue;
+		}
+		dst.push_back(file);
+		total_size += file.size;
+	}
+}
+
+// Returns the time it took. The files are read the first time, so this
+// measures the disk, rather than the cache.
+static double read_sample(buffer_t &dst, std::vector<TuningFile> files){
+	std::mt19937 rng;
+	std::shuffle(files.begin(), files.end(), rng);
+	dst.reserve(sample_size);
+	auto start = tuning_clock::now();
+	for (auto &file : files){
+		if (dst.size() >= sample_size)
+			break;
+		if (!file.size)
+			continue;
+		boost::filesystem::ifstream stream(file.path, std::ios::binary);
+		if (!stream)
+			continue;
+		auto n = (size_t)std::min<std::uint64_t>(std::min<std::uint64_t>(file.size, max_sample_per_file), sample_size - dst.size());
+		auto offset = dst.size();
+		dst.resize(offset + n);
+		stream.read((char *)&dst[offset], n);
+		dst.resize(offset + (size_t)stream.gcount());
+	}
+	return seconds_since(start);
+}
+
+// Reads and hashes a file the way ArchiveWriter::add_file() reads big files,
+// and returns the time it took.
+static double time_file_read(const TuningFile &file, size_t segment_size){
+	zstreams::StreamPipeline pipeline;
+	auto start = tuning_clock::now();
+	{
+		Stream<zstreams::NullSink> null(pipeline);
+		Stream<zstreams::HashSink<CryptoPP::SHA256>> hash(*null);
+		hash->set_fusion_allowed(false);
+		std::unique_ptr<std::istream> stream(new boost::filesystem::ifstream(file.path, std::ios::binary));
+		Stream<zstreams::StdStreamSource> source(stream, pipeline);
+		source->set_segment_size(segment_size);
+		source->copy_to(*hash);
+		hash->get_digest();
+	}
+	pipeline.check_exceptions();
+	return seconds_since(start);
+}
+
+// Returns zero if there are no big files to try.
+static size_t choose_segment_size(const std::vector<TuningFile> &files){
+	const TuningFile *biggest = nullptr;
+	for (auto &file : files)
+		if (file.size >= large_segment_threshold && file.size <= max_segment_test_size && (!biggest || file.size > biggest->size))
+			biggest = &file;
+	if (!biggest)
+		return 0;
+	// Bring the file into the cache first, so that both sizes are measured
+	// under the same conditions.
+	time_file_read(*biggest, BufferPool::large_size);
+	size_t ret = 0;
+	double best_time = 0;
+	for (auto size : segment_sizes){
+		auto time = time_file_read(*biggest, size);
+		std::cout << "Reading in " << (size >> 10) << " KiB segments: " << std::fixed << std::setprecision(1) << biggest->size / time / (1 << 20) << " MiB/s\n";
+		if (!ret || time < best_time){
+			ret = size;
+			best_time = time;
+		}
+	}
+	return ret;
+}
+
+static LevelResult time_compression(Codec codec, int level, const buffer_t &sample){
+	zstreams::streamsize_t compressed;
+	zstreams::StreamPipeline pipeline;
+	auto start = tuning_clock::now();
+	{
+		Stream<zstreams::NullSink> null(pipeline);
+		Stream<zstreams::ByteCounterSink> counter(*null, compressed);
+		bool mt = false;
+		auto compressor = zstreams::create_compressor(codec, *counter, &mt, level);
+		Stream<zstreams::MemorySource> source(sample.data(), sample.size(), pipeline);
+		source->copy_to(*compressor);
+	}
+	pipeline.check_exceptions();
+	LevelResult ret = { level, sample.size() / seconds_since(start), (double)compressed / sample.size() };
+	return ret;
+}
+
+static double time_encryption(CryptoMode mode, const buffer_t &sample){
+	ArchiveKeys keys(CryptoPP::Twofish::MAX_KEYLENGTH, CryptoPP::Twofish::BLOCKSIZE);
+	zstreams::StreamPipeline pipeline;
+	auto start = tuning_clock::now();
+	{
+		Stream<zstreams::NullSink> null(pipeline);
+		auto crypto = zstreams::CryptoSink::create(mode, default_crypto_algorithm, *null, &keys.get_key(0), &keys.get_iv(0));
+		Stream<zstreams::MemorySource> source(sample.data(), sample.size(), pipeline);
+		source->copy_to(*crypto);
+	}
+	pipeline.check_exceptions();
+	return sample.size() / seconds_since(start);
+}
+
+// Writes the sample to a temporary file in the target directory, bypassing
+// the cache, and returns the bytes per second.
+static double time_write(const buffer_t &sample, const path_t &target){
+	const DWORD chunk_size = 1 << 20;
+	auto path = target / "autotune.tmp";
+	AutoHandle file = CreateFileW(path.wstring().c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_FLAG_WRITE_THROUGH | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+	if (file.handle == INVALID_HANDLE_VALUE)
+		throw Win32Exception(GetLastError());
+	auto start = tuning_clock::now();
+	for (size_t offset = 0; offset < sample.size(); ){
+		auto n = (DWORD)std::min<size_t>(chunk_size, sample.size() - offset);
+		DWORD written;
+		if (!WriteFile(file.handle, &sample[offset], n, &written, nullptr))
+			throw Win32Exception(GetLastError());
+		offset += written;
+	}
+	return sample.size() / seconds_since(start);
+}
+
+// Compresses and encrypts the data the way ArchiveWriter writes the file
+// data, with the current process-wide settings, and returns the time it
+// took.
+static double time_pipeline(Codec codec, CryptoMode mode, int level, const std::uint8_t *data, size_t size){
+	ArchiveKeys keys(CryptoPP::Twofish::MAX_KEYLENGTH, CryptoPP::Twofish::BLOCKSIZE);
+	zstreams::StreamPipeline pipeline;
+	auto start = tuning_clock::now();
+	{
+		Stream<zstreams::NullSink> null(pipeline);
+		auto crypto = zstreams::CryptoSink::create(mode, default_crypto_algorithm, *null, &keys.get_key(0), &keys.get_iv(0));
+		bool mt = true;
+		auto compressor = zstreams::create_compressor(codec, *crypto, &mt, level);
+		Stream<zstreams::MemorySource> source(data, size, pipeline);
+		source->copy_to(*compressor);
+	}
+	pipeline.check_exceptions();
+	return seconds_since(start);
+}
+
+SavedPipelineSettings::SavedPipelineSettings():
+		compression_threads(cpu_budget->get_compression_threads()),
+		queue_depth(buffer_pool->get_queue_depth_setting()){}
+
+SavedPipelineSettings::~SavedPipelineSettings(){
+	cpu_budget->set_compression_threads(this->compression_threads);
+	buffer_pool->set_queue_depth(this->queue_depth);
+}
+
+std::shared_ptr<TuningSettings> autotune(Codec codec, CryptoMode crypto_mode, const std::vector<path_t> &sources, const path_t &target, TuningGoal goal, double goal_value){
+	std::vector<TuningFile> files;
+	std::uint64_t total_size = 0;
+	for (auto &source : sources)
+		find_files(files, total_size, source);
+	std::cout << "Found " << files.size() << " files (" << total_size << " bytes).\n";
+	buffer_t sample;
+	auto read_time = read_sample(sample, files);
+	if (!sample.size())
+		throw StdStringException("The sources contain no data to sample.");
+	std::cout << "Sampled " << sample.size() << " bytes.\n";
+	auto read_speed = sample.size() / read_time;
+	print_speed("Read", read_speed);
+
+	auto ret = std::make_shared<TuningSettings>();
+	ret->file_data_codec = (std::uint32_t)codec;
+	ret->read_segment_size = (std::uint32_t)choose_segment_size(files);
+
+	auto encryption_speed = time_encryption(crypto_mode, sample);
+	print_speed("Encryption", encryption_speed);
+	auto write_speed = time_write(sample, target);
+	print_speed("Write", write_speed);
+
+	std::vector<LevelResult> levels;
+	auto try_levels = [&](const int *begin, const int *end){
+		for (; begin != end; ++begin){
+			auto result = time_compression(codec, *begin, sample);
+			std::cout << "Level " << result.level << ": ratio " << std::fixed << std::setprecision(4) << result.ratio << ", ";
+			print_speed("single thread", result.speed);
+			levels.push_back(result);
+		}
+	};
+	switch (codec){
+		case Codec::Lzma:
+			try_levels(lzma_levels, lzma_levels + array_size(lzma_levels));
+			break;
+		case Codec::Zstd:
+			try_levels(zstd_levels, zstd_levels + array_size(zstd_levels));
+			break;
+		default:
+			throw std::exception("Unknown codec.");
+	}
+
+	// Compression is assumed to scale with the threads in the CPU budget.
+	// Encryption and writing only see the compressed data.
+	auto cores = cpu_budget->get_max_threads();
+	auto others_speed = [&](const LevelResult &r){
+		return std::min(read_speed, std::min(encryption_speed, write_speed) / std::max(r.ratio, 0.01));
+	};
+	auto overall_speed = [&](const LevelResult &r){
+		return std::min(others_speed(r), r.speed * cores);
+	};
+	const LevelResult *best = nullptr;
+	for (auto &r : levels){
+		switch (goal){
+			case TuningGoal::Balanced:
+				if (r.speed * cores >= others_speed(r) && (!best || r.ratio < best->ratio))
+					best = &r;
+				break;
+			case TuningGoal::Time:
+				if (total_size / overall_speed(r) <= goal_value && (!best || r.ratio < best->ratio))
+					best = &r;
+				break;
+			case TuningGoal::Ratio:
+				if (r.ratio <= goal_value && (!best || overall_speed(r) > overall_speed(*best)))
+					best = &r;
+				break;
+		}
+	}
+	if (!best){
+		std::cout << "The goal can't be met. Getting as close as possible.\n";
+		for (auto &r : levels){
+			if (goal == TuningGoal::Ratio ? !best || r.ratio < best->ratio : !best || overall_speed(r) > overall_speed(*best))
+				best = &r;
+		}
+	}
+	ret->file_data_level = best->level;
+
+	// Compressing faster than the rest of the pipeline can go is pointless,
+	// so leave the remaining cores to other programs.
+	auto needed = (unsigned)std::ceil(others_speed(*best) / best->speed);
+	ret->compression_threads = needed < cores ? std::max(needed, 1U) : 0;
+
+	// A few seconds' worth of data is enough to see the effect of the queues.
+	auto pipeline_size = std::min(sample.size(), (size_t)(best->speed * 4));
+	std::vector<double> times;
+	{
+		SavedPipelineSettings saved;
+		cpu_budget->set_compression_threads(ret->compression_threads);
+		for (auto depth : queue_depths){
+			buffer_pool->set_queue_depth(depth);
+			times.push_back(time_pipeline(codec, crypto_mode, best->level, sample.data(), pipeline_size));
+			std::cout << "Queue depth " << depth << ": ";
+			print_speed("compression and encryption", pipeline_size / times.back());
+		}
+	}
+	// Deeper queues take more memory, so only use them if they make a
+	// difference.
+	auto fastest = *std::min_element(times.begin(), times.end());
+	for (size_t i = 0; i < times.size(); i++){
+		if (times[i] <= fastest * 1.05){
+			ret->queue_depth = (std::uint32_t)queue_depths[i];
+			break;
+		}
+	}
+
+	std::cout
+		<< "Chosen settings: level " << ret->file_data_level
+		<< ", " << ret->compression_threads << " compression threads (0 means automatic)"
+		<< ", " << ret->read_segment_size << "-byte segments for big files (0 means default)"
+		<< ", queue depth " << ret->queue_depth << ".\n"
+		<< "Estimated backup time: " << std::setprecision(0) << total_size / overall_speed(*best) << " s\n";
+	return ret;
+}
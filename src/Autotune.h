@@ -0,0 +1,52 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#include "CompressionFilter.h"
+
+class TuningSettings;
+enum class CryptoMode;
+
+// Saves the process-wide pipeline settings (compression threads and queue
+// depth) and puts them back when destroyed, so that settings applied for a
+// while don't outlive their use, even if an exception is thrown.
+class SavedPipelineSettings{
+	unsigned compression_threads;
+	size_t queue_depth;
+public:
+	SavedPipelineSettings();
+	SavedPipelineSettings(const SavedPipelineSettings &) = delete;
+	void operator=(const SavedPipelineSettings &) = delete;
+	~SavedPipelineSettings();
+};
+
+enum class TuningGoal{
+	// The strongest compression that doesn't slow down the backup, i.e. that
+	// keeps up with reading, encrypting and writing.
+	Balanced,
+	// The strongest compression that's expected to back up all of the sources
+	// within a given number of seconds.
+	Time,
+	// The fastest compression that reduces the data to at most a given
+	// fraction of its size.
+	Ratio,
+};
+
+// Measures how fast this machine reads a sample of the files under sources,
+// compresses it with codec at each level, encrypts it in crypto_mode and
+// writes it to the target directory, and picks the settings that best meet
+// the goal.
+// goal_value is the time or the ratio, depending on the goal.
+std::shared_ptr<TuningSettings> autotune(
+	Codec codec,
+	CryptoMode crypto_mode,
+	const std::vector<path_t> &sources,
+	const path_t &target,
+	TuningGoal goal,
+	double goal_value
+);
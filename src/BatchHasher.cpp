@@ -0,0 +1,363 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "BatchHasher.h"
+#include "serialization/fso.generated.h"
+#include "System/CpuBudget.h"
+#include "System/BufferPool.h"
+#include "Utility.h"
+#include "Xxh3.h"
+#include <intrin.h>
+
+// A batch is hashed once it has this many files or this many bytes.
+const size_t max_batch_files = 256;
+const size_t max_batch_size = BufferPool::large_size;
+// With fewer inputs than this left, most of the AVX2 lanes would be wasted,
+// so they're hashed by Crypto++ instead.
+const size_t min_avx2_lanes = 3;
+
+static const std::uint32_t sha256_k[64] = {
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+static const std::uint32_t sha256_initial_state[8] = {
+	0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+static const struct CpuFeatures{
+	bool sha_ni,
+		avx2;
+	CpuFeatures(): sha_ni(false), avx2(false){
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return;
+		__cpuid(info, 1);
+		bool ssse3 = !!(info[2] & (1 << 9));
+		bool sse41 = !!(info[2] & (1 << 19));
+		bool osxsave = !!(info[2] & (1 << 27));
+		bool avx = !!(info[2] & (1 << 28));
+		__cpuidex(info, 7, 0);
+		this->sha_ni = ssse3 && sse41 && !!(info[1] & (1 << 29));
+		// The OS must also save the YMM registers.
+		this->avx2 = osxsave && avx && !!(info[1] & (1 << 5)) && (_xgetbv(0) & 6) == 6;
+	}
+} cpu_features;
+
+bool is_supported(Sha256Engine engine){
+	switch (engine){
+		case Sha256Engine::Generic:
+			return true;
+		case Sha256Engine::Avx2:
+			return cpu_features.avx2;
+		case Sha256Engine::ShaNi:
+			return cpu_features.sha_ni;
+	}
+	return false;
+}
+
+Sha256Engine get_sha256_engine(){
+	if (cpu_features.sha_ni)
+		return Sha256Engine::ShaNi;
+	if (cpu_features.avx2)
+		return Sha256Engine::Avx2;
+	return Sha256Engine::Generic;
+}
+
+const char *to_string(Sha256Engine engine){
+	switch (engine){
+		case Sha256Engine::Generic:
+			return "Crypto++";
+		case Sha256Engine::Avx2:
+			return "AVX2";
+		case Sha256Engine::ShaNi:
+			return "SHA-NI";
+	}
+	return "?";
+}
+
+// The blocks after the last full one of an input: its remaining bytes, the
+// end marker and the length in bits, which take one or two blocks.
+struct Sha256Tail{
+	std::uint8_t data[128];
+	size_t blocks;
+
+	void set(const HashInput &input){
+		auto rest = input.size % 64;
+		memset(this->data, 0, sizeof(this->data));
+		memcpy(this->data, (const std::uint8_t *)input.data + (input.size - rest), rest);
+		this->data[rest] = 0x80;
+		this->blocks = rest + 9 <= 64 ? 1 : 2;
+		auto bits = (std::uint64_t)input.size * 8;
+		for (size_t i = 0; i < 8; i++)
+			this->data[this->blocks * 64 - 1 - i] = (std::uint8_t)(bits >> (8 * i));
+	}
+};
+
+static void store_digest(sha256_digest &dst, const std::uint32_t state[8]){
+	for (size_t i = 0; i < 8; i++)
+		for (size_t j = 0; j < 4; j++)
+			dst[i * 4 + j] = (std::uint8_t)(state[i] >> (24 - 8 * j));
+}
+
+static void sha256_generic(const HashInput &input, sha256_digest &digest){
+	CryptoPP::SHA256 hash;
+	hash.Update((const byte *)input.data, input.size);
+	hash.Final(digest.data());
+}
+
+// Computes the next four words of the message schedule from the previous
+// sixteen, oldest first.
+static __m128i sha256_ni_schedule(__m128i w0, __m128i w1, __m128i w2, __m128i w3){
+	auto t = _mm_add_epi32(_mm_sha256msg1_epu32(w0, w1), _mm_alignr_epi8(w3, w2, 4));
+	return _mm_sha256msg2_epu32(t, w3);
+}
+
+// Runs four rounds, the ones numbered 4 * i to 4 * i + 3.
+static void sha256_ni_rounds(__m128i &state0, __m128i &state1, __m128i w, size_t i){
+	auto message = _mm_add_epi32(w, _mm_loadu_si128((const __m128i *)(sha256_k + i * 4)));
+	state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+	state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(message, 0x0E));
+}
+
+static void sha256_ni_blocks(std::uint32_t state[8], const std::uint8_t *data, size_t blocks){
+	const __m128i byte_swap = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+	// The instructions want the state as ABEF and CDGH.
+	auto temp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0xB1);
+	auto state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(state + 4)), 0x1B);
+	auto state0 = _mm_alignr_epi8(temp, state1, 8);
+	state1 = _mm_blend_epi16(state1, temp, 0xF0);
+
+	for (; blocks; blocks--, data += 64){
+		auto saved0 = state0;
+		auto saved1 = state1;
+		auto w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), byte_swap);
+		auto w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), byte_swap);
+		auto w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), byte_swap);
+		auto w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), byte_swap);
+		sha256_ni_rounds(state0, state1, w0, 0);
+		sha256_ni_rounds(state0, state1, w1, 1);
+		sha256_ni_rounds(state0, state1, w2, 2);
+		sha256_ni_rounds(state0, state1, w3, 3);
+		for (size_t i = 4; i < 16; i += 4){
+			w0 = sha256_ni_schedule(w0, w1, w2, w3);
+			sha256_ni_rounds(state0, state1, w0, i);
+			w1 = sha256_ni_schedule(w1, w2, w3, w0);
+			sha256_ni_rounds(state0, state1, w1, i + 1);
+			w2 = sha256_ni_schedule(w2, w3, w0, w1);
+			sha256_ni_rounds(state0, state1, w2, i + 2);
+			w3 = sha256_ni_schedule(w3, w0, w1, w2);
+			sha256_ni_rounds(state0, state1, w3, i + 3);
+		}
+		state0 = _mm_add_epi32(state0, saved0);
+		state1 = _mm_add_epi32(state1, saved1);
+	}
+
+	temp = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	_mm_storeu_si128((__m128i *)state, _mm_blend_epi16(temp, state1, 0xF0));
+	_mm_storeu_si128((__m128i *)(state + 4), _mm_alignr_epi8(state1, temp, 8));
+}
+
+static void sha256_ni(const HashInput &input, sha256_digest &digest){
+	std::uint32_t state[8];
+	std::copy(sha256_initial_state, sha256_initial_state + 8, state);
+	sha256_ni_blocks(state, (const std::uint8_t *)input.data, input.size / 64);
+	Sha256Tail tail;
+	tail.set(input);
+	sha256_ni_blocks(state, tail.data, tail.blocks);
+	store_digest(digest, state);
+}
+
+static __m256i rotate_right(__m256i x, int n){
+	return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+static __m256i xor3(__m256i a, __m256i b, __m256i c){
+	return _mm256_xor_si256(_mm256_xor_si256(a, b), c);
+}
+
+// Runs one block of each lane through the compression function. Only the
+// lanes set in active are updated.
+static void sha256_avx2_block(__m256i state[8], const std::uint8_t *const blocks[8], __m256i active){
+	const __m256i byte_swap = _mm256_set_epi8(
+		12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+		12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3
+	);
+	__m256i w[16];
+	for (size_t i = 0; i < 16; i++){
+		std::uint32_t words[8];
+		for (size_t lane = 0; lane < 8; lane++)
+			memcpy(words + lane, blocks[lane] + i * 4, 4);
+		w[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)words), byte_swap);
+	}
+	auto a = state[0], b = state[1], c = state[2], d = state[3],
+		e = state[4], f = state[5], g = state[6], h = state[7];
+	for (size_t i = 0; i < 64; i++){
+		auto &current = w[i % 16];
+		if (i >= 16){
+			auto w15 = w[(i + 1) % 16];
+			auto w2 = w[(i + 14) % 16];
+			auto s0 = xor3(rotate_right(w15, 7), rotate_right(w15, 18), _mm256_srli_epi32(w15, 3));
+			auto s1 = xor3(rotate_right(w2, 17), rotate_right(w2, 19), _mm256_srli_epi32(w2, 10));
+			current = _mm256_add_epi32(_mm256_add_epi32(current, s0), _mm256_add_epi32(w[(i + 9) % 16], s1));
+		}
+		auto s1 = xor3(rotate_right(e, 6), rotate_right(e, 11), rotate_right(e, 25));
+		auto ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+		auto t1 = _mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(ch, _mm256_add_epi32(current, _mm256_set1_epi32((int)sha256_k[i]))));
+		auto s0 = xor3(rotate_right(a, 2), rotate_right(a, 13), rotate_right(a, 22));
+		auto maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+		auto t2 = _mm256_add_epi32(s0, maj);
+		h = g;
+		g = f;
+		f = e;
+		e = _mm256_add_epi32(d, t1);
+		d = c;
+		c = b;
+		b = a;
+		a = _mm256_add_epi32(t1, t2);
+	}
+	__m256i results[] = { a, b, c, d, e, f, g, h };
+	for (size_t i = 0; i < 8; i++)
+		state[i] = _mm256_blendv_epi8(state[i], _mm256_add_epi32(state[i], results[i]), active);
+}
+
+// Hashes up to eight inputs at once, one per lane. Lanes whose inputs have
+// run out of blocks are fed zeroes and left unchanged.
+static void sha256_avx2(const HashInput *inputs, const size_t *indices, size_t count, sha256_digest *digests){
+	static const std::uint8_t zero_block[64] = {};
+	Sha256Tail tails[8];
+	size_t full_blocks[8],
+		total_blocks[8],
+		max_blocks = 0;
+	for (size_t lane = 0; lane < count; lane++){
+		auto &input = inputs[indices[lane]];
+		tails[lane].set(input);
+		full_blocks[lane] = input.size / 64;
+		total_blocks[lane] = full_blocks[lane] + tails[lane].blocks;
+		max_blocks = std::max(max_blocks, total_blocks[lane]);
+	}
+	__m256i state[8];
+	for (size_t i = 0; i < 8; i++)
+		state[i] = _mm256_set1_epi32((int)sha256_initial_state[i]);
+	for (size_t block = 0; block < max_blocks; block++){
+		const std::uint8_t *blocks[8];
+		std::int32_t active[8];
+		for (size_t lane = 0; lane < 8; lane++){
+			active[lane] = lane < count && block < total_blocks[lane] ? -1 : 0;
+			if (!active[lane])
+				blocks[lane] = zero_block;
+			else if (block < full_blocks[lane])
+				blocks[lane] = (const std::uint8_t *)inputs[indices[lane]].data + block * 64;
+			else
+				blocks[lane] = tails[lane].data + (block - full_blocks[lane]) * 64;
+		}
+		sha256_avx2_block(state, blocks, _mm256_loadu_si256((const __m256i *)active));
+	}
+	std::uint32_t words[8][8];
+	for (size_t i = 0; i < 8; i++)
+		_mm256_storeu_si256((__m256i *)words[i], state[i]);
+	for (size_t lane = 0; lane < count; lane++){
+		std::uint32_t lane_state[8];
+		for (size_t i = 0; i < 8; i++)
+			lane_state[i] = words[i][lane];
+		store_digest(digests[indices[lane]], lane_state);
+	}
+}
+
+void sha256_batch(const HashInput *inputs, size_t count, sha256_digest *digests, Sha256Engine engine){
+	zekvok_assert(is_supported(engine));
+	switch (engine){
+		case Sha256Engine::Generic:
+			for (size_t i = 0; i < count; i++)
+				sha256_generic(inputs[i], digests[i]);
+			break;
+		case Sha256Engine::ShaNi:
+			for (size_t i = 0; i < count; i++)
+				sha256_ni(inputs[i], digests[i]);
+			break;
+		case Sha256Engine::Avx2:
+			{
+				// Inputs of similar sizes are put in the same lanes, so that
+				// few lanes sit idle.
+				std::vector<size_t> order(count);
+				for (size_t i = 0; i < count; i++)
+					order[i] = i;
+				std::sort(order.begin(), order.end(), [inputs](size_t a, size_t b){ return inputs[a].size < inputs[b].size; });
+				size_t i = 0;
+				for (; count - i >= min_avx2_lanes; i += std::min<size_t>(count - i, 8))
+					sha256_avx2(inputs, &order[i], std::min<size_t>(count - i, 8), digests);
+				for (; i < count; i++)
+					sha256_generic(inputs[order[i]], digests[order[i]]);
+			}
+			break;
+	}
+}
+
+void BatchHasher::add(FilishFso &fso, buffer_t &&data){
+	this->pending_size += data.size();
+	this->pending.push_back({ &fso, std::move(data) });
+	if (this->pending.size() >= max_batch_files || this->pending_size >= max_batch_size)
+		this->flush();
+}
+
+bool BatchHasher::add(FilishFso &fso){
+	boost::filesystem::ifstream file(fso.get_mapped_path(), std::ios::binary);
+	if (!file)
+		return false;
+	buffer_t data;
+	read(data, file, fso.get_size());
+	this->add(fso, std::move(data));
+	return true;
+}
+
+void BatchHasher::flush(){
+	if (!this->pending.size())
+		return;
+	auto start = std::chrono::steady_clock::now();
+	std::vector<HashInput> inputs;
+	inputs.reserve(this->pending.size());
+	for (auto &p : this->pending)
+		inputs.push_back({ p.data.data(), p.data.size() });
+	std::vector<sha256_digest> digests(inputs.size());
+	sha256_batch(inputs.data(), inputs.size(), digests.data(), this->engine);
+	for (size_t i = 0; i < digests.size(); i++){
+		auto &p = this->pending[i];
+		p.fso->set_hash(digests[i]);
+		fingerprint_t fingerprint;
+		xxh3_128(fingerprint, p.data.data(), p.data.size());
+		p.fso->set_fingerprint(fingerprint);
+	}
+	if (cpu_budget){
+		auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		cpu_budget->record(CpuStage::Hashing, this->pending_size, nanoseconds);
+	}
+	this->pending.clear();
+	this->pending_size = 0;
+}
+
+void BatchHasher::read(buffer_t &dst, std::istream &stream, std::uint64_t size){
+	// One byte more than expected, to notice if the file has grown.
+	dst.resize((size_t)size + 1);
+	size_t filled = 0;
+	while (true){
+		stream.read((char *)dst.data() + filled, dst.size() - filled);
+		filled += (size_t)stream.gcount();
+		if (filled < dst.size())
+			break;
+		dst.resize(dst.size() * 2);
+	}
+	dst.resize(filled);
+}
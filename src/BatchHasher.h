@@ -0,0 +1,65 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#include "SimpleTypes.h"
+
+class FilishFso;
+
+enum class Sha256Engine{
+	// Crypto++, one input at a time.
+	Generic,
+	// Eight inputs at a time, one in each lane of the AVX2 registers.
+	Avx2,
+	// The SHA extensions, one input at a time.
+	ShaNi,
+};
+
+bool is_supported(Sha256Engine);
+// Returns the fastest engine the CPU supports.
+Sha256Engine get_sha256_engine();
+const char *to_string(Sha256Engine);
+
+struct HashInput{
+	const void *data;
+	size_t size;
+};
+
+// Computes the SHA-256 digest of each input. The engine must be supported.
+void sha256_batch(const HashInput *inputs, size_t count, sha256_digest *digests, Sha256Engine engine = get_sha256_engine());
+
+// Hashes small files without building a pipeline for each one, which takes
+// longer than hashing them. The files are read whole and queued, and hashed
+// with sha256_batch() once enough of them have accumulated. Their hashes and
+// fingerprints are set when they're hashed, so the owner must call flush()
+// before using them.
+class BatchHasher{
+	struct Pending{
+		FilishFso *fso;
+		buffer_t data;
+	};
+	Sha256Engine engine;
+	std::vector<Pending> pending;
+	size_t pending_size = 0;
+public:
+	// Files up to this size are read whole and hashed in batches. Bigger
+	// ones should be hashed as they're read, through a HashSink.
+	static const std::uint64_t max_file_size = 64 << 10;
+
+	BatchHasher(Sha256Engine engine = get_sha256_engine()): engine(engine){}
+	BatchHasher(const BatchHasher &) = delete;
+	void operator=(const BatchHasher &) = delete;
+	// Queues the contents of the file, which the caller has already read.
+	void add(FilishFso &, buffer_t &&data);
+	// Reads the file and queues it. Returns false if it couldn't be opened.
+	bool add(FilishFso &);
+	// Hashes everything that's queued.
+	void flush();
+	// Reads the rest of the stream, which should contain about size bytes.
+	static void read(buffer_t &dst, std::istream &, std::uint64_t size);
+};
@@ -0,0 +1,346 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "Benchmarks.h"
+#include "StreamProcessor.h"
+#include "HashFilter.h"
+#include "NullStream.h"
+#include "MemoryStream.h"
+#include "BoundedStreamFilter.h"
+#include "CompressionFilter.h"
+#include "SimilarityOrdering.h"
+#include "Utility.h"
+#include "BatchHasher.h"
+#include "Xxh3.h"
+
+typedef std::chrono::high_resolution_clock benchmark_clock;
+
+static double seconds_since(const benchmark_clock::time_point &start){
+	return std::chrono::duration_cast<std::chrono::duration<double>>(benchmark_clock::now() - start).count();
+}
+
+template <typename QueueT>
+static double benchmark_queue(size_t segments){
+	QueueT queue(16);
+	auto start = benchmark_clock::now();
+	std::thread producer([&queue, segments](){
+		for (size_t i = 0; i < segments; i++){
+			zstreams::Segment segment(zstreams::SegmentType::Data);
+			while (!queue.try_push(segment));
+		}
+	});
+	for (size_t i = 0; i < segments; i++){
+		zstreams::Segment segment;
+		while (!queue.try_pop(segment));
+	}
+	producer.join();
+	return segments / seconds_since(start);
+}
+
+void benchmark_queues(){
+	const size_t segments = 1 << 22;
+	std::cout << "Moving " << segments << " segments between two threads through a 16-deep queue.\n";
+	auto before = benchmark_queue<CircularQueue<zstreams::Segment>>(segments);
+	std::cout << "CircularQueue: " << std::fixed << std::setprecision(0) << before << " segments/s\n";
+	auto after = benchmark_queue<SpscQueue<zstreams::Segment>>(segments);
+	std::cout << "SpscQueue:     " << std::fixed << std::setprecision(0) << after << " segments/s\n";
+	std::cout << "Speedup: " << std::setprecision(2) << after / before << "x\n";
+}
+
+// Hashes a 1-byte "file", the way ArchiveWriter::add_files() does.
+static void process_tiny_file(bool fusion){
+	zstreams::StreamPipeline pipeline;
+	pipeline.set_fusion_enabled(fusion);
+	zstreams::Stream<zstreams::NullSink> null(pipeline);
+	zstreams::Stream<zstreams::HashSink<CryptoPP::SHA256>> hash(*null);
+	std::unique_ptr<std::istream> stream(new std::istringstream("x"));
+	zstreams::Stream<zstreams::StdStreamSource> source(stream, pipeline);
+	source->copy_to(*hash);
+	hash->get_digest();
+}
+
+// Writes a 1-byte object to memory, the way small metadata streams are
+// written.
+static void process_tiny_object(bool fusion){
+	buffer_t mem;
+	zstreams::StreamPipeline pipeline;
+	pipeline.set_fusion_enabled(fusion);
+	zstreams::Stream<zstreams::MemorySink> sink(mem, pipeline);
+	boost::iostreams::stream<zstreams::SynchronousSink> stream(*sink);
+	stream.write("x", 1);
+}
+
+template <typename F>
+static double benchmark_latency(size_t iterations, F f){
+	auto start = benchmark_clock::now();
+	for (size_t i = 0; i < iterations; i++)
+		f();
+	return seconds_since(start) / iterations;
+}
+
+void benchmark_tiny_files(){
+	const size_t iterations = 1000;
+	std::cout << "Average latency over " << iterations << " pipelines carrying 1 byte each.\n";
+	for (int i = 0; i < 2; i++){
+		bool fusion = !i;
+		const char *label = fusion ? "fused" : "unfused";
+		auto file = benchmark_latency(iterations, [fusion](){ process_tiny_file(fusion); });
+		auto object = benchmark_latency(iterations, [fusion](){ process_tiny_object(fusion); });
+		std::cout
+			<< std::fixed << std::setprecision(1)
+			<< "File (" << label << "):   " << file * 1e6 << " us\n"
+			<< "Object (" << label << "): " << object * 1e6 << " us\n";
+	}
+}
+
+struct BenchmarkFile{
+	path_t path;
+	std::uint64_t size;
+};
+
+static std::unique_ptr<std::istream> open_benchmark_file(const BenchmarkFile &file){
+	return std::unique_ptr<std::istream>(new boost::filesystem::ifstream(file.path, std::ios::binary));
+}
+
+// Compresses the files in the given order the way ArchiveWriter::add_files()
+// does, and returns the compressed size.
+static zstreams::streamsize_t compress_files(const std::vector<BenchmarkFile> &files){
+	zstreams::streamsize_t ret;
+	zstreams::StreamPipeline pipeline;
+	{
+		zstreams::Stream<zstreams::NullSink> null(pipeline);
+		zstreams::Stream<zstreams::ByteCounterSink> counter(*null, ret);
+		bool mt = true;
+		auto compressor = zstreams::create_compressor(Codec::Lzma, *counter, &mt, CompressionLevel::Normal);
+		for (auto &file : files){
+			zstreams::streamsize_t size;
+			zstreams::Stream<zstreams::ByteCounterSink> file_counter(*compressor, size);
+			auto stream = open_benchmark_file(file);
+			zstreams::Stream<zstreams::StdStreamSource> source(stream, pipeline);
+			if (file.size)
+				source->copy_to(*file_counter);
+		}
+	}
+	pipeline.check_exceptions();
+	return ret;
+}
+
+void benchmark_ordering(const std::wstring &path){
+	std::vector<BenchmarkFile> files;
+	std::uint64_t total_size = 0;
+	boost::system::error_code error;
+	for (boost::filesystem::recursive_directory_iterator i(path, error), e; !error && i != e; i.increment(error)){
+		if (!boost::filesystem::is_regular_file(i->status()))
+			continue;
+		BenchmarkFile file = { i->path(), boost::filesystem::file_size(i->path(), error) };
+		if (error){
+			error.clear();
+			continue;
+		}
+		files.push_back(file);
+		total_size += file.size;
+	}
+	std::cout << "Compressing " << files.size() << " files (" << total_size << " bytes) with LZMA in two orders.\n";
+	if (!files.size())
+		return;
+
+	// The order reorder_file_streams() uses when similarity ordering is
+	// disabled.
+	std::sort(files.begin(), files.end(), [](const BenchmarkFile &a, const BenchmarkFile &b){
+		auto a_extension = get_extension(a.path.wstring());
+		auto b_extension = get_extension(b.path.wstring());
+		if (extension_sort(a_extension, b_extension))
+			return true;
+		if (extension_sort(b_extension, a_extension))
+			return false;
+		return a.size < b.size;
+	});
+
+	auto start = benchmark_clock::now();
+	std::vector<ContentSketch> sketches(files.size());
+	for (size_t i = 0; i < files.size(); i++)
+		sketches[i].compute(*open_benchmark_file(files[i]), files[i].size);
+	std::vector<const ContentSketch *> sketch_pointers;
+	for (auto &sketch : sketches)
+		sketch_pointers.push_back(&sketch);
+	auto order = order_by_similarity(sketch_pointers);
+	auto sketch_time = seconds_since(start);
+	std::vector<BenchmarkFile> similarity_files;
+	for (auto i : order)
+		similarity_files.push_back(files[i]);
+
+	start = benchmark_clock::now();
+	auto before = compress_files(files);
+	auto before_time = seconds_since(start);
+	start = benchmark_clock::now();
+	auto after = compress_files(similarity_files);
+	auto after_time = seconds_since(start);
+
+	std::cout
+		<< std::fixed << std::setprecision(4)
+		<< "Extension order:  " << before << " bytes, ratio " << (double)before / total_size << ", " << std::setprecision(2) << before_time << " s\n"
+		<< std::setprecision(4)
+		<< "Similarity order: " << after << " bytes, ratio " << (double)after / total_size << ", " << std::setprecision(2) << after_time << " s"
+		<< " (+" << sketch_time << " s to sketch and order)\n"
+		<< "Size change: " << std::showpos << ((double)after / before - 1) * 100 << std::noshowpos << "%\n";
+}
+
+// Hashes a file through a pipeline of its own, the way files used to be
+// hashed before BatchHasher.
+static sha256_digest hash_file_with_pipeline(const BenchmarkFile &file){
+	auto stream = open_benchmark_file(file);
+	zstreams::StreamPipeline pipeline;
+	zstreams::Stream<zstreams::NullSink> null(pipeline);
+	zstreams::Stream<zstreams::StdStreamSource> source(stream, pipeline);
+	std::shared_ptr<zstreams::HashSink<CryptoPP::SHA256>::digest_t> digest;
+	{
+		zstreams::Stream<zstreams::HashSink<CryptoPP::SHA256>> hash(*null);
+		source->copy_to(*hash);
+		digest = hash->get_digest();
+	}
+	sha256_digest ret;
+	std::copy(digest->begin(), digest->end(), ret.begin());
+	return ret;
+}
+
+// Reads the files whole and hashes them in batches, the way BatchHasher
+// does. Returns the time spent hashing, not counting the reads.
+static double hash_files_in_batches(const std::vector<BenchmarkFile> &files, Sha256Engine engine, std::vector<sha256_digest> &digests){
+	const size_t batch_size = 256;
+	double hashing_time = 0;
+	digests.resize(files.size());
+	for (size_t i = 0; i < files.size(); i += batch_size){
+		auto n = std::min(batch_size, files.size() - i);
+		std::vector<buffer_t> data(n);
+		std::vector<HashInput> inputs(n);
+		for (size_t j = 0; j < n; j++){
+			auto stream = open_benchmark_file(files[i + j]);
+			BatchHasher::read(data[j], *stream, files[i + j].size);
+			inputs[j] = { data[j].data(), data[j].size() };
+		}
+		auto start = benchmark_clock::now();
+		sha256_batch(inputs.data(), n, &digests[i], engine);
+		hashing_time += seconds_since(start);
+	}
+	return hashing_time;
+}
+
+// Like hash_files_in_batches(), but computes the fingerprints of the files.
+static double fingerprint_files(const std::vector<BenchmarkFile> &files){
+	const size_t batch_size = 256;
+	double hashing_time = 0;
+	fingerprint_t fingerprint;
+	for (size_t i = 0; i < files.size(); i += batch_size){
+		auto n = std::min(batch_size, files.size() - i);
+		std::vector<buffer_t> data(n);
+		for (size_t j = 0; j < n; j++){
+			auto stream = open_benchmark_file(files[i + j]);
+			BatchHasher::read(data[j], *stream, files[i + j].size);
+		}
+		auto start = benchmark_clock::now();
+		for (auto &d : data)
+			xxh3_128(fingerprint, d.data(), d.size());
+		hashing_time += seconds_since(start);
+	}
+	return hashing_time;
+}
+
+// Compares the throughput of SHA-256 and of the fingerprint on a single big
+// buffer, which is what hashing a big file amounts to.
+static void benchmark_large_buffer(){
+	const size_t size = 64 << 20;
+	buffer_t data(size);
+	std::mt19937 rng(1);
+	for (auto &b : data)
+		b = (std::uint8_t)rng();
+
+	auto engine = get_sha256_engine();
+	HashInput input = { data.data(), data.size() };
+	sha256_digest digest;
+	auto start = benchmark_clock::now();
+	sha256_batch(&input, 1, &digest, engine);
+	auto sha256_time = seconds_since(start);
+
+	fingerprint_t fingerprint;
+	start = benchmark_clock::now();
+	xxh3_128(fingerprint, data.data(), data.size());
+	auto fingerprint_time = seconds_since(start);
+
+	std::cout
+		<< std::setprecision(1)
+		<< "One buffer of " << (size >> 20) << " MiB: SHA-256 (" << to_string(engine) << ") " << size / sha256_time / 1e6 << " MB/s, "
+		<< "XXH3-128 " << size / fingerprint_time / 1e6 << " MB/s\n";
+}
+
+void benchmark_hashing(){
+	const size_t directories = 100;
+	const size_t files_per_directory = 200;
+	const size_t max_file_size = 4 << 10;
+
+	auto root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+	std::vector<BenchmarkFile> files;
+	std::uint64_t total_size = 0;
+	{
+		std::mt19937 rng(1);
+		buffer_t contents(max_file_size);
+		for (size_t i = 0; i < directories; i++){
+			auto directory = root / std::to_string(i);
+			boost::filesystem::create_directories(directory);
+			for (size_t j = 0; j < files_per_directory; j++){
+				BenchmarkFile file = { directory / (std::to_string(j) + ".txt"), rng() % (max_file_size + 1) };
+				for (size_t k = 0; k < file.size; k++)
+					contents[k] = (std::uint8_t)rng();
+				boost::filesystem::ofstream stream(file.path, std::ios::binary);
+				stream.write((const char *)contents.data(), file.size);
+				files.push_back(file);
+				total_size += file.size;
+			}
+		}
+	}
+	std::cout << "Hashing a synthetic tree of " << files.size() << " files (" << total_size << " bytes) of up to " << max_file_size << " bytes.\n";
+
+	auto start = benchmark_clock::now();
+	std::vector<sha256_digest> reference;
+	for (auto &file : files)
+		reference.push_back(hash_file_with_pipeline(file));
+	auto pipeline_time = seconds_since(start);
+	std::cout
+		<< std::fixed << std::setprecision(0)
+		<< "One pipeline per file: " << files.size() / pipeline_time << " files/s\n";
+
+	for (auto engine : { Sha256Engine::Generic, Sha256Engine::Avx2, Sha256Engine::ShaNi }){
+		if (!is_supported(engine)){
+			std::cout << "Batches (" << to_string(engine) << "): not supported by this CPU\n";
+			continue;
+		}
+		std::vector<sha256_digest> digests;
+		start = benchmark_clock::now();
+		auto hashing_time = hash_files_in_batches(files, engine, digests);
+		auto total_time = seconds_since(start);
+		std::cout
+			<< std::setprecision(0)
+			<< "Batches (" << to_string(engine) << "): " << files.size() / total_time << " files/s, "
+			<< std::setprecision(1) << total_size / hashing_time / 1e6 << " MB/s while hashing, speedup "
+			<< std::setprecision(2) << pipeline_time / total_time << "x"
+			<< (digests == reference ? "" : " (DIGESTS DIFFER)") << "\n";
+	}
+	{
+		start = benchmark_clock::now();
+		auto hashing_time = fingerprint_files(files);
+		auto total_time = seconds_since(start);
+		std::cout
+			<< std::setprecision(0)
+			<< "Fingerprints (XXH3-128): " << files.size() / total_time << " files/s, "
+			<< std::setprecision(1) << total_size / hashing_time / 1e6 << " MB/s while hashing, speedup "
+			<< std::setprecision(2) << pipeline_time / total_time << "x\n";
+	}
+	benchmark_large_buffer();
+
+	boost::system::error_code error;
+	boost::filesystem::remove_all(root, error);
+}
@@ -0,0 +1,13 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+void benchmark_queues();
+void benchmark_tiny_files();
+void benchmark_ordering(const std::wstring &path);
+void benchmark_hashing();
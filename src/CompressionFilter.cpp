@@ -0,0 +1,307 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "CompressionFilter.h"
+#include "LzmaFilter.h"
+#include "ZstdFilter.h"
+#include "Utility.h"
+
+namespace zstreams{
+
+CompressorSink::CompressorSink(Sink &stream):
+		Sink(stream),
+		blocks(std::make_shared<blocks_t>()){
+	this->blocks->push_back(Block{ 0, 0 });
+}
+
+CompressorSink::~CompressorSink(){
+	this->release_threads(this->threads);
+}
+
+unsigned CompressorSink::acquire_threads(){
+	if (!this->threads_acquired){
+		this->threads_acquired = true;
+		if (cpu_budget)
+			this->threads = cpu_budget->acquire_compression_threads();
+		else
+			this->threads = std::max(std::thread::hardware_concurrency(), 1U);
+	}
+	return this->threads;
+}
+
+void CompressorSink::release_threads(unsigned count){
+	count = std::min(count, this->threads);
+	this->threads -= count;
+	if (cpu_budget)
+		cpu_budget->release_compression_threads(count);
+}
+
+void CompressorSink::report_cpu_usage(){
+	// The workers are busy for as long as the compressor's own task is.
+	this->record_cpu_time(CpuStage::Compression, std::max(this->threads, 1U));
+}
+
+void CompressorSink::write_output(Segment &segment){
+	this->bytes_out += segment.get_data().size;
+	this->write(segment);
+}
+
+void CompressorSink::open_block(){
+	this->begin_block();
+	this->blocks->push_back(Block{ this->bytes_out, this->bytes_in });
+	this->block_input = 0;
+	this->block_open = true;
+}
+
+void CompressorSink::finish_block(){
+	this->end_block();
+	this->block_open = false;
+}
+
+void CompressorSink::flush_impl(){
+	if (this->finished)
+		return;
+	this->finished = true;
+	// If the last block was just finished, don't add an empty one.
+	if (this->block_open)
+		this->finish_block();
+	Segment eof(SegmentType::Eof);
+	this->write(eof);
+}
+
+void CompressorSink::work(){
+	Segment segment;
+	const std::uint8_t *input = nullptr;
+	size_t input_size = 0;
+	while (true){
+		if (!input_size){
+			segment = this->read();
+			if (segment.get_type() == SegmentType::Eof)
+				break;
+			auto data = segment.get_data();
+			if (!data.size)
+				continue;
+			input = data.data;
+			input_size = data.size;
+		}
+		if (!this->block_open)
+			this->open_block();
+		size_t size = input_size;
+		if (this->block_size)
+			size = (size_t)std::min<std::uint64_t>(size, this->block_size - this->block_input);
+		auto before = size;
+		this->compress(input, size);
+		auto consumed = before - size;
+		input_size -= consumed;
+		this->block_input += consumed;
+		this->bytes_in += consumed;
+		if (this->block_size && this->block_input == this->block_size)
+			this->finish_block();
+	}
+	this->flush_impl();
+}
+
+class BlockJob : public DecodedBlock{
+public:
+	std::vector<Segment> input;
+	std::mutex mutex;
+	std::deque<Segment> output;
+	bool done = false;
+	std::exception_ptr error;
+	Event event;
+	std::shared_ptr<TaskHandle> task;
+
+	void push(Segment &&segment) override{
+		{
+			LOCK_MUTEX(this->mutex);
+			this->output.emplace_back(std::move(segment));
+		}
+		this->event.signal();
+	}
+	void cancel(){
+		this->cancelled = true;
+	}
+};
+
+// The jobs use the DecompressorSource, so if it stops early they must be
+// stopped before it's destroyed.
+class BlockJobs : public std::deque<std::unique_ptr<BlockJob>>{
+public:
+	~BlockJobs(){
+		for (auto &job : *this)
+			job->cancel();
+		for (auto &job : *this)
+			job->task->join();
+	}
+};
+
+DecompressorSource::DecompressorSource(Source &stream, const std::vector<std::uint64_t> &block_sizes, std::uint64_t max_block_output):
+	Source(stream),
+	block_sizes(block_sizes),
+	max_block_output(max_block_output){}
+
+void DecompressorSource::work(){
+	if (this->block_sizes.size() > 1)
+		this->work_parallel();
+	else
+		this->work_sequential();
+}
+
+// Reads exactly size bytes. Returns false if the input ends first.
+bool DecompressorSource::read_block(std::vector<Segment> &dst, std::uint64_t size){
+	while (size){
+		auto segment = this->read();
+		if (segment.get_type() == SegmentType::Eof)
+			return false;
+		auto data = segment.get_data();
+		if (data.size > size){
+			auto head = segment.split((size_t)size);
+			this->put_back(segment);
+			segment = std::move(head);
+			data = segment.get_data();
+		}
+		size -= data.size;
+		dst.emplace_back(std::move(segment));
+	}
+	return true;
+}
+
+void DecompressorSource::work_parallel(){
+	// Each block in flight may hold up to max_block_output bytes of decoded
+	// data, waiting for the blocks before it to be written.
+	size_t max_jobs = std::max(executor->get_thread_count(), (size_t)2);
+	auto limit = buffer_pool->get_memory_limit();
+	if (limit && this->max_block_output)
+		max_jobs = (size_t)std::max<std::uint64_t>(std::min<std::uint64_t>(max_jobs, limit / 2 / this->max_block_output), 1);
+
+	BlockJobs jobs;
+	size_t next_block = 0;
+	bool input_ended = false;
+	while (true){
+		while (!input_ended && next_block < this->block_sizes.size() && jobs.size() < max_jobs){
+			std::unique_ptr<BlockJob> job(new BlockJob);
+			if (!this->read_block(job->input, this->block_sizes[next_block++])){
+				input_ended = true;
+				if (!job->input.size())
+					break;
+			}
+			auto p = job.get();
+			job->task = executor->spawn(std::make_unique<std::function<void()>>([this, p](){
+				try{
+					this->decode_block(p->input, *p);
+				}catch (...){
+					p->error = std::current_exception();
+				}
+				p->input.clear();
+				{
+					LOCK_MUTEX(p->mutex);
+					p->done = true;
+				}
+				p->event.signal();
+			}));
+			jobs.emplace_back(std::move(job));
+		}
+		if (!jobs.size())
+			break;
+
+		auto &job = *jobs.front();
+		while (true){
+			std::deque<Segment> output;
+			bool done;
+			{
+				LOCK_MUTEX(job.mutex);
+				output.swap(job.output);
+				done = job.done;
+			}
+			for (auto &segment : output)
+				this->write(segment);
+			if (done)
+				break;
+			job.event.wait();
+		}
+		job.task->join();
+		if (job.error)
+			std::rethrow_exception(job.error);
+		jobs.pop_front();
+	}
+	Segment eof(SegmentType::Eof);
+	this->write(eof);
+}
+
+int get_codec_level(Codec codec, CompressionLevel level){
+	static const int lzma_presets[] = { 1, 8, 9 };
+	static const int zstd_levels[] = { 3, 19, 22 };
+	switch (codec){
+		case Codec::Lzma:
+			return lzma_presets[(int)level];
+		case Codec::Zstd:
+			return zstd_levels[(int)level];
+	}
+	throw std::exception("Unknown codec.");
+}
+
+Stream<CompressorSink> create_compressor(Codec codec, Sink &stream, bool *multithreaded, CompressionLevel level, ContentFilter filter){
+	auto native_level = get_codec_level(codec, level);
+	switch (codec){
+		case Codec::Lzma:
+			return Stream<LzmaSink>(stream, multithreaded, native_level, level == CompressionLevel::Maximum, filter);
+		case Codec::Zstd:
+			return Stream<ZstdSink>(stream, multithreaded, native_level);
+	}
+	throw std::exception("Unknown codec.");
+}
+
+Stream<CompressorSink> create_compressor(Codec codec, Sink &stream, bool *multithreaded, int level, ContentFilter filter){
+	switch (codec){
+		case Codec::Lzma:
+			return Stream<LzmaSink>(stream, multithreaded, level, false, filter);
+		case Codec::Zstd:
+			return Stream<ZstdSink>(stream, multithreaded, level);
+	}
+	throw std::exception("Unknown codec.");
+}
+
+buffer_t compress_with_dictionary(Codec codec, int level, const buffer_t &data, const buffer_t &dictionary){
+	switch (codec){
+		case Codec::Lzma:
+			return lzma_compress_with_dictionary(level, data, dictionary);
+		case Codec::Zstd:
+			return zstd_compress_with_dictionary(level, data, dictionary);
+	}
+	throw std::exception("Unknown codec.");
+}
+
+buffer_t decompress_with_dictionary(Codec codec, const buffer_t &data, std::uint64_t size, const buffer_t &dictionary){
+	switch (codec){
+		case Codec::Lzma:
+			return lzma_decompress_with_dictionary(data, size, dictionary);
+		case Codec::Zstd:
+			return zstd_decompress_with_dictionary(data, size, dictionary);
+	}
+	throw std::exception("Unknown codec.");
+}
+
+bool codec_supports_filters(Codec codec){
+	return codec == Codec::Lzma;
+}
+
+Stream<DecompressorSource> create_decompressor(
+		Codec codec,
+		Source &stream,
+		const std::vector<std::uint64_t> &block_sizes,
+		std::uint64_t max_block_output){
+	switch (codec){
+		case Codec::Lzma:
+			return Stream<LzmaSource>(stream, block_sizes, max_block_output);
+		case Codec::Zstd:
+			return Stream<ZstdSource>(stream, block_sizes, max_block_output);
+	}
+	throw std::exception("Unknown codec.");
+}
+
+}
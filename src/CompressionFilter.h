@@ -0,0 +1,165 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#include "StreamProcessor.h"
+
+// The values are stored in archives. Don't reorder.
+enum class Codec{
+	Lzma = 0,
+	Zstd = 1,
+	Count,
+};
+
+// Preprocessing that makes some kinds of data more compressible. Chosen per
+// group of files, according to their contents. Only LZMA supports them; the
+// other codecs ignore them.
+enum class ContentFilter{
+	None,
+	// Branch conversion for executable code.
+	X86,
+	Arm64,
+	// Byte-wise delta with a distance of 2, 3 or 4, for uncompressed audio and
+	// images.
+	Delta2,
+	Delta3,
+	Delta4,
+};
+
+enum class CompressionLevel{
+	// Fast enough to keep up with reading the files being backed up.
+	Normal,
+	// Slower, better suited for smaller, redundant data, such as serialized
+	// objects.
+	High,
+	// As strong as the codec allows, for when time doesn't matter, such as
+	// when recompressing old archives.
+	Maximum,
+};
+
+namespace zstreams{
+
+// Base for compressors. Handles cutting the output into independent blocks.
+class CompressorSink : public Sink{
+public:
+	struct Block{
+		std::uint64_t offset,
+			uncompressed_offset;
+	};
+	typedef std::vector<Block> blocks_t;
+private:
+	std::uint64_t block_size = 0,
+		block_input = 0,
+		bytes_in = 0,
+		bytes_out = 0;
+	bool block_open = true,
+		finished = false;
+	std::shared_ptr<blocks_t> blocks;
+	unsigned threads = 0;
+	bool threads_acquired = false;
+
+	void open_block();
+	void finish_block();
+protected:
+	CompressorSink(Sink &);
+	// The first call takes threads for the compressor's workers from
+	// cpu_budget, and later calls return the same number. Zero means the
+	// compressor should run single-threaded.
+	unsigned acquire_threads();
+	// Gives back threads the compressor won't use after all.
+	void release_threads(unsigned);
+	void report_cpu_usage() override;
+	// Called before the second and later blocks. The first block begins
+	// when the compressor is constructed.
+	virtual void begin_block() = 0;
+	// Consumes as much of the input as it can, and advances input and size
+	// accordingly.
+	virtual void compress(const std::uint8_t *&input, size_t &size) = 0;
+	// Compresses any buffered input and completes the block, so that it can
+	// be decoded on its own.
+	virtual void end_block() = 0;
+	// Compressors should send their output through here.
+	void write_output(Segment &);
+	void flush_impl() override;
+	void work() override;
+public:
+	virtual ~CompressorSink();
+	// If non-zero, the output is made up of independently decodable blocks,
+	// each of which holds size bytes of input (the last one may hold fewer).
+	// Must be called before any data is written.
+	void set_block_size(std::uint64_t size){
+		this->block_size = size;
+	}
+	// The offsets at which each block starts, both in the output and in the
+	// input. Complete after the stream is flushed.
+	std::shared_ptr<blocks_t> get_blocks(){
+		return this->blocks;
+	}
+};
+
+// Lets a DecompressorSource decode a block on another task.
+class DecodedBlock{
+protected:
+	std::atomic<bool> cancelled;
+	DecodedBlock(): cancelled(false){}
+public:
+	virtual ~DecodedBlock(){}
+	virtual void push(Segment &&) = 0;
+	// If true, the decoder should stop as soon as possible.
+	bool is_cancelled() const{
+		return this->cancelled;
+	}
+};
+
+// Base for decompressors. If the input is made up of independent blocks
+// (see CompressorSink::set_block_size()), decodes them in parallel.
+class DecompressorSource : public Source{
+	std::vector<std::uint64_t> block_sizes;
+	std::uint64_t max_block_output;
+
+	void work() override;
+	void work_parallel();
+	bool read_block(std::vector<Segment> &, std::uint64_t size);
+protected:
+	DecompressorSource(Source &stream, const std::vector<std::uint64_t> &block_sizes, std::uint64_t max_block_output);
+	// Decodes the whole input, which may consist of several blocks.
+	virtual void work_sequential() = 0;
+	// Decodes one complete block. May be called concurrently from several
+	// tasks, so other than allocate_segment(), it must not touch the state of
+	// the decompressor.
+	virtual void decode_block(const std::vector<Segment> &input, DecodedBlock &output) = 0;
+public:
+	virtual ~DecompressorSource(){}
+};
+
+// The level that create_compressor() uses for the setting, in the codec's own
+// scale.
+int get_codec_level(Codec, CompressionLevel);
+Stream<CompressorSink> create_compressor(Codec, Sink &, bool *multithreaded, CompressionLevel, ContentFilter = ContentFilter::None);
+// Takes a level in the codec's own scale: an LZMA preset (0-9) or a
+// Zstandard level (1-22).
+Stream<CompressorSink> create_compressor(Codec, Sink &, bool *multithreaded, int level, ContentFilter = ContentFilter::None);
+// Compresses data on its own, primed with dictionary: the data may refer back
+// into the dictionary, so if the two are similar, little more than their
+// differences is stored. The same dictionary must be given to
+// decompress_with_dictionary(). Everything is done in memory, so it's meant
+// for small files. level is in the codec's own scale.
+buffer_t compress_with_dictionary(Codec, int level, const buffer_t &data, const buffer_t &dictionary);
+// size is the size of the decompressed data.
+buffer_t decompress_with_dictionary(Codec, const buffer_t &data, std::uint64_t size, const buffer_t &dictionary);
+bool codec_supports_filters(Codec);
+// block_sizes are the compressed sizes of the blocks that make up the input,
+// if known, and max_block_output is the most any of them decodes to.
+Stream<DecompressorSource> create_decompressor(
+	Codec,
+	Source &,
+	const std::vector<std::uint64_t> &block_sizes = std::vector<std::uint64_t>(),
+	std::uint64_t max_block_output = 0
+);
+
+}
@@ -0,0 +1,230 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "CompressionPolicy.h"
+#include "serialization/fso.generated.h"
+
+// Samples with at least this many bits of entropy per byte are considered
+// incompressible.
+const double incompressible_entropy = 7.9;
+// How many samples of an extension are needed before its statistics are
+// trusted.
+const std::uint64_t min_samples = 8;
+// Even when the statistics are trusted, every this many files one is
+// sampled, so that they can follow changes.
+const unsigned resample_interval = 16;
+
+static double compute_entropy(const std::uint8_t *data, size_t size){
+	size_t histogram[256] = { 0 };
+	for (size_t i = 0; i < size; i++)
+		histogram[data[i]]++;
+	double ret = 0;
+	for (auto n : histogram){
+		if (!n)
+			continue;
+		double p = (double)n / size;
+		ret -= p * std::log2(p);
+	}
+	return ret;
+}
+
+static std::uint16_t read_u16(const std::vector<std::uint8_t> &data, size_t offset){
+	if (offset + 2 > data.size())
+		return 0;
+	return data[offset] | data[offset + 1] << 8;
+}
+
+static std::uint32_t read_u32(const std::vector<std::uint8_t> &data, size_t offset){
+	if (offset + 4 > data.size())
+		return 0;
+	return read_u16(data, offset) | (std::uint32_t)read_u16(data, offset + 2) << 16;
+}
+
+static bool has_magic(const std::vector<std::uint8_t> &data, size_t offset, const char *magic){
+	auto n = strlen(magic);
+	return offset + n <= data.size() && !memcmp(&data[offset], magic, n);
+}
+
+static ContentFilter filter_from_machine(std::uint32_t machine){
+	switch (machine){
+		// PE
+		case 0x014C:
+		case 0x8664:
+		// ELF
+		case 3:
+		case 62:
+		// Mach-O
+		case 0x01000007:
+			return ContentFilter::X86;
+		case 0xAA64:
+		case 183:
+		case 0x0100000C:
+			return ContentFilter::Arm64;
+	}
+	return ContentFilter::None;
+}
+
+static ContentFilter filter_from_delta(unsigned distance){
+	switch (distance){
+		case 2:
+			return ContentFilter::Delta2;
+		case 3:
+			return ContentFilter::Delta3;
+		case 4:
+			return ContentFilter::Delta4;
+	}
+	return ContentFilter::None;
+}
+
+// Returns false if the header isn't recognized.
+static bool filter_from_header(ContentFilter &dst, const std::vector<std::uint8_t> &data){
+	if (has_magic(data, 0, "MZ")){
+		auto pe = read_u32(data, 0x3C);
+		if (!has_magic(data, pe, "PE"))
+			return false;
+		dst = filter_from_machine(read_u16(data, pe + 4));
+		return true;
+	}
+	if (has_magic(data, 0, "\x7F" "ELF")){
+		dst = filter_from_machine(read_u16(data, 18));
+		return true;
+	}
+	if (read_u32(data, 0) == 0xFEEDFACF){
+		dst = filter_from_machine(read_u32(data, 4));
+		return true;
+	}
+	if (has_magic(data, 0, "RIFF") && has_magic(data, 8, "WAVE")){
+		for (size_t offset = 12; offset + 8 <= data.size(); offset += 8 + (read_u32(data, offset + 4) + 1) / 2 * 2){
+			if (!has_magic(data, offset, "fmt "))
+				continue;
+			// Only PCM.
+			if (read_u16(data, offset + 8) != 1)
+				break;
+			dst = filter_from_delta(read_u16(data, offset + 20));
+			return true;
+		}
+		dst = ContentFilter::None;
+		return true;
+	}
+	if (has_magic(data, 0, "BM") && read_u32(data, 14) >= 40){
+		// Only uncompressed bitmaps.
+		auto compression = read_u32(data, 30);
+		if (compression != 0 && compression != 3){
+			dst = ContentFilter::None;
+			return true;
+		}
+		dst = filter_from_delta(read_u16(data, 28) / 8);
+		return true;
+	}
+	return false;
+}
+
+ContentFilter CompressionPolicy::get_extension_filter(const std::wstring &extension){
+	static const std::set<std::wstring, strcmpci> executables = {
+		L"a",
+		L"cpl",
+		L"dll",
+		L"drv",
+		L"dylib",
+		L"efi",
+		L"exe",
+		L"lib",
+		L"o",
+		L"obj",
+		L"ocx",
+		L"pyd",
+		L"scr",
+		L"so",
+		L"sys",
+	};
+	if (executables.find(extension) != executables.end())
+		return ContentFilter::X86;
+	if (strcmpci::equal(extension, L"wav"))
+		return ContentFilter::Delta4;
+	if (strcmpci::equal(extension, L"bmp"))
+		return ContentFilter::Delta3;
+	return ContentFilter::None;
+}
+
+bool CompressionPolicy::read_sample(std::vector<std::uint8_t> &dst, const FilishFso &fso, size_t size){
+	dst.resize(size);
+	try{
+		std::uint64_t file_size;
+		auto stream = fso.open_for_exclusive_read(file_size);
+		stream->read((char *)&dst[0], dst.size());
+		dst.resize((size_t)stream->gcount());
+	}catch (std::exception &){
+		// The file will fail again when it's added to the archive, which
+		// reports the error.
+		return false;
+	}
+	return dst.size() == size;
+}
+
+CompressionPolicy::Decision CompressionPolicy::decide(const FilishFso &fso, bool allow_storing){
+	auto extension = get_extension(fso.get_name());
+	Decision ret = { false, get_extension_filter(extension) };
+	// Small files aren't worth the time it takes to sample them.
+	if (fso.get_size() < sample_size)
+		return ret;
+	ExtensionStats *stats = nullptr;
+	bool sample = allow_storing;
+	if (allow_storing){
+		stats = &this->stats[extension];
+		if (stats->samples >= min_samples && stats->unsampled + 1 < resample_interval){
+			// At least 95% of the samples agree.
+			if (stats->incompressible * 20 >= stats->samples * 19){
+				stats->unsampled++;
+				ret.stored = true;
+				ret.filter = ContentFilter::None;
+				return ret;
+			}
+			if (stats->incompressible * 20 <= stats->samples){
+				stats->unsampled++;
+				sample = false;
+			}
+		}
+	}
+	bool sniff = !is_text_extension(extension);
+	if (!sample && !sniff)
+		return ret;
+
+	std::vector<std::uint8_t> buffer;
+	if (!read_sample(buffer, fso, sample ? sample_size : header_size))
+		return ret;
+	filter_from_header(ret.filter, buffer);
+	if (!sample)
+		return ret;
+	stats->unsampled = 0;
+	stats->samples++;
+	if (compute_entropy(&buffer[0], buffer.size()) >= incompressible_entropy){
+		stats->incompressible++;
+		ret.stored = true;
+		ret.filter = ContentFilter::None;
+	}
+	return ret;
+}
+
+void CompressionPolicy::load(const CompressionStats &src){
+	auto n = std::min(src.extensions.size(), std::min(src.samples.size(), src.incompressible_samples.size()));
+	for (size_t i = 0; i < n; i++){
+		ExtensionStats stats = { src.samples[i], src.incompressible_samples[i], 0 };
+		this->stats[src.extensions[i]] = stats;
+	}
+}
+
+void CompressionPolicy::save(CompressionStats &dst) const{
+	dst.extensions.clear();
+	dst.samples.clear();
+	dst.incompressible_samples.clear();
+	for (auto &kv : this->stats){
+		dst.extensions.push_back(kv.first);
+		dst.samples.push_back(kv.second.samples);
+		dst.incompressible_samples.push_back(kv.second.incompressible);
+	}
+}
@@ -0,0 +1,51 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#include "Utility.h"
+#include "CompressionFilter.h"
+
+class FilishFso;
+class CompressionStats;
+
+// Decides how each file is compressed.
+//
+// Files that look random (media, archives, etc.) barely shrink, so they're
+// stored as they are instead. This is decided by measuring the entropy of
+// the start of the file. Each extension remembers how often its files turned
+// out to be incompressible, and once that's clear enough, most of its files
+// are decided without being sampled.
+//
+// Executables and uncompressed audio and images get a filter, chosen by
+// their headers or, failing that, by their extensions.
+class CompressionPolicy{
+	struct ExtensionStats{
+		std::uint64_t samples,
+			incompressible;
+		// Decisions made from the statistics alone in this session.
+		unsigned unsampled;
+	};
+	std::map<std::wstring, ExtensionStats, strcmpci> stats;
+
+	static bool read_sample(std::vector<std::uint8_t> &dst, const FilishFso &, size_t size);
+public:
+	static const size_t sample_size = 64 << 10;
+	// Enough to recognize the formats that have filters.
+	static const size_t header_size = 4 << 10;
+	struct Decision{
+		bool stored;
+		ContentFilter filter;
+	};
+
+	Decision decide(const FilishFso &, bool allow_storing);
+	// The filter for files with the given extension, when their contents
+	// can't be examined.
+	static ContentFilter get_extension_filter(const std::wstring &extension);
+	void load(const CompressionStats &);
+	void save(CompressionStats &) const;
+};
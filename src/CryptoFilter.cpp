@@ -1,142 +1,502 @@
-/*
-Copyright (c), Helios
-All rights reserved.
-
-Distributed under a permissive license. See COPYING.txt for details.
-*/
-
-#include "stdafx.h"
-#include "CryptoFilter.h"
-#include "Utility.h"
-
-namespace zstreams{
-
-template <typename T>
-class GenericCryptoOutputStream : public CryptoSink{
-	typename CryptoPP::CBC_Mode<T>::Encryption e;
-	std::unique_ptr<CryptoPP::StreamTransformationFilter> filter;
-
-protected:
-	CryptoPP::StreamTransformationFilter *get_filter() override{
-		return this->filter.get();
-	}
-public:
-	GenericCryptoOutputStream(
-			Sink &stream,
-			const CryptoPP::SecByteBlock &key,
-			const CryptoPP::SecByteBlock &iv): CryptoSink(stream){
-		this->e.SetKeyWithIV(key, key.size(), iv.data(), iv.size());
-		this->filter.reset(new CryptoPP::StreamTransformationFilter(this->e));
-	}
-};
-
-Stream<CryptoSink> CryptoSink::create(Algorithm algo, Sink &stream, const CryptoPP::SecByteBlock *key, const CryptoPP::SecByteBlock *iv){
-	switch (algo){
-		case Algorithm::Rijndael:
-			return Stream<GenericCryptoOutputStream<CryptoPP::Rijndael>>(stream, *key, *iv);
-		case Algorithm::Serpent:
-			return Stream<GenericCryptoOutputStream<CryptoPP::Serpent>>(stream, *key, *iv);
-		case Algorithm::Twofish:
-			return Stream<GenericCryptoOutputStream<CryptoPP::Twofish>>(stream, *key, *iv);
-	}
-	zekvok_assert(false);
-	return Stream<GenericCryptoOutputStream<CryptoPP::Twofish>>();
-}
-
-void CryptoSink::work(){
-	auto filter = this->get_filter();
-	while (true){
-		{
-			auto segment = this->read();
-			if (segment.get_type() == SegmentType::Eof)
-				break;
-			auto data = segment.get_data();
-			filter->Put(data.data, data.size);
-		}
-
-		this->flush_filter(filter);
-	}
-	this->flush_impl();
-}
-
-static void flush_filter(StreamProcessor *p, CryptoPP::StreamTransformationFilter *filter){
-	while (true){
-		auto segment = p->allocate_segment();
-		auto data = segment.get_data();
-		auto read = filter->Get(data.data, data.size);
-		if (!read)
-			return;
-		segment.trim_to_size(read);
-		p->write(segment);
-	}
-}
-
-void CryptoSink::flush_filter(CryptoPP::StreamTransformationFilter *filter){
-	zstreams::flush_filter(this, filter);
-}
-
-void CryptoSink::flush_impl(){
-	auto filter = this->get_filter();
-	if (!this->flushed){
-		filter->MessageEnd();
-		this->flushed = true;
-	}
-	this->flush_filter(filter);
-}
-
-template <typename T>
-class GenericCryptoInputStream : public CryptoSource{
-	typename CryptoPP::CBC_Mode<T>::Decryption d;
-	std::unique_ptr<CryptoPP::StreamTransformationFilter> filter;
-
-protected:
-	CryptoPP::StreamTransformationFilter *get_filter() override{
-		return this->filter.get();
-	}
-public:
-	GenericCryptoInputStream(Source &stream, const CryptoPP::SecByteBlock &key, const CryptoPP::SecByteBlock &iv): CryptoSource(stream){
-		this->d.SetKeyWithIV(key, key.size(), iv.data(), iv.size());
-		this->filter.reset(new CryptoPP::StreamTransformationFilter(this->d));
-	}
-};
-
-Stream<CryptoSource> CryptoSource::create(
-		Algorithm algo,
-		Source &stream,
-		const CryptoPP::SecByteBlock *key,
-		const CryptoPP::SecByteBlock *iv){
-	switch (algo){
-		case Algorithm::Rijndael:
-			return Stream<GenericCryptoInputStream<CryptoPP::Rijndael>>(stream, *key, *iv);
-		case Algorithm::Serpent:
-			return Stream<GenericCryptoInputStream<CryptoPP::Serpent>>(stream, *key, *iv);
-		case Algorithm::Twofish:
-			return Stream<GenericCryptoInputStream<CryptoPP::Twofish>>(stream, *key, *iv);
-	}
-	zekvok_assert(false);
-	return Stream<GenericCryptoInputStream<CryptoPP::Twofish>>();
-}
-
-void CryptoSource::work(){
-	auto filter = this->get_filter();
-	bool done = false;
-
-	while (!done){
-		{
-			auto segment = this->read();
-			if (segment.get_type() == SegmentType::Eof){
-				filter->MessageEnd();
-				done = true;
-			}else{
-				auto data = segment.get_data();
-				filter->Put(data.data, data.size);
-			}
-		}
-
-		zstreams::flush_filter(this, filter);
-	}
-	Segment eof(SegmentType::Eof);
-	this->write(eof);
-}
-
-}
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "CryptoFilter.h"
+#include "Utility.h"
+#include "Exception.h"
+
+const size_t crypto_tag_size = 16;
+const size_t default_crypto_chunk_size = (64 << 10) - crypto_tag_size;
+const size_t max_crypto_chunk_size = BufferPool::large_size - crypto_tag_size;
+// 96 bits is the nonce size GCM handles most efficiently.
+const size_t crypto_nonce_size = 12;
+
+namespace zstreams{
+
+class CbcCryptoSink : public CryptoSink{
+protected:
+	bool flushed;
+	virtual CryptoPP::StreamTransformationFilter *get_filter() = 0;
+	CbcCryptoSink(Sink &stream):
+		CryptoSink(stream),
+		flushed(false){}
+	void work() override;
+	void flush_impl() override;
+	void flush_filter(CryptoPP::StreamTransformationFilter *);
+};
+
+template <typename T>
+class GenericCryptoOutputStream : public CbcCryptoSink{
+	typename CryptoPP::CBC_Mode<T>::Encryption e;
+	std::unique_ptr<CryptoPP::StreamTransformationFilter> filter;
+
+protected:
+	CryptoPP::StreamTransformationFilter *get_filter() override{
+		return this->filter.get();
+	}
+public:
+	GenericCryptoOutputStream(
+			Sink &stream,
+			const CryptoPP::SecByteBlock &key,
+			const CryptoPP::SecByteBlock &iv): CbcCryptoSink(stream){
+		this->e.SetKeyWithIV(key, key.size(), iv.data(), iv.size());
+		this->filter.reset(new CryptoPP::StreamTransformationFilter(this->e));
+	}
+};
+
+Stream<CryptoSink> CryptoSink::create(Algorithm algo, Sink &stream, const CryptoPP::SecByteBlock *key, const CryptoPP::SecByteBlock *iv){
+	switch (algo){
+		case Algorithm::Rijndael:
+			return Stream<GenericCryptoOutputStream<CryptoPP::Rijndael>>(stream, *key, *iv);
+		case Algorithm::Serpent:
+			return Stream<GenericCryptoOutputStream<CryptoPP::Serpent>>(stream, *key, *iv);
+		case Algorithm::Twofish:
+			return Stream<GenericCryptoOutputStream<CryptoPP::Twofish>>(stream, *key, *iv);
+	}
+	zekvok_assert(false);
+	return Stream<GenericCryptoOutputStream<CryptoPP::Twofish>>();
+}
+
+void CbcCryptoSink::work(){
+	auto filter = this->get_filter();
+	while (true){
+		{
+			auto segment = this->read();
+			if (segment.get_type() == SegmentType::Eof)
+				break;
+			auto data = segment.get_data();
+			filter->Put(data.data, data.size);
+		}
+
+		this->flush_filter(filter);
+	}
+	this->flush_impl();
+}
+
+static void flush_filter(StreamProcessor *p, CryptoPP::StreamTransformationFilter *filter){
+	while (true){
+		auto segment = p->allocate_segment();
+		auto data = segment.get_data();
+		auto read = filter->Get(data.data, data.size);
+		if (!read)
+			return;
+		segment.trim_to_size(read);
+		p->write(segment);
+	}
+}
+
+void CbcCryptoSink::flush_filter(CryptoPP::StreamTransformationFilter *filter){
+	zstreams::flush_filter(this, filter);
+}
+
+void CbcCryptoSink::flush_impl(){
+	auto filter = this->get_filter();
+	if (!this->flushed){
+		filter->MessageEnd();
+		this->flushed = true;
+	}
+	this->flush_filter(filter);
+}
+
+// Splits count items into tasks contiguous runs and calls f() for each run on
+// a task of its own on the executor (the first one on the caller's), with the
+// index of the run. Waits for all of them and rethrows the first error.
+static void run_in_tasks(size_t count, size_t tasks, const std::function<void(size_t task, size_t begin, size_t end)> &f){
+	std::vector<std::exception_ptr> errors(tasks);
+	auto run_range = [&](size_t task){
+		try{
+			f(task, count * task / tasks, count * (task + 1) / tasks);
+		}catch (...){
+			errors[task] = std::current_exception();
+		}
+	};
+	std::vector<std::shared_ptr<TaskHandle>> handles;
+	for (size_t task = 1; task < tasks; task++)
+		handles.push_back(executor->spawn(std::make_unique<std::function<void()>>([&run_range, task](){ run_range(task); })));
+	run_range(0);
+	for (auto &handle : handles)
+		handle->join();
+	for (auto &error : errors)
+		if (error)
+			std::rethrow_exception(error);
+}
+
+// Returns how many tasks count items should be split among.
+static size_t get_task_count(size_t count){
+	return std::max<size_t>(std::min<size_t>(count, executor->get_thread_count()), 1);
+}
+
+// Unlike encryption, CBC decryption doesn't depend on its own output: each
+// block is decrypted by itself and XORed with the ciphertext block before
+// it. So the ciphertext is gathered into large segments, and each segment is
+// split into runs of blocks that are decrypted by several tasks at once,
+// each one starting with the ciphertext block before its run as the IV.
+template <typename T>
+class CbcCryptoSource : public CryptoSource{
+	typedef typename CryptoPP::CBC_Mode<T>::Decryption cipher_t;
+	static const size_t block_size = T::BLOCKSIZE;
+	CryptoPP::SecByteBlock key;
+	// One per task, since they hold state between calls.
+	std::vector<std::unique_ptr<cipher_t>> ciphers;
+	// The ciphertext block before the first one in input.
+	std::uint8_t previous[block_size];
+	Segment input;
+	size_t input_size,
+		input_fill = 0;
+	unsigned max_tasks = 1;
+
+	void work() override;
+	void decrypt_input(bool last);
+	void report_cpu_usage() override{
+		this->record_cpu_time(CpuStage::Encryption, this->max_tasks);
+	}
+public:
+	CbcCryptoSource(Source &stream, const CryptoPP::SecByteBlock &key, const CryptoPP::SecByteBlock &iv):
+			CryptoSource(stream),
+			key(key),
+			input_size(BufferPool::large_size / block_size * block_size){
+		zekvok_assert(iv.size() == block_size);
+		std::copy(iv.begin(), iv.end(), this->previous);
+		this->set_segment_size(this->input_size);
+	}
+};
+
+Stream<CryptoSource> CryptoSource::create(
+		Algorithm algo,
+		Source &stream,
+		const CryptoPP::SecByteBlock *key,
+		const CryptoPP::SecByteBlock *iv){
+	switch (algo){
+		case Algorithm::Rijndael:
+			return Stream<CbcCryptoSource<CryptoPP::Rijndael>>(stream, *key, *iv);
+		case Algorithm::Serpent:
+			return Stream<CbcCryptoSource<CryptoPP::Serpent>>(stream, *key, *iv);
+		case Algorithm::Twofish:
+			return Stream<CbcCryptoSource<CryptoPP::Twofish>>(stream, *key, *iv);
+	}
+	zekvok_assert(false);
+	return Stream<CbcCryptoSource<CryptoPP::Twofish>>();
+}
+
+template <typename T>
+void CbcCryptoSource<T>::work(){
+	while (true){
+		auto segment = this->read();
+		if (segment.get_type() == SegmentType::Eof)
+			break;
+		auto data = segment.get_data();
+		while (data.size){
+			if (!this->input)
+				this->input = this->allocate_segment();
+			auto n = std::min(data.size, this->input_size - this->input_fill);
+			memcpy(this->input.get_data().data + this->input_fill, data.data, n);
+			data.data += n;
+			data.size -= n;
+			this->input_fill += n;
+			if (this->input_fill == this->input_size)
+				this->decrypt_input(false);
+		}
+	}
+	// The input also looks like it ended if the pipeline is being stopped.
+	this->throw_on_termination();
+	if (!this->input_fill || this->input_fill % block_size)
+		throw ArchiveReadException("Invalid data: Encrypted data is truncated");
+	this->decrypt_input(true);
+	Segment eof(SegmentType::Eof);
+	this->write(eof);
+}
+
+template <typename T>
+void CbcCryptoSource<T>::decrypt_input(bool last){
+	auto input = this->input.get_data().data;
+	auto blocks = this->input_fill / block_size;
+	// Until the stream ends, the last block is held back, since it might be
+	// the one with the padding.
+	if (!last)
+		blocks--;
+	auto output = this->allocate_segment();
+	auto out = output.get_data().data;
+	auto tasks = get_task_count(blocks);
+	while (this->ciphers.size() < tasks){
+		std::unique_ptr<cipher_t> cipher(new cipher_t);
+		cipher->SetKeyWithIV(this->key, this->key.size(), this->previous, block_size);
+		this->ciphers.push_back(std::move(cipher));
+	}
+	auto previous = this->previous;
+	run_in_tasks(blocks, tasks, [&](size_t task, size_t begin, size_t end){
+		auto &cipher = *this->ciphers[task];
+		cipher.Resynchronize(begin ? input + (begin - 1) * block_size : previous, (int)block_size);
+		cipher.ProcessData(out + begin * block_size, input + begin * block_size, (end - begin) * block_size);
+	});
+	this->max_tasks = std::max(this->max_tasks, (unsigned)tasks);
+	auto size = blocks * block_size;
+	if (last){
+		// PKCS #7 padding.
+		auto padding = out[size - 1];
+		if (!padding || padding > block_size || std::any_of(out + size - padding, out + size, [padding](std::uint8_t c){ return c != padding; }))
+			throw ArchiveReadException("Invalid data: Encrypted data has invalid padding");
+		size -= padding;
+	}else{
+		memcpy(this->previous, input + (blocks - 1) * block_size, block_size);
+		memcpy(input, input + blocks * block_size, block_size);
+		this->input_fill = block_size;
+	}
+	if (!size)
+		return;
+	output.trim_to_size(size);
+	this->write(output);
+}
+
+// The nonce of each chunk is the stream's IV with the chunk number XORed into
+// its last bytes. Every stream has a key of its own, so nonces never repeat
+// under the same key.
+static void make_nonce(std::uint8_t *dst, const CryptoPP::SecByteBlock &iv, std::uint64_t chunk){
+	std::copy(iv.begin(), iv.begin() + crypto_nonce_size, dst);
+	for (size_t i = 0; i < sizeof(chunk); i++)
+		dst[crypto_nonce_size - 1 - i] ^= (std::uint8_t)(chunk >> (8 * i));
+}
+
+// Transforms runs of chunks in place, spreading them among tasks on the
+// executor. Each task uses a cipher object of its own, since they hold state
+// between calls.
+template <typename Cipher>
+class ChunkCiphers{
+	std::vector<std::unique_ptr<Cipher>> ciphers;
+	CryptoPP::SecByteBlock key,
+		iv;
+public:
+	typedef std::function<void(Cipher &, size_t, const std::uint8_t *nonce)> chunk_function_t;
+	ChunkCiphers(const CryptoPP::SecByteBlock &key, const CryptoPP::SecByteBlock &iv): key(key), iv(iv){
+		zekvok_assert(iv.size() >= crypto_nonce_size);
+	}
+	// Calls f() for the chunks numbered first_chunk to first_chunk + count,
+	// with the index of the chunk in the run and its nonce. Returns how many
+	// tasks were used.
+	unsigned run(size_t count, std::uint64_t first_chunk, const chunk_function_t &f);
+};
+
+template <typename Cipher>
+unsigned ChunkCiphers<Cipher>::run(size_t count, std::uint64_t first_chunk, const chunk_function_t &f){
+	auto tasks = get_task_count(count);
+	while (this->ciphers.size() < tasks){
+		std::unique_ptr<Cipher> cipher(new Cipher);
+		cipher->SetKey(this->key, this->key.size());
+		this->ciphers.push_back(std::move(cipher));
+	}
+	run_in_tasks(count, tasks, [&](size_t task, size_t begin, size_t end){
+		std::uint8_t nonce[crypto_nonce_size];
+		for (size_t i = begin; i < end; i++){
+			make_nonce(nonce, this->iv, first_chunk + i);
+			f(*this->ciphers[task], i, nonce);
+		}
+	});
+	return (unsigned)tasks;
+}
+
+// Both sides gather the chunks into segments that hold a whole number of
+// them, with their tags, and transform all the chunks in a segment at once.
+static size_t get_chunks_per_segment(size_t chunk_size){
+	// Chunks are decrypted in place, so one that doesn't fit in a segment
+	// would overflow the buffer.
+	zekvok_assert(chunk_size && chunk_size <= max_crypto_chunk_size);
+	return BufferPool::large_size / (chunk_size + crypto_tag_size);
+}
+
+template <typename T>
+class ChunkedCryptoSink : public CryptoSink{
+	typedef typename T::Encryption cipher_t;
+	ChunkCiphers<cipher_t> ciphers;
+	size_t chunks_per_segment;
+	std::uint64_t next_chunk = 0;
+	unsigned max_tasks = 1;
+	Segment output;
+	// Full chunks in output, and bytes in the chunk after them.
+	size_t chunks = 0,
+		chunk_fill = 0;
+
+	void work() override;
+	void write_output(bool last);
+	void report_cpu_usage() override{
+		this->record_cpu_time(CpuStage::Encryption, this->max_tasks);
+	}
+public:
+	ChunkedCryptoSink(Sink &stream, const CryptoPP::SecByteBlock &key, const CryptoPP::SecByteBlock &iv):
+			CryptoSink(stream),
+			ciphers(key, iv),
+			chunks_per_segment(get_chunks_per_segment(default_crypto_chunk_size)){
+		this->set_segment_size(this->chunks_per_segment * (default_crypto_chunk_size + crypto_tag_size));
+	}
+};
+
+template <typename T>
+void ChunkedCryptoSink<T>::work(){
+	const auto stride = default_crypto_chunk_size + crypto_tag_size;
+	while (true){
+		auto segment = this->read();
+		if (segment.get_type() == SegmentType::Eof)
+			break;
+		auto data = segment.get_data();
+		while (data.size){
+			if (!this->output)
+				this->output = this->allocate_segment();
+			auto n = std::min(data.size, default_crypto_chunk_size - this->chunk_fill);
+			memcpy(this->output.get_data().data + this->chunks * stride + this->chunk_fill, data.data, n);
+			data.data += n;
+			data.size -= n;
+			this->chunk_fill += n;
+			if (this->chunk_fill < default_crypto_chunk_size)
+				continue;
+			this->chunk_fill = 0;
+			if (++this->chunks == this->chunks_per_segment)
+				this->write_output(false);
+		}
+	}
+	if (!this->output)
+		this->output = this->allocate_segment();
+	this->write_output(true);
+}
+
+// The last chunk is the partial one after the full ones.
+template <typename T>
+void ChunkedCryptoSink<T>::write_output(bool last){
+	const auto stride = default_crypto_chunk_size + crypto_tag_size;
+	auto base = this->output.get_data().data;
+	auto full_chunks = this->chunks;
+	auto last_size = this->chunk_fill;
+	auto tasks = this->ciphers.run(full_chunks + last, this->next_chunk, [=](cipher_t &cipher, size_t i, const std::uint8_t *nonce){
+		auto chunk = base + i * stride;
+		auto size = i < full_chunks ? default_crypto_chunk_size : last_size;
+		// Authenticating whether the chunk is the last one keeps the stream
+		// from being cut short at a chunk boundary.
+		std::uint8_t is_last = i == full_chunks;
+		cipher.EncryptAndAuthenticate(chunk, chunk + size, crypto_tag_size, nonce, crypto_nonce_size, &is_last, 1, chunk, size);
+	});
+	this->max_tasks = std::max(this->max_tasks, tasks);
+	this->output.trim_to_size(full_chunks * stride + (last ? last_size + crypto_tag_size : 0));
+	this->write(this->output);
+	this->output = Segment();
+	this->next_chunk += full_chunks + last;
+	this->chunks = 0;
+	this->chunk_fill = 0;
+}
+
+Stream<CryptoSink> CryptoSink::create(CryptoMode mode, Algorithm algo, Sink &stream, const CryptoPP::SecByteBlock *key, const CryptoPP::SecByteBlock *iv){
+	switch (mode){
+		case CryptoMode::Cbc:
+			return create(algo, stream, key, iv);
+		case CryptoMode::AesGcm:
+			return Stream<ChunkedCryptoSink<CryptoPP::GCM<CryptoPP::AES>>>(stream, *key, *iv);
+	}
+	zekvok_assert(false);
+	return Stream<ChunkedCryptoSink<CryptoPP::GCM<CryptoPP::AES>>>();
+}
+
+template <typename T>
+class ChunkedCryptoSource : public CryptoSource{
+	typedef typename T::Decryption cipher_t;
+	ChunkCiphers<cipher_t> ciphers;
+	size_t chunk_size,
+		chunks_per_segment;
+	std::uint64_t next_chunk;
+	unsigned max_tasks = 1;
+	Segment output;
+	// Full chunks in output, and bytes in the chunk after them.
+	size_t chunks = 0,
+		chunk_fill = 0;
+
+	void work() override;
+	void write_output(bool last);
+	void report_cpu_usage() override{
+		this->record_cpu_time(CpuStage::Encryption, this->max_tasks);
+	}
+public:
+	ChunkedCryptoSource(Source &stream, const CryptoPP::SecByteBlock &key, const CryptoPP::SecByteBlock &iv, size_t chunk_size, std::uint64_t first_chunk):
+			CryptoSource(stream),
+			ciphers(key, iv),
+			chunk_size(chunk_size),
+			chunks_per_segment(get_chunks_per_segment(chunk_size)),
+			next_chunk(first_chunk){
+		this->set_segment_size(this->chunks_per_segment * (chunk_size + crypto_tag_size));
+	}
+};
+
+template <typename T>
+void ChunkedCryptoSource<T>::work(){
+	const auto stride = this->chunk_size + crypto_tag_size;
+	while (true){
+		auto segment = this->read();
+		if (segment.get_type() == SegmentType::Eof)
+			break;
+		auto data = segment.get_data();
+		while (data.size){
+			if (!this->output)
+				this->output = this->allocate_segment();
+			auto n = std::min(data.size, stride - this->chunk_fill);
+			memcpy(this->output.get_data().data + this->chunks * stride + this->chunk_fill, data.data, n);
+			data.data += n;
+			data.size -= n;
+			this->chunk_fill += n;
+			if (this->chunk_fill < stride)
+				continue;
+			this->chunk_fill = 0;
+			if (++this->chunks == this->chunks_per_segment)
+				this->write_output(false);
+		}
+	}
+	// The input also looks like it ended if the pipeline is being stopped.
+	this->throw_on_termination();
+	// A stream that ends in a full chunk has lost its last one.
+	if (this->chunk_fill < crypto_tag_size)
+		throw ArchiveReadException("Invalid data: Encrypted data is truncated");
+	this->write_output(true);
+	Segment eof(SegmentType::Eof);
+	this->write(eof);
+}
+
+template <typename T>
+void ChunkedCryptoSource<T>::write_output(bool last){
+	const auto stride = this->chunk_size + crypto_tag_size;
+	auto base = this->output.get_data().data;
+	auto full_chunks = this->chunks;
+	auto chunk_size = this->chunk_size;
+	auto last_size = last ? this->chunk_fill - crypto_tag_size : 0;
+	auto tasks = this->ciphers.run(full_chunks + last, this->next_chunk, [=](cipher_t &cipher, size_t i, const std::uint8_t *nonce){
+		auto chunk = base + i * stride;
+		auto size = i < full_chunks ? chunk_size : last_size;
+		std::uint8_t is_last = i == full_chunks;
+		if (!cipher.DecryptAndVerify(chunk, chunk + size, crypto_tag_size, nonce, crypto_nonce_size, &is_last, 1, chunk, size))
+			throw ArchiveReadException("Invalid data: Encrypted data failed authentication");
+	});
+	this->max_tasks = std::max(this->max_tasks, tasks);
+	// Close the gaps left by the tags.
+	for (size_t i = 1; i < full_chunks + last; i++)
+		memmove(base + i * chunk_size, base + i * stride, i < full_chunks ? chunk_size : last_size);
+	this->output.trim_to_size(full_chunks * chunk_size + last_size);
+	this->write(this->output);
+	this->output = Segment();
+	this->next_chunk += full_chunks + last;
+	this->chunks = 0;
+	this->chunk_fill = 0;
+}
+
+Stream<CryptoSource> CryptoSource::create_chunked(
+		CryptoMode mode,
+		Source &stream,
+		const CryptoPP::SecByteBlock *key,
+		const CryptoPP::SecByteBlock *iv,
+		size_t chunk_size,
+		std::uint64_t first_chunk){
+	switch (mode){
+		case CryptoMode::AesGcm:
+			return Stream<ChunkedCryptoSource<CryptoPP::GCM<CryptoPP::AES>>>(stream, *key, *iv, chunk_size, first_chunk);
+	}
+	zekvok_assert(false);
+	return Stream<ChunkedCryptoSource<CryptoPP::GCM<CryptoPP::AES>>>();
+}
+
+}
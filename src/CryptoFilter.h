@@ -1,63 +1,101 @@
-/*
-Copyright (c), Helios
-All rights reserved.
-
-Distributed under a permissive license. See COPYING.txt for details.
-*/
-
-#pragma once
-
-#include "Filters.h"
-#include "StreamProcessor.h"
-
-enum class Algorithm{
-	Rijndael,
-	Twofish,
-	Serpent,
-};
-
-namespace zstreams{
-
-class CryptoSink : public Sink{
-protected:
-	bool flushed;
-	virtual CryptoPP::StreamTransformationFilter *get_filter() = 0;
-	CryptoSink(Sink &stream):
-		Sink(stream),
-		flushed(false){}
-	void work() override;
-	void flush_impl() override;
-	void flush_filter(CryptoPP::StreamTransformationFilter *);
-public:
-	virtual ~CryptoSink(){}
-	static Stream<CryptoSink> create(
-		Algorithm algo,
-		Sink &stream,
-		const CryptoPP::SecByteBlock *key,
-		const CryptoPP::SecByteBlock *iv
-	);
-	const char *class_name() const override{
-		return "CryptoOutputStream";
-	}
-};
-
-class CryptoSource : public Source{
-protected:
-	virtual CryptoPP::StreamTransformationFilter *get_filter() = 0;
-	CryptoSource(Source &stream): Source(stream){}
-	void work() override;
-	IGNORE_FLUSH_COMMAND
-public:
-	virtual ~CryptoSource(){}
-	static Stream<CryptoSource> create(
-		Algorithm algo,
-		Source &stream,
-		const CryptoPP::SecByteBlock *key,
-		const CryptoPP::SecByteBlock *iv
-	);
-	const char *class_name() const override{
-		return "CryptoInputStream";
-	}
-};
-
-}
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#include "Filters.h"
+#include "StreamProcessor.h"
+
+enum class Algorithm{
+	Rijndael,
+	Twofish,
+	Serpent,
+};
+
+enum class CryptoMode{
+	// The whole stream is a single CBC message, encrypted with one of the
+	// Algorithms. Archives that don't record a mode use it.
+	Cbc,
+	// The stream is split into chunks that are encrypted and authenticated
+	// with AES-GCM independently of each other, so that several threads can
+	// work on them at once and decryption can start at any chunk.
+	AesGcm,
+	Count,
+};
+
+// Plaintext bytes per chunk written in the chunked modes. With its tag, each
+// chunk takes 64 KiB.
+extern const size_t default_crypto_chunk_size;
+extern const size_t crypto_tag_size;
+// The largest chunk that fits in a segment along with its tag. Archives that
+// claim bigger chunks can't be read.
+extern const size_t max_crypto_chunk_size;
+
+namespace zstreams{
+
+class CryptoSink : public Sink{
+protected:
+	CryptoSink(Sink &stream): Sink(stream){}
+	void report_cpu_usage() override{
+		this->record_cpu_time(CpuStage::Encryption);
+	}
+public:
+	virtual ~CryptoSink(){}
+	static Stream<CryptoSink> create(
+		Algorithm algo,
+		Sink &stream,
+		const CryptoPP::SecByteBlock *key,
+		const CryptoPP::SecByteBlock *iv
+	);
+	// In the chunked modes, the algorithm is ignored. Each chunk is
+	// default_crypto_chunk_size bytes of plaintext followed by a tag of
+	// crypto_tag_size bytes, except for the last one, which is always
+	// shorter (possibly just a tag), so that truncation can be detected.
+	static Stream<CryptoSink> create(
+		CryptoMode mode,
+		Algorithm algo,
+		Sink &stream,
+		const CryptoPP::SecByteBlock *key,
+		const CryptoPP::SecByteBlock *iv
+	);
+	const char *class_name() const override{
+		return "CryptoOutputStream";
+	}
+};
+
+class CryptoSource : public Source{
+protected:
+	CryptoSource(Source &stream): Source(stream){}
+	void report_cpu_usage() override{
+		this->record_cpu_time(CpuStage::Encryption);
+	}
+	IGNORE_FLUSH_COMMAND
+public:
+	virtual ~CryptoSource(){}
+	static Stream<CryptoSource> create(
+		Algorithm algo,
+		Source &stream,
+		const CryptoPP::SecByteBlock *key,
+		const CryptoPP::SecByteBlock *iv
+	);
+	// Decrypts a stream written by CryptoSink in a chunked mode, starting
+	// from the chunk numbered first_chunk, which the source must be
+	// positioned at. The source must end where the encrypted stream does.
+	static Stream<CryptoSource> create_chunked(
+		CryptoMode mode,
+		Source &stream,
+		const CryptoPP::SecByteBlock *key,
+		const CryptoPP::SecByteBlock *iv,
+		size_t chunk_size,
+		std::uint64_t first_chunk
+	);
+	const char *class_name() const override{
+		return "CryptoInputStream";
+	}
+};
+
+}
@@ -1,11 +1,11 @@
-/*
-Copyright (c), Helios
-All rights reserved.
-
-Distributed under a permissive license. See COPYING.txt for details.
-*/
-
-#include "stdafx.h"
-#include "Globals.h"
-
-std::unique_ptr<CryptoPP::AutoSeededRandomPool> random_number_generator;
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "Globals.h"
+
+std::unique_ptr<CryptoPP::AutoSeededRandomPool> random_number_generator;
@@ -1,68 +1,89 @@
-/*
-Copyright (c), Helios
-All rights reserved.
-
-Distributed under a permissive license. See COPYING.txt for details.
-*/
-
-#pragma once
-
-#include "Utility.h"
-#include "SimpleTypes.h"
-
-class BackupSystem;
-
-class LineProcessor{
-	std::vector<std::string> args;
-	std::set<std::string, strcmpci> argument_set;
-	enum class OperationMode{
-		User,
-		Pipe,
-	};
-	OperationMode operation_mode;
-	std::weak_unique_ptr<BackupSystem> backup_system;
-	version_number_t selected_version;
-
-	void ensure_backup_initialized();
-	void ensure_existing_version();
-
-#define DECLARE_PROCESS_OVERLOAD(x) void process_##x(const std::wstring *begin, const std::wstring *end)
-	DECLARE_PROCESS_OVERLOAD(line);
-	DECLARE_PROCESS_OVERLOAD(open);
-	DECLARE_PROCESS_OVERLOAD(add);
-	DECLARE_PROCESS_OVERLOAD(exclude);
-	DECLARE_PROCESS_OVERLOAD(backup);
-	DECLARE_PROCESS_OVERLOAD(restore);
-	DECLARE_PROCESS_OVERLOAD(select);
-	DECLARE_PROCESS_OVERLOAD(show);
-	DECLARE_PROCESS_OVERLOAD(if);
-	DECLARE_PROCESS_OVERLOAD(set);
-	DECLARE_PROCESS_OVERLOAD(verify);
-	DECLARE_PROCESS_OVERLOAD(generate);
-
-#define DECLARE_PROCESS_EXCLUDE_OVERLOAD(x) DECLARE_PROCESS_OVERLOAD(exclude_##x)
-	DECLARE_PROCESS_EXCLUDE_OVERLOAD(extension);
-	DECLARE_PROCESS_EXCLUDE_OVERLOAD(path);
-	DECLARE_PROCESS_EXCLUDE_OVERLOAD(name);
-	
-#define DECLARE_PROCESS_SELECT_OVERLOAD(x) DECLARE_PROCESS_OVERLOAD(select_##x)
-	DECLARE_PROCESS_SELECT_OVERLOAD(version);
-	DECLARE_PROCESS_SELECT_OVERLOAD(keypair);
-
-#define DECLARE_PROCESS_SHOW_OVERLOAD(x) DECLARE_PROCESS_OVERLOAD(show_##x)
-	DECLARE_PROCESS_SHOW_OVERLOAD(dependencies);
-	DECLARE_PROCESS_SHOW_OVERLOAD(versions);
-	DECLARE_PROCESS_SHOW_OVERLOAD(version_count);
-	DECLARE_PROCESS_SHOW_OVERLOAD(paths);
-	DECLARE_PROCESS_SHOW_OVERLOAD(version_summary);
-
-#define DECLARE_PROCESS_SET_OVERLOAD(x) DECLARE_PROCESS_OVERLOAD(set_##x)
-	DECLARE_PROCESS_SET_OVERLOAD(use_snapshots);
-	DECLARE_PROCESS_SET_OVERLOAD(change_criterium);
-
-#define DECLARE_PROCESS_GENERATE_OVERLOAD(x) DECLARE_PROCESS_OVERLOAD(generate_##x)
-	DECLARE_PROCESS_GENERATE_OVERLOAD(keypair);
-public:
-	LineProcessor(int argc, char **argv);
-	void process();
-};
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#include "Utility.h"
+#include "SimpleTypes.h"
+
+class BackupSystem;
+
+class LineProcessor{
+	std::vector<std::string> args;
+	std::set<std::string, strcmpci> argument_set;
+	enum class OperationMode{
+		User,
+		Pipe,
+	};
+	OperationMode operation_mode;
+	std::weak_unique_ptr<BackupSystem> backup_system;
+	version_number_t selected_version;
+
+	void ensure_backup_initialized();
+	void ensure_existing_version();
+
+#define DECLARE_PROCESS_OVERLOAD(x) void process_##x(const std::wstring *begin, const std::wstring *end)
+	DECLARE_PROCESS_OVERLOAD(line);
+	DECLARE_PROCESS_OVERLOAD(open);
+	DECLARE_PROCESS_OVERLOAD(add);
+	DECLARE_PROCESS_OVERLOAD(exclude);
+	DECLARE_PROCESS_OVERLOAD(backup);
+	DECLARE_PROCESS_OVERLOAD(restore);
+	DECLARE_PROCESS_OVERLOAD(select);
+	DECLARE_PROCESS_OVERLOAD(show);
+	DECLARE_PROCESS_OVERLOAD(if);
+	DECLARE_PROCESS_OVERLOAD(set);
+	DECLARE_PROCESS_OVERLOAD(verify);
+	DECLARE_PROCESS_OVERLOAD(generate);
+	DECLARE_PROCESS_OVERLOAD(benchmark);
+	DECLARE_PROCESS_OVERLOAD(recompress);
+	DECLARE_PROCESS_OVERLOAD(autotune);
+
+#define DECLARE_PROCESS_EXCLUDE_OVERLOAD(x) DECLARE_PROCESS_OVERLOAD(exclude_##x)
+	DECLARE_PROCESS_EXCLUDE_OVERLOAD(extension);
+	DECLARE_PROCESS_EXCLUDE_OVERLOAD(path);
+	DECLARE_PROCESS_EXCLUDE_OVERLOAD(name);
+	
+#define DECLARE_PROCESS_SELECT_OVERLOAD(x) DECLARE_PROCESS_OVERLOAD(select_##x)
+	DECLARE_PROCESS_SELECT_OVERLOAD(version);
+	DECLARE_PROCESS_SELECT_OVERLOAD(keypair);
+
+#define DECLARE_PROCESS_SHOW_OVERLOAD(x) DECLARE_PROCESS_OVERLOAD(show_##x)
+	DECLARE_PROCESS_SHOW_OVERLOAD(dependencies);
+	DECLARE_PROCESS_SHOW_OVERLOAD(versions);
+	DECLARE_PROCESS_SHOW_OVERLOAD(version_count);
+	DECLARE_PROCESS_SHOW_OVERLOAD(paths);
+	DECLARE_PROCESS_SHOW_OVERLOAD(version_summary);
+
+#define DECLARE_PROCESS_SET_OVERLOAD(x) DECLARE_PROCESS_OVERLOAD(set_##x)
+	DECLARE_PROCESS_SET_OVERLOAD(use_snapshots);
+	DECLARE_PROCESS_SET_OVERLOAD(change_criterium);
+	DECLARE_PROCESS_SET_OVERLOAD(large_pages);
+	DECLARE_PROCESS_SET_OVERLOAD(memory_limit);
+	DECLARE_PROCESS_SET_OVERLOAD(block_size);
+	DECLARE_PROCESS_SET_OVERLOAD(file_data_codec);
+	DECLARE_PROCESS_SET_OVERLOAD(base_objects_codec);
+	DECLARE_PROCESS_SET_OVERLOAD(store_incompressible);
+	DECLARE_PROCESS_SET_OVERLOAD(similarity_ordering);
+	DECLARE_PROCESS_SET_OVERLOAD(dictionary_priming);
+	DECLARE_PROCESS_SET_OVERLOAD(encryption_mode);
+	DECLARE_PROCESS_SET_OVERLOAD(hashing_threads);
+	DECLARE_PROCESS_SET_OVERLOAD(max_threads);
+	DECLARE_PROCESS_SET_OVERLOAD(priority);
+
+#define DECLARE_PROCESS_GENERATE_OVERLOAD(x) DECLARE_PROCESS_OVERLOAD(generate_##x)
+	DECLARE_PROCESS_GENERATE_OVERLOAD(keypair);
+
+#define DECLARE_PROCESS_BENCHMARK_OVERLOAD(x) DECLARE_PROCESS_OVERLOAD(benchmark_##x)
+	DECLARE_PROCESS_BENCHMARK_OVERLOAD(queue);
+	DECLARE_PROCESS_BENCHMARK_OVERLOAD(tiny_files);
+	DECLARE_PROCESS_BENCHMARK_OVERLOAD(ordering);
+	DECLARE_PROCESS_BENCHMARK_OVERLOAD(hashing);
+public:
+	LineProcessor(int argc, char **argv);
+	void process();
+};
@@ -1,260 +1,398 @@
-/*
-Copyright (c), Helios
-All rights reserved.
-
-Distributed under a permissive license. See COPYING.txt for details.
-*/
-
-#include "stdafx.h"
-#include "LzmaFilter.h"
-#include "Utility.h"
-#include "Exception.h"
-
-namespace zstreams{
-
-LzmaSink::LzmaSink(Sink &stream, bool *multithreaded, int compression_level, bool extreme_mode):
-	Sink(stream){
-	zero_struct(this->lstream);
-	this->lstream = LZMA_STREAM_INIT;
-
-	auto f = !*multithreaded ? &LzmaSink::initialize_single_threaded : &LzmaSink::initialize_multithreaded;
-	*multithreaded = (this->*f)(compression_level, extreme_mode);
-
-	this->action = LZMA_RUN;
-	this->reset_segment();
-}
-
-LzmaSink::~LzmaSink(){
-	StreamProcessor::stop();
-	lzma_end(&this->lstream);
-}
-
-void LzmaSink::reset_segment(){
-	this->output_segment = this->pipeline->allocate_segment();
-	auto data = this->output_segment.get_data();
-	this->lstream.next_out = data.data;
-	this->lstream.avail_out = data.size;
-}
-
-bool LzmaSink::initialize_single_threaded(int compression_level, bool extreme_mode){
-	uint32_t preset = compression_level;
-	if (extreme_mode)
-		preset |= LZMA_PRESET_EXTREME;
-	lzma_ret ret = lzma_easy_encoder(&this->lstream, preset, LZMA_CHECK_NONE);
-	if (ret != LZMA_OK){
-		const char *msg;
-		switch (ret) {
-			case LZMA_MEM_ERROR:
-				msg = "Memory allocation failed.";
-				break;
-			case LZMA_OPTIONS_ERROR:
-				msg = "Specified compression level is not supported.";
-				break;
-			case LZMA_UNSUPPORTED_CHECK:
-				msg = "Specified integrity check is not supported.";
-				break;
-			default:
-				msg = "Unknown error.";
-				break;
-		}
-		throw LzmaInitializationException(msg);
-	}
-	return false;
-}
-
-bool LzmaSink::initialize_multithreaded(int compression_level, bool extreme_mode){
-	lzma_mt mt;
-	zero_struct(mt);
-	mt.flags = 0;
-	mt.block_size = 0;
-	mt.timeout = 0;
-	mt.preset = compression_level;
-	if (extreme_mode)
-		mt.preset |= LZMA_PRESET_EXTREME;
-	mt.filters = 0;
-	mt.check = LZMA_CHECK_NONE;
-	mt.threads = lzma_cputhreads();
-	if (!mt.threads){
-		this->initialize_single_threaded(compression_level, extreme_mode);
-		return false;
-	}
-
-	mt.threads = std::max(mt.threads, 4U);
-
-	lzma_ret ret = lzma_stream_encoder_mt(&this->lstream, &mt);
-
-	if (ret != LZMA_OK){
-		const char *msg;
-		switch (ret) {
-			case LZMA_MEM_ERROR:
-				msg = "Memory allocation failed.";
-				break;
-			case LZMA_OPTIONS_ERROR:
-				msg = "Specified filter chain or compression level is not supported.";
-				break;
-			case LZMA_UNSUPPORTED_CHECK:
-				msg = "Specified integrity check is not supported.";
-				break;
-			default:
-				msg = "Unknown error.";
-				break;
-		}
-		throw LzmaInitializationException(msg);
-	}
-	return true;
-}
-
-bool LzmaSink::pass_data_to_stream(lzma_ret ret){
-	if (!this->lstream.avail_out || ret == LZMA_STREAM_END) {
-		size_t write_size = this->output_segment.get_data().size - this->lstream.avail_out;
-		this->output_segment.trim_to_size(write_size);
-		this->write(this->output_segment);
-		this->reset_segment();
-	}
-
-	if (ret != LZMA_OK){
-		if (ret != LZMA_STREAM_END){
-			const char *msg;
-			switch (ret) {
-				case LZMA_MEM_ERROR:
-					msg = "Memory allocation failed.";
-					break;
-				case LZMA_DATA_ERROR:
-					msg = "File size limits exceeded.";
-					break;
-				default:
-					msg = "Unknown error.";
-					break;
-			}
-			throw LzmaOperationException(msg);
-		}
-		return false;
-	}
-	return true;
-}
-
-void LzmaSink::flush_impl(){
-	if (this->action != LZMA_RUN)
-		return;
-	this->action = LZMA_FINISH;
-	while (this->pass_data_to_stream(lzma_code(&this->lstream, this->action)));
-	Segment eof(SegmentType::Eof);
-	this->write(eof);
-}
-
-void LzmaSink::work(){
-	lzma_ret lret = LZMA_OK;
-	Segment segment;
-	do{
-		if (this->lstream.avail_in == 0){
-			segment = this->read();
-			if (segment.get_type() == SegmentType::Eof){
-				break;
-			}
-			auto data = segment.get_data();
-			if (!data.size)
-				continue;
-			this->lstream.next_in = static_cast<const uint8_t *>(data.data);
-			this->lstream.avail_in = data.size;
-		}
-		lret = lzma_code(&this->lstream, this->action);
-
-	}while (this->pass_data_to_stream(lret));
-	this->flush_impl();
-}
-
-LzmaSource::LzmaSource(Source &stream):
-		Source(stream){
-	zero_struct(this->lstream);
-
-	this->lstream = LZMA_STREAM_INIT;
-	lzma_ret ret = lzma_stream_decoder(&this->lstream, UINT64_MAX, LZMA_IGNORE_CHECK);
-	if (ret != LZMA_OK){
-		const char *msg;
-		switch (ret) {
-			case LZMA_MEM_ERROR:
-				msg = "Memory allocation failed.\n";
-				break;
-			case LZMA_OPTIONS_ERROR:
-				msg = "Unsupported decompressor flags.\n";
-				break;
-			default:
-				msg = "Unknown error.\n";
-				break;
-		}
-		throw LzmaInitializationException(msg);
-	}
-	this->action = LZMA_RUN;
-}
-
-LzmaSource::~LzmaSource(){
-	StreamProcessor::stop();
-	lzma_end(&this->lstream);
-}
-
-void LzmaSource::work(){
-	Segment in_segment;
-	Segment out_segment;
-	while (true){
-		if (this->lstream.avail_in == 0 && !this->at_eof){
-			in_segment = this->read();
-			if (in_segment.get_type() == SegmentType::Eof){
-				this->at_eof = true;
-				this->action = LZMA_FINISH;
-			}else{
-				auto data = in_segment.get_data();
-				if (!data.size)
-					continue;
-				this->lstream.next_in = static_cast<const uint8_t *>(data.data);
-				this->lstream.avail_in = data.size;
-			}
-		}
-
-		if (!this->lstream.avail_out){
-			if (!!out_segment)
-				this->write(out_segment);
-			out_segment = this->pipeline->allocate_segment();
-			auto data = out_segment.get_data();
-			this->lstream.next_out = data.data;
-			this->lstream.avail_out = data.size;
-		}
-
-		auto ret_code = lzma_code(&this->lstream, this->action);
-
-		if (ret_code != LZMA_OK){
-			if (ret_code == LZMA_STREAM_END)
-				break;
-			const char *msg;
-			switch (ret_code){
-				case LZMA_MEM_ERROR:
-					msg = "Memory allocation failed.";
-					break;
-				case LZMA_FORMAT_ERROR:
-					msg = "The input is not in the .xz format.";
-					break;
-				case LZMA_OPTIONS_ERROR:
-					msg = "Unsupported compression options.";
-					break;
-				case LZMA_DATA_ERROR:
-					msg = "Compressed file is corrupt.";
-					break;
-				case LZMA_BUF_ERROR:
-					msg = "Compressed file is truncated or otherwise corrupt.";
-					break;
-				default:
-					msg = "Unknown error.";
-					break;
-			}
-			throw LzmaOperationException(msg);
-		}
-	}
-	if (!!out_segment){
-		auto data = out_segment.get_data();
-		out_segment.trim_to_size(data.size - this->lstream.avail_out);
-		this->write(out_segment);
-	}
-	Segment eof(SegmentType::Eof);
-	this->write(eof);
-}
-
-}
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "LzmaFilter.h"
+#include "Utility.h"
+#include "Exception.h"
+
+namespace zstreams{
+
+LzmaSink::LzmaSink(Sink &stream, bool *multithreaded, int compression_level, bool extreme_mode, ContentFilter filter):
+		CompressorSink(stream),
+		multithreaded(*multithreaded),
+		compression_level(compression_level),
+		extreme_mode(extreme_mode),
+		filter(filter){
+	zero_struct(this->lstream);
+	this->lstream = LZMA_STREAM_INIT;
+
+	this->initialize();
+	*multithreaded = this->multithreaded;
+
+	this->reset_segment();
+}
+
+LzmaSink::~LzmaSink(){
+	StreamProcessor::stop();
+	lzma_end(&this->lstream);
+}
+
+void LzmaSink::reset_segment(){
+	this->output_segment = this->allocate_segment();
+	auto data = this->output_segment.get_data();
+	this->lstream.next_out = data.data;
+	this->lstream.avail_out = data.size;
+}
+
+void LzmaSink::initialize(){
+	auto f = !this->multithreaded ? &LzmaSink::initialize_single_threaded : &LzmaSink::initialize_multithreaded;
+	this->multithreaded = (this->*f)(this->compression_level, this->extreme_mode);
+}
+
+struct LzmaFilterChain{
+	lzma_options_lzma lzma;
+	lzma_options_delta delta;
+	lzma_filter filters[3];
+};
+
+// Returns false if nothing goes before LZMA2, in which case the preset can be
+// used as is.
+static bool build_filter_chain(LzmaFilterChain &chain, ContentFilter filter, uint32_t preset){
+	size_t n = 0;
+	switch (filter){
+		case ContentFilter::X86:
+			chain.filters[n++] = { LZMA_FILTER_X86, nullptr };
+			break;
+#ifdef LZMA_FILTER_ARM64
+		case ContentFilter::Arm64:
+			chain.filters[n++] = { LZMA_FILTER_ARM64, nullptr };
+			break;
+#endif
+		case ContentFilter::Delta2:
+		case ContentFilter::Delta3:
+		case ContentFilter::Delta4:
+			zero_struct(chain.delta);
+			chain.delta.type = LZMA_DELTA_TYPE_BYTE;
+			chain.delta.dist = 2 + ((int)filter - (int)ContentFilter::Delta2);
+			chain.filters[n++] = { LZMA_FILTER_DELTA, &chain.delta };
+			break;
+		default:
+			return false;
+	}
+	if (lzma_lzma_preset(&chain.lzma, preset))
+		throw LzmaInitializationException("Specified compression level is not supported.");
+	chain.filters[n++] = { LZMA_FILTER_LZMA2, &chain.lzma };
+	chain.filters[n] = { LZMA_VLI_UNKNOWN, nullptr };
+	return true;
+}
+
+bool LzmaSink::initialize_single_threaded(int compression_level, bool extreme_mode){
+	uint32_t preset = compression_level;
+	if (extreme_mode)
+		preset |= LZMA_PRESET_EXTREME;
+	LzmaFilterChain chain;
+	lzma_ret ret;
+	if (build_filter_chain(chain, this->filter, preset))
+		ret = lzma_stream_encoder(&this->lstream, chain.filters, LZMA_CHECK_NONE);
+	else
+		ret = lzma_easy_encoder(&this->lstream, preset, LZMA_CHECK_NONE);
+	if (ret != LZMA_OK){
+		const char *msg;
+		switch (ret) {
+			case LZMA_MEM_ERROR:
+				msg = "Memory allocation failed.";
+				break;
+			case LZMA_OPTIONS_ERROR:
+				msg = "Specified compression level is not supported.";
+				break;
+			case LZMA_UNSUPPORTED_CHECK:
+				msg = "Specified integrity check is not supported.";
+				break;
+			default:
+				msg = "Unknown error.";
+				break;
+		}
+		throw LzmaInitializationException(msg);
+	}
+	return false;
+}
+
+bool LzmaSink::initialize_multithreaded(int compression_level, bool extreme_mode){
+	lzma_mt mt;
+	zero_struct(mt);
+	mt.flags = 0;
+	mt.block_size = 0;
+	mt.timeout = 0;
+	mt.preset = compression_level;
+	if (extreme_mode)
+		mt.preset |= LZMA_PRESET_EXTREME;
+	mt.filters = 0;
+	LzmaFilterChain chain;
+	if (build_filter_chain(chain, this->filter, mt.preset))
+		mt.filters = chain.filters;
+	mt.check = LZMA_CHECK_NONE;
+	mt.threads = this->acquire_threads();
+	if (!mt.threads){
+		this->initialize_single_threaded(compression_level, extreme_mode);
+		return false;
+	}
+
+	// Each encoder thread needs its own dictionary and block buffers, so keep
+	// the encoder within half of the memory limit, if there is one.
+	auto limit = buffer_pool->get_memory_limit();
+	if (limit){
+		while (mt.threads > 1 && lzma_stream_encoder_mt_memusage(&mt) > limit / 2)
+			mt.threads--;
+		this->release_threads(this->acquire_threads() - mt.threads);
+		if (lzma_stream_encoder_mt_memusage(&mt) > limit / 2){
+			this->release_threads(mt.threads);
+			this->initialize_single_threaded(compression_level, extreme_mode);
+			return false;
+		}
+	}
+
+	lzma_ret ret = lzma_stream_encoder_mt(&this->lstream, &mt);
+
+	if (ret != LZMA_OK){
+		const char *msg;
+		switch (ret) {
+			case LZMA_MEM_ERROR:
+				msg = "Memory allocation failed.";
+				break;
+			case LZMA_OPTIONS_ERROR:
+				msg = "Specified filter chain or compression level is not supported.";
+				break;
+			case LZMA_UNSUPPORTED_CHECK:
+				msg = "Specified integrity check is not supported.";
+				break;
+			default:
+				msg = "Unknown error.";
+				break;
+		}
+		throw LzmaInitializationException(msg);
+	}
+	return true;
+}
+
+bool LzmaSink::pass_data_to_stream(lzma_ret ret){
+	if (!this->lstream.avail_out || ret == LZMA_STREAM_END) {
+		size_t write_size = this->output_segment.get_data().size - this->lstream.avail_out;
+		this->output_segment.trim_to_size(write_size);
+		this->write_output(this->output_segment);
+		this->reset_segment();
+	}
+
+	if (ret != LZMA_OK){
+		if (ret != LZMA_STREAM_END){
+			const char *msg;
+			switch (ret) {
+				case LZMA_MEM_ERROR:
+					msg = "Memory allocation failed.";
+					break;
+				case LZMA_DATA_ERROR:
+					msg = "File size limits exceeded.";
+					break;
+				default:
+					msg = "Unknown error.";
+					break;
+			}
+			throw LzmaOperationException(msg);
+		}
+		return false;
+	}
+	return true;
+}
+
+void LzmaSink::begin_block(){
+	this->initialize();
+}
+
+void LzmaSink::compress(const std::uint8_t *&input, size_t &size){
+	this->lstream.next_in = input;
+	this->lstream.avail_in = size;
+	auto ret = lzma_code(&this->lstream, LZMA_RUN);
+	input = this->lstream.next_in;
+	size = this->lstream.avail_in;
+	this->pass_data_to_stream(ret);
+}
+
+void LzmaSink::end_block(){
+	this->lstream.avail_in = 0;
+	while (this->pass_data_to_stream(lzma_code(&this->lstream, LZMA_FINISH)));
+}
+
+static void initialize_decoder(lzma_stream &stream){
+	stream = LZMA_STREAM_INIT;
+	lzma_ret ret = lzma_stream_decoder(&stream, UINT64_MAX, LZMA_IGNORE_CHECK | LZMA_CONCATENATED);
+	if (ret != LZMA_OK){
+		const char *msg;
+		switch (ret) {
+			case LZMA_MEM_ERROR:
+				msg = "Memory allocation failed.\n";
+				break;
+			case LZMA_OPTIONS_ERROR:
+				msg = "Unsupported decompressor flags.\n";
+				break;
+			default:
+				msg = "Unknown error.\n";
+				break;
+		}
+		throw LzmaInitializationException(msg);
+	}
+}
+
+static void check_decoder_result(lzma_ret ret_code){
+	if (ret_code == LZMA_OK || ret_code == LZMA_STREAM_END)
+		return;
+	const char *msg;
+	switch (ret_code){
+		case LZMA_MEM_ERROR:
+			msg = "Memory allocation failed.";
+			break;
+		case LZMA_FORMAT_ERROR:
+			msg = "The input is not in the .xz format.";
+			break;
+		case LZMA_OPTIONS_ERROR:
+			msg = "Unsupported compression options.";
+			break;
+		case LZMA_DATA_ERROR:
+			msg = "Compressed file is corrupt.";
+			break;
+		case LZMA_BUF_ERROR:
+			msg = "Compressed file is truncated or otherwise corrupt.";
+			break;
+		default:
+			msg = "Unknown error.";
+			break;
+	}
+	throw LzmaOperationException(msg);
+}
+
+LzmaSource::LzmaSource(Source &stream, const std::vector<std::uint64_t> &block_sizes, std::uint64_t max_block_output):
+		DecompressorSource(stream, block_sizes, max_block_output){
+	zero_struct(this->lstream);
+	initialize_decoder(this->lstream);
+	this->action = LZMA_RUN;
+}
+
+LzmaSource::~LzmaSource(){
+	StreamProcessor::stop();
+	lzma_end(&this->lstream);
+}
+
+void LzmaSource::work_sequential(){
+	Segment in_segment;
+	Segment out_segment;
+	while (true){
+		if (this->lstream.avail_in == 0 && !this->at_eof){
+			in_segment = this->read();
+			if (in_segment.get_type() == SegmentType::Eof){
+				this->at_eof = true;
+				this->action = LZMA_FINISH;
+			}else{
+				auto data = in_segment.get_data();
+				if (!data.size)
+					continue;
+				this->lstream.next_in = static_cast<const uint8_t *>(data.data);
+				this->lstream.avail_in = data.size;
+			}
+		}
+
+		if (!this->lstream.avail_out){
+			if (!!out_segment)
+				this->write(out_segment);
+			out_segment = this->allocate_segment();
+			auto data = out_segment.get_data();
+			this->lstream.next_out = data.data;
+			this->lstream.avail_out = data.size;
+		}
+
+		auto ret_code = lzma_code(&this->lstream, this->action);
+		if (ret_code == LZMA_STREAM_END)
+			break;
+		check_decoder_result(ret_code);
+	}
+	if (!!out_segment){
+		auto data = out_segment.get_data();
+		out_segment.trim_to_size(data.size - this->lstream.avail_out);
+		this->write(out_segment);
+	}
+	Segment eof(SegmentType::Eof);
+	this->write(eof);
+}
+
+void LzmaSource::decode_block(const std::vector<Segment> &input, DecodedBlock &output){
+	lzma_stream stream;
+	zero_struct(stream);
+	initialize_decoder(stream);
+	std::shared_ptr<lzma_stream> end(&stream, lzma_end);
+	lzma_action action = LZMA_RUN;
+	size_t next_input = 0;
+	Segment out_segment;
+	while (!output.is_cancelled()){
+		if (!stream.avail_in){
+			if (next_input < input.size()){
+				auto data = input[next_input++].get_data();
+				stream.next_in = data.data;
+				stream.avail_in = data.size;
+			}else
+				action = LZMA_FINISH;
+		}
+		if (!stream.avail_out){
+			if (!!out_segment)
+				output.push(std::move(out_segment));
+			out_segment = this->allocate_segment();
+			auto data = out_segment.get_data();
+			stream.next_out = data.data;
+			stream.avail_out = data.size;
+		}
+		auto ret_code = lzma_code(&stream, action);
+		if (ret_code == LZMA_STREAM_END)
+			break;
+		check_decoder_result(ret_code);
+	}
+	if (!!out_segment){
+		out_segment.trim_to_size(out_segment.get_data().size - stream.avail_out);
+		output.push(std::move(out_segment));
+	}
+}
+
+// Raw LZMA2 streams don't record the size of their dictionary, so both sides
+// derive it from the sizes of the data and of the preset dictionary.
+static void set_dictionary_options(lzma_options_lzma &options, const buffer_t &dictionary, std::uint64_t size){
+	options.preset_dict = dictionary.size() ? &dictionary[0] : nullptr;
+	options.preset_dict_size = (uint32_t)dictionary.size();
+	options.dict_size = (uint32_t)std::max<std::uint64_t>(dictionary.size() + size, LZMA_DICT_SIZE_MIN);
+}
+
+buffer_t lzma_compress_with_dictionary(int preset, const buffer_t &data, const buffer_t &dictionary){
+	lzma_options_lzma options;
+	if (lzma_lzma_preset(&options, preset))
+		throw LzmaInitializationException("Specified compression level is not supported.");
+	set_dictionary_options(options, dictionary, data.size());
+	lzma_filter filters[] = {
+		{ LZMA_FILTER_LZMA2, &options },
+		{ LZMA_VLI_UNKNOWN, nullptr },
+	};
+	buffer_t ret(lzma_stream_buffer_bound(data.size()));
+	size_t size = 0;
+	auto result = lzma_raw_buffer_encode(filters, nullptr, data.size() ? &data[0] : nullptr, data.size(), &ret[0], &size, ret.size());
+	if (result != LZMA_OK)
+		throw LzmaOperationException("Compression with a dictionary failed.");
+	ret.resize(size);
+	return ret;
+}
+
+buffer_t lzma_decompress_with_dictionary(const buffer_t &data, std::uint64_t size, const buffer_t &dictionary){
+	lzma_options_lzma options;
+	zero_struct(options);
+	set_dictionary_options(options, dictionary, size);
+	lzma_filter filters[] = {
+		{ LZMA_FILTER_LZMA2, &options },
+		{ LZMA_VLI_UNKNOWN, nullptr },
+	};
+	buffer_t ret((size_t)size);
+	size_t in_pos = 0,
+		out_pos = 0;
+	auto result = lzma_raw_buffer_decode(filters, nullptr, data.size() ? &data[0] : nullptr, &in_pos, data.size(), ret.size() ? &ret[0] : nullptr, &out_pos, ret.size());
+	if (result != LZMA_OK || out_pos != ret.size())
+		throw LzmaOperationException("Invalid data: A file compressed with a dictionary could not be decoded.");
+	return ret;
+}
+
+}
@@ -1,48 +1,61 @@
-/*
-Copyright (c), Helios
-All rights reserved.
-
-Distributed under a permissive license. See COPYING.txt for details.
-*/
-
-#pragma once
-
-#include "Filters.h"
-#include "StreamProcessor.h"
-
-namespace zstreams{
-	
-class LzmaSink : public Sink{
-	lzma_stream lstream;
-	lzma_action action = LZMA_RUN;
-	Segment output_segment;
-
-	void reset_segment();
-	bool initialize_single_threaded(int, bool);
-	bool initialize_multithreaded(int, bool);
-	bool pass_data_to_stream(lzma_ret ret);
-	void flush_impl() override;
-	void work() override;
-public:
-	LzmaSink(Sink &stream, bool *multithreaded, int compression_level = 7, bool extreme_mode = false);
-	~LzmaSink();
-	const char *class_name() const override{
-		return "LzmaOutputStream";
-	}
-};
-
-class LzmaSource : public Source{
-	lzma_stream lstream;
-	lzma_action action = LZMA_RUN;
-	bool at_eof = false;
-
-	void work() override;
-public:
-	LzmaSource(Source &wrapped_stream);
-	~LzmaSource();
-	const char *class_name() const override{
-		return "LzmaInputStream";
-	}
-};
-
-}
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#include "Filters.h"
+#include "CompressionFilter.h"
+
+namespace zstreams{
+	
+class LzmaSink : public CompressorSink{
+	lzma_stream lstream;
+	Segment output_segment;
+	bool multithreaded;
+	int compression_level;
+	bool extreme_mode;
+	ContentFilter filter;
+
+	void reset_segment();
+	void initialize();
+	bool initialize_single_threaded(int, bool);
+	bool initialize_multithreaded(int, bool);
+	bool pass_data_to_stream(lzma_ret ret);
+	void begin_block() override;
+	void compress(const std::uint8_t *&input, size_t &size) override;
+	void end_block() override;
+public:
+	// Each block is a separate xz stream. The filter is recorded in the xz
+	// headers, so decoders don't need to be told about it.
+	LzmaSink(Sink &stream, bool *multithreaded, int compression_level = 7, bool extreme_mode = false, ContentFilter filter = ContentFilter::None);
+	~LzmaSink();
+	const char *class_name() const override{
+		return "LzmaOutputStream";
+	}
+};
+
+class LzmaSource : public DecompressorSource{
+	lzma_stream lstream;
+	lzma_action action = LZMA_RUN;
+	bool at_eof = false;
+
+	void work_sequential() override;
+	void decode_block(const std::vector<Segment> &input, DecodedBlock &output) override;
+public:
+	LzmaSource(Source &wrapped_stream, const std::vector<std::uint64_t> &block_sizes = std::vector<std::uint64_t>(), std::uint64_t max_block_output = 0);
+	~LzmaSource();
+	const char *class_name() const override{
+		return "LzmaInputStream";
+	}
+};
+
+// See compress_with_dictionary(). The output is a raw LZMA2 stream that uses
+// the dictionary as its preset dictionary.
+buffer_t lzma_compress_with_dictionary(int preset, const buffer_t &data, const buffer_t &dictionary);
+buffer_t lzma_decompress_with_dictionary(const buffer_t &data, std::uint64_t size, const buffer_t &dictionary);
+
+}
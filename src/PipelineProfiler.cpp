@@ -0,0 +1,115 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "PipelineProfiler.h"
+#include "System/Threads.h"
+
+namespace zstreams{
+
+PipelineProfiler profiler;
+
+void ProcessorStats::add(const ProcessorStats &other){
+	this->work_time += other.work_time;
+	this->starved_time += other.starved_time;
+	this->backpressured_time += other.backpressured_time;
+	this->fused_time += other.fused_time;
+	this->segments_read += other.segments_read;
+	this->segments_written += other.segments_written;
+	this->bytes_read += other.bytes_read;
+	this->bytes_written += other.bytes_written;
+	for (size_t i = 0; i < queue_depth_buckets; i++)
+		this->queue_depth[i] += other.queue_depth[i];
+	this->instances += other.instances;
+}
+
+std::uint64_t ProcessorStats::get_active_time() const{
+	auto waiting = this->starved_time + this->backpressured_time + this->fused_time;
+	return this->work_time > waiting ? this->work_time - waiting : 0;
+}
+
+void PipelineProfiler::add(const std::string &class_name, const ProcessorStats &stats){
+	LOCK_MUTEX(this->mutex);
+	this->stats[class_name].add(stats);
+}
+
+void PipelineProfiler::reset(){
+	LOCK_MUTEX(this->mutex);
+	this->stats.clear();
+}
+
+static double to_seconds(std::uint64_t ns){
+	return ns * 1e-9;
+}
+
+static double to_mib(std::uint64_t bytes){
+	return bytes / (1024.0 * 1024.0);
+}
+
+void PipelineProfiler::report(std::ostream &stream){
+	LOCK_MUTEX(this->mutex);
+	if (!this->stats.size())
+		return;
+	stream
+		<< "Pipeline profile:\n"
+		<< std::left << std::setw(24) << "Stage" << std::right
+		<< std::setw(6) << "Inst."
+		<< std::setw(10) << "Active s"
+		<< std::setw(10) << "Starved s"
+		<< std::setw(10) << "Blocked s"
+		<< std::setw(10) << "Seg. in"
+		<< std::setw(10) << "Seg. out"
+		<< std::setw(11) << "MiB in"
+		<< std::setw(11) << "MiB out"
+		<< std::setw(9) << "Empty %"
+		<< std::setw(8) << "Full %"
+		<< std::endl;
+	const std::string *bottleneck = nullptr;
+	std::uint64_t bottleneck_time = 0;
+	auto flags = stream.flags();
+	stream << std::fixed;
+	for (auto &p : this->stats){
+		auto &s = p.second;
+		std::uint64_t samples = 0;
+		for (auto n : s.queue_depth)
+			samples += n;
+		double empty = 0,
+			full = 0;
+		if (samples){
+			empty = 100.0 * s.queue_depth[0] / samples;
+			full = 100.0 * s.queue_depth[ProcessorStats::queue_depth_buckets - 1] / samples;
+		}
+		auto active = s.get_active_time();
+		if (active > bottleneck_time){
+			bottleneck = &p.first;
+			bottleneck_time = active;
+		}
+		stream
+			<< std::left << std::setw(24) << p.first << std::right
+			<< std::setw(6) << s.instances
+			<< std::setprecision(2)
+			<< std::setw(10) << to_seconds(active)
+			<< std::setw(10) << to_seconds(s.starved_time)
+			<< std::setw(10) << to_seconds(s.backpressured_time)
+			<< std::setw(10) << s.segments_read
+			<< std::setw(10) << s.segments_written
+			<< std::setw(11) << to_mib(s.bytes_read)
+			<< std::setw(11) << to_mib(s.bytes_written)
+			<< std::setprecision(1);
+		// Fused processors don't have an input queue.
+		if (samples)
+			stream << std::setw(9) << empty << std::setw(8) << full;
+		else
+			stream << std::setw(9) << "-" << std::setw(8) << "-";
+		stream << std::endl;
+	}
+	if (bottleneck)
+		stream << "Busiest stage: " << *bottleneck << " (" << std::setprecision(2) << to_seconds(bottleneck_time) << " s active)\n";
+	stream.flags(flags);
+}
+
+}
@@ -0,0 +1,55 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+namespace zstreams{
+
+typedef std::chrono::steady_clock profiler_clock;
+
+struct ProcessorStats{
+	static const size_t queue_depth_buckets = 17;
+
+	// Time spent inside the processor, including the time below.
+	std::uint64_t work_time = 0;
+	// Time spent waiting for input.
+	std::uint64_t starved_time = 0;
+	// Time spent waiting for room in the output queue.
+	std::uint64_t backpressured_time = 0;
+	// Time spent in fused processors downstream of this one.
+	std::uint64_t fused_time = 0;
+	std::uint64_t segments_read = 0,
+		segments_written = 0,
+		bytes_read = 0,
+		bytes_written = 0;
+	// Number of segments in the input queue each time the processor read from
+	// it. The last bucket counts every depth that doesn't fit in the others.
+	std::uint64_t queue_depth[queue_depth_buckets] = {};
+	unsigned instances = 0;
+
+	void add(const ProcessorStats &);
+	std::uint64_t get_active_time() const;
+	static std::uint64_t elapsed(const profiler_clock::time_point &since){
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(profiler_clock::now() - since).count();
+	}
+};
+
+// Collects the statistics of every processor in every pipeline, grouped by
+// class name, so that it's possible to tell which stage limits a given
+// operation.
+class PipelineProfiler{
+	std::map<std::string, ProcessorStats> stats;
+	std::mutex mutex;
+public:
+	void add(const std::string &class_name, const ProcessorStats &);
+	void reset();
+	void report(std::ostream &);
+};
+
+extern PipelineProfiler profiler;
+
+}
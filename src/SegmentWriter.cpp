@@ -0,0 +1,150 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "SegmentWriter.h"
+#include "Utility.h"
+
+namespace zstreams{
+
+SegmentWriter::SegmentWriter(Sink &sink): Sink(sink){
+	this->segment_size = sink.get_segment_size();
+}
+
+SegmentWriter::~SegmentWriter(){
+	// If there are outstanding reservations, the operation was abandoned and
+	// the held data is incomplete. Drop it.
+	if (!this->holds){
+		try{
+			this->send_current();
+		}catch (...){
+		}
+	}
+	this->state = State::Ignore;
+}
+
+void SegmentWriter::send(Segment &segment){
+	if (!this->started){
+		this->pipeline->start();
+		this->started = true;
+	}
+	Sink::write(segment);
+}
+
+void SegmentWriter::send_current(){
+	if (!this->current_segment)
+		return;
+	auto segment = std::move(this->current_segment);
+	segment.trim_to_size(this->offset);
+	this->offset = 0;
+	if (!segment.get_data().size)
+		return;
+	if (this->holds)
+		this->held_segments.emplace_back(std::move(segment));
+	else
+		this->send(segment);
+}
+
+void SegmentWriter::send_partial(){
+	this->send_current();
+}
+
+SubSegment SegmentWriter::get_span(size_t min_size){
+	if (!!this->current_segment && this->current_segment.get_data().size - this->offset < min_size)
+		this->send_current();
+	if (!this->current_segment){
+		this->current_segment = this->allocate_segment();
+		this->offset = 0;
+		zekvok_assert(this->current_segment.get_data().size >= min_size);
+	}
+	auto data = this->current_segment.get_data();
+	return SubSegment{ data.data + this->offset, data.size - this->offset };
+}
+
+void SegmentWriter::commit(size_t size){
+	this->offset += size;
+	this->total_written += size;
+}
+
+void SegmentWriter::write(const void *buffer, size_t size){
+	auto p = (const std::uint8_t *)buffer;
+	while (size){
+		auto span = this->get_span();
+		auto n = std::min(span.size, size);
+		memcpy(span.data, p, n);
+		this->commit(n);
+		p += n;
+		size -= n;
+	}
+}
+
+SegmentWriter::Reservation SegmentWriter::reserve(size_t size){
+	auto span = this->get_span(size);
+	this->commit(size);
+	this->holds++;
+	return Reservation{ span.data, size };
+}
+
+void SegmentWriter::backpatch(const Reservation &reservation, const void *data){
+	zekvok_assert(this->holds);
+	memcpy(reservation.data, data, reservation.size);
+	if (--this->holds)
+		return;
+	for (auto &segment : this->held_segments)
+		this->send(segment);
+	this->held_segments.clear();
+}
+
+void SegmentStreambuf::lend(){
+	auto span = this->writer.get_span();
+	this->setp((char *)span.data, (char *)span.data + span.size);
+}
+
+void SegmentStreambuf::give_back(){
+	if (this->pbase())
+		this->writer.commit(this->pptr() - this->pbase());
+	this->setp(nullptr, nullptr);
+}
+
+SegmentStreambuf::~SegmentStreambuf(){
+	this->give_back();
+}
+
+SegmentStreambuf::int_type SegmentStreambuf::overflow(int_type c){
+	this->give_back();
+	if (traits_type::eq_int_type(c, traits_type::eof()))
+		return traits_type::not_eof(c);
+	this->lend();
+	*this->pptr() = traits_type::to_char_type(c);
+	this->pbump(1);
+	return c;
+}
+
+std::streamsize SegmentStreambuf::xsputn(const char *s, std::streamsize n){
+	auto ret = n;
+	while (n){
+		auto available = this->epptr() - this->pptr();
+		if (!available){
+			this->give_back();
+			this->lend();
+			continue;
+		}
+		auto copy = (int)std::min<std::streamsize>(available, n);
+		memcpy(this->pptr(), s, copy);
+		this->pbump(copy);
+		s += copy;
+		n -= copy;
+	}
+	return ret;
+}
+
+int SegmentStreambuf::sync(){
+	this->give_back();
+	return 0;
+}
+
+}
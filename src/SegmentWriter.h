@@ -0,0 +1,98 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#include "StreamProcessor.h"
+
+namespace zstreams{
+
+// Lends the caller the free space of the current segment to write into, and
+// sends each segment to the sink once it's full. Unlike SynchronousSink, the
+// data is written straight into the segments, with no intermediate buffers.
+// Like SynchronousSink, it runs on the caller's thread.
+class SegmentWriter : public Sink{
+public:
+	struct Reservation{
+		std::uint8_t *data;
+		size_t size;
+	};
+private:
+	Segment current_segment;
+	size_t offset = 0;
+	std::uint64_t total_written = 0;
+	// Segments that can't be sent yet because a reservation in them (or in
+	// an earlier one) hasn't been filled in.
+	std::vector<Segment> held_segments;
+	unsigned holds = 0;
+	bool started = false;
+
+	IGNORE_FLUSH_COMMAND
+	void work() override{}
+	void send_current();
+	void send(Segment &);
+	// Waiting while holding segments back could deadlock.
+	bool waits_for_memory() const override{
+		return !this->holds;
+	}
+public:
+	SegmentWriter(Sink &);
+	virtual ~SegmentWriter();
+	void start() override{}
+	void join() override{}
+	void stop() override{}
+	// Returns the free space in the current segment, which is at least
+	// min_size bytes long. min_size may not be larger than a segment. Nothing
+	// is sent until the written bytes are commit()ted.
+	SubSegment get_span(size_t min_size = 1);
+	void commit(size_t size);
+	void write(const void *buffer, size_t size);
+	// Sets aside size contiguous bytes at the current position, to be filled
+	// in later with backpatch(), e.g. with the length of what follows. No
+	// data is sent downstream until every reservation has been filled in.
+	Reservation reserve(size_t size);
+	void backpatch(const Reservation &, const void *data);
+	// Sends the current segment, even if it isn't full.
+	void send_partial();
+	std::uint64_t get_bytes_written() const{
+		return this->total_written;
+	}
+	const char *class_name() const override{
+		return "SegmentWriter";
+	}
+};
+
+// Adapts SegmentWriter to std::streambuf, lending its put area to the
+// stream.
+class SegmentStreambuf : public std::streambuf{
+	SegmentWriter &writer;
+
+	void lend();
+	void give_back();
+protected:
+	int_type overflow(int_type) override;
+	std::streamsize xsputn(const char *, std::streamsize) override;
+	int sync() override;
+public:
+	SegmentStreambuf(SegmentWriter &writer): writer(writer){}
+	~SegmentStreambuf();
+};
+
+// Use when something needs an std::ostream, such as SerializerStream. The
+// writer may not be used directly while the stream is alive.
+class SegmentOStream : public std::ostream{
+	SegmentStreambuf buffer;
+public:
+	SegmentOStream(SegmentWriter &writer): std::ostream(nullptr), buffer(writer){
+		this->rdbuf(&this->buffer);
+	}
+	~SegmentOStream(){
+		this->flush();
+	}
+};
+
+}
@@ -0,0 +1,158 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "SimilarityOrdering.h"
+
+// One in 2^shingle_sampling_bits shingles is used.
+const unsigned shingle_sampling_bits = 3;
+const size_t shingle_size = 8;
+// Files with a lower estimated similarity aren't put together.
+const double min_similarity = 0.3;
+// Limits the work done for large groups of files that look alike.
+const size_t max_candidates = 256;
+
+static std::uint64_t mix(std::uint64_t x){
+	x ^= x >> 33;
+	x *= 0xFF51AFD7ED558CCDULL;
+	x ^= x >> 33;
+	x *= 0xC4CEB9FE1A85EC53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static const class Seeds{
+	std::uint64_t seeds[ContentSketch::hash_count];
+public:
+	Seeds(){
+		for (size_t i = 0; i < ContentSketch::hash_count; i++)
+			this->seeds[i] = mix(0x9E3779B97F4A7C15ULL * (i + 1));
+	}
+	std::uint64_t operator[](size_t i) const{
+		return this->seeds[i];
+	}
+} seeds;
+
+ContentSketch::ContentSketch(){
+	std::fill(this->minimums, this->minimums + hash_count, ~(std::uint32_t)0);
+}
+
+void ContentSketch::add(const std::uint8_t *data, size_t size){
+	static const std::uint64_t sampling_mask = (1 << shingle_sampling_bits) - 1;
+	if (size < shingle_size)
+		return;
+	for (size_t i = 0; i + shingle_size <= size; i++){
+		std::uint64_t shingle;
+		memcpy(&shingle, data + i, shingle_size);
+		auto hash = mix(shingle);
+		if (hash & sampling_mask)
+			continue;
+		this->valid = true;
+		for (size_t j = 0; j < hash_count; j++){
+			auto value = (std::uint32_t)mix(hash ^ seeds[j]);
+			this->minimums[j] = std::min(this->minimums[j], value);
+		}
+	}
+}
+
+bool ContentSketch::compute(std::istream &stream, std::uint64_t size){
+	std::vector<std::uint8_t> buffer;
+	auto read = [&stream, &buffer](std::uint64_t offset, size_t size){
+		buffer.resize(size);
+		stream.seekg(offset);
+		stream.read((char *)&buffer[0], size);
+		buffer.resize((size_t)stream.gcount());
+		return buffer.size() == size;
+	};
+	if (size <= sample_size * sample_count){
+		if (!size || !read(0, (size_t)size))
+			return false;
+		this->add(&buffer[0], buffer.size());
+	}else{
+		auto step = (size - sample_size) / (sample_count - 1);
+		for (size_t i = 0; i < sample_count; i++){
+			if (!read(step * i, sample_size))
+				return false;
+			this->add(&buffer[0], buffer.size());
+		}
+	}
+	return this->valid;
+}
+
+double ContentSketch::similarity(const ContentSketch &other) const{
+	if (!this->valid || !other.valid)
+		return 0;
+	size_t matches = 0;
+	for (size_t i = 0; i < hash_count; i++)
+		matches += this->minimums[i] == other.minimums[i];
+	return (double)matches / hash_count;
+}
+
+std::uint64_t ContentSketch::get_band_hash(size_t band) const{
+	std::uint64_t ret = band;
+	for (size_t i = 0; i < band_size; i++)
+		ret = mix(ret ^ this->minimums[band * band_size + i]);
+	return ret;
+}
+
+// Places each element that isn't part of a cluster yet, and then follows it
+// with its most similar unplaced neighbor, and that one with its own, and so
+// on. Candidates are found through locality-sensitive hashing: elements that
+// share all the hashes of a band are likely to be similar.
+std::vector<size_t> order_by_similarity(const std::vector<const ContentSketch *> &sketches){
+	auto n = sketches.size();
+	std::vector<size_t> ret;
+	ret.reserve(n);
+	std::vector<bool> placed(n, false);
+	std::vector<std::unordered_map<std::uint64_t, std::vector<size_t>>> buckets(ContentSketch::band_count);
+	for (size_t i = 0; i < n; i++){
+		if (!sketches[i] || !sketches[i]->is_valid())
+			continue;
+		for (size_t band = 0; band < ContentSketch::band_count; band++)
+			buckets[band][sketches[i]->get_band_hash(band)].push_back(i);
+	}
+
+	for (size_t i = 0; i < n; i++){
+		if (placed[i])
+			continue;
+		auto current = i;
+		while (true){
+			placed[current] = true;
+			ret.push_back(current);
+			auto sketch = sketches[current];
+			if (!sketch || !sketch->is_valid())
+				break;
+			size_t best = n;
+			double best_similarity = min_similarity;
+			size_t candidates = 0;
+			for (size_t band = 0; band < ContentSketch::band_count && candidates < max_candidates; band++){
+				auto &bucket = buckets[band][sketch->get_band_hash(band)];
+				for (size_t j = 0; j < bucket.size() && candidates < max_candidates;){
+					auto other = bucket[j];
+					if (placed[other]){
+						// Placed elements are never candidates again.
+						bucket[j] = bucket.back();
+						bucket.pop_back();
+						continue;
+					}
+					j++;
+					candidates++;
+					auto similarity = sketch->similarity(*sketches[other]);
+					// On ties, prefer the element that came first.
+					if (similarity > best_similarity || similarity == best_similarity && other < best){
+						best = other;
+						best_similarity = similarity;
+					}
+				}
+			}
+			if (best == n)
+				break;
+			current = best;
+		}
+	}
+	return ret;
+}
@@ -0,0 +1,48 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+// A MinHash signature of the contents of a file, which allows estimating how
+// much two files have in common without comparing them.
+//
+// The signature is built from 8-byte shingles. To keep it cheap, only the
+// shingles whose hash has its low bits clear are used. Since the choice
+// depends on the contents and not on the position, inserting data into a file
+// doesn't change the shingles that are picked from the rest of it.
+class ContentSketch{
+public:
+	static const size_t hash_count = 24;
+	static const size_t band_size = 3;
+	static const size_t band_count = hash_count / band_size;
+	// Files are read whole up to this size. Larger files are sampled at
+	// sample_count evenly spaced places, sample_size bytes each.
+	static const size_t sample_size = 64 << 10;
+	static const size_t sample_count = 4;
+private:
+	std::uint32_t minimums[hash_count];
+	bool valid = false;
+
+	void add(const std::uint8_t *data, size_t size);
+public:
+	ContentSketch();
+	// Returns false if the file couldn't be read or is too small to be
+	// compared.
+	bool compute(std::istream &, std::uint64_t size);
+	bool is_valid() const{
+		return this->valid;
+	}
+	// Estimates the Jaccard similarity of the shingle sets of both files.
+	double similarity(const ContentSketch &) const;
+	std::uint64_t get_band_hash(size_t band) const;
+};
+
+// Returns a permutation of the elements such that similar ones are next to
+// each other, so that they fall within the compressor's window. Elements
+// without a valid sketch (or null) keep their relative place, as does the
+// first element of each cluster.
+std::vector<size_t> order_by_similarity(const std::vector<const ContentSketch *> &);
@@ -1,534 +1,713 @@
-/*
-Copyright (c), Helios
-All rights reserved.
-
-Distributed under a permissive license. See COPYING.txt for details.
-*/
-
-#include "stdafx.h"
-#include "StreamProcessor.h"
-#include "Utility.h"
-#include "Exception.h"
-#include "NullStream.h"
-
-namespace zstreams{
-
-const size_t default_buffer_size = 1 << 16;
-
-const Segment &Segment::operator=(Segment &&old){
-	this->release();
-	this->allocator = old.allocator;
-	old.allocator = nullptr;
-	this->type = old.type;
-	old.type = SegmentType::Undefined;
-	this->data = std::move(old.data);
-	this->default_subsegment = old.default_subsegment;
-	old.default_subsegment = SubSegment();
-	this->subsegment_override = old.subsegment_override;
-	old.subsegment_override = SubSegment();
-	this->flush_callback = std::move(old.flush_callback);
-	return *this;
-}
-
-void Segment::skip_bytes(size_t n){
-	auto addend = std::min(this->subsegment_override.size, n);
-	this->subsegment_override.data += addend;
-	this->subsegment_override.size -= addend;
-}
-
-void Segment::trim_to_size(size_t n){
-	if (n < this->subsegment_override.size)
-		this->subsegment_override.size = n;
-}
-
-Segment Segment::clone_and_trim(size_t max_size){
-	if (this->type == SegmentType::Flush || this->type == SegmentType::FullFlush)
-		throw std::exception("Attempt to clone a flush signal.");
-	Segment ret;
-	auto &old = *this;
-	ret.allocator = old.allocator;
-	ret.type = old.type;
-	if (ret.allocator){
-		max_size = std::min(max_size, old.subsegment_override.size);
-		ret.data = ret.allocator->allocate_buffer();
-		ret.default_subsegment = ret.construct_default_subsegment();
-		ret.subsegment_override.data = ret.default_subsegment.data;
-		ret.subsegment_override.size = max_size;
-		memcpy(ret.default_subsegment.data, old.default_subsegment.data + old.get_offset(), max_size);
-	}
-	return ret;
-}
-
-Segment Segment::clone(){
-	if (this->type == SegmentType::Flush || this->type == SegmentType::FullFlush)
-		throw std::exception("Attempt to clone a flush signal.");
-	Segment ret;
-	auto &old = *this;
-	ret.allocator = old.allocator;
-	ret.type = old.type;
-	if (ret.allocator){
-		ret.data = ret.allocator->allocate_buffer();
-		ret.default_subsegment = ret.construct_default_subsegment();
-		memcpy(ret.default_subsegment.data, old.default_subsegment.data, ret.default_subsegment.size);
-		ret.subsegment_override.data = ret.default_subsegment.data + old.get_offset();
-		ret.subsegment_override.size = old.subsegment_override.size;
-	}
-	return ret;
-}
-
-void Segment::release(){
-	if (this->data)
-		this->allocator->release_buffer(this->data);
-}
-
-Segment::Segment(StreamPipeline &pipeline){
-	this->allocator = &pipeline;
-	this->data = pipeline.allocate_buffer();
-	this->type = SegmentType::Data;
-	this->subsegment_override = this->default_subsegment = this->construct_default_subsegment();
-}
-
-Segment Segment::construct_flush(flush_callback_ptr_t &callback){
-	Segment ret(SegmentType::Flush);
-	ret.flush_callback = std::move(callback);
-	return ret;
-}
-
-Segment::~Segment(){
-	this->release();
-}
-
-struct StreamProcessorStoppingException{};
-
-StreamProcessor::StreamProcessor(StreamPipeline &parent): pipeline(&parent), state(State::Uninitialized), stop_requested(false){
-}
-
-StreamProcessor::~StreamProcessor(){
-	this->stop();
-	this->join();
-	if (this->sink_queue)
-		this->sink_queue->detach_source();
-	if (this->source_queue)
-		this->source_queue->detach_sink();
-	if (this->bytes_written_dst)
-		*this->bytes_written_dst = this->bytes_written;
-	if (this->bytes_read_dst)
-		*this->bytes_read_dst = this->bytes_read;
-}
-
-Segment StreamProcessor::read(){
-	Segment eof(SegmentType::Eof);
-	while (true){
-		Segment ret;
-		{
-			auto &running = this->pipeline->busy_threads;
-			ScopedAtomicReversibleSet<State> scope(this->state, State::Yielding, ScopedAtomicReversibleSet<State>::CancelOnException);
-			ScopedDecrement<decltype(running)> inc(running);
-			while (!this->source_queue){
-				std::this_thread::sleep_for(std::chrono::milliseconds(250));
-				if (this->stop_requested)
-					return eof;
-			}
-			while (!this->source_queue->try_pop(ret))
-				if (this->stop_requested)
-					return eof;
-		}
-		if (ret.get_type() == SegmentType::Flush){
-			this->flush_impl();
-			ret.get_flush_callback()();
-			continue;
-		}
-		if (ret.get_type() == SegmentType::FullFlush){
-			this->flush_impl();
-			if (this->pass_flush())
-				this->sink_queue->push(ret);
-			else
-				ret.get_flush_callback()();
-			continue;
-		}
-		if (ret.get_type() == SegmentType::Data)
-			this->bytes_read += ret.get_data().size;
-		return ret;
-	}
-}
-
-void StreamProcessor::throw_on_termination(){
-	if (this->stop_requested)
-		throw StreamProcessorStoppingException();
-}
-
-void StreamProcessor::put_back(Segment &segment){
-	size_t size = 0;
-	if (segment.get_type() == SegmentType::Data)
-		size = segment.get_data().size;
-	this->source_queue->put_back(segment);
-	this->bytes_read -= size;
-}
-
-void StreamProcessor::write(Segment &segment){
-	bool is_eof = segment.get_type() == SegmentType::Eof;
-	if (!this->pass_eof && is_eof)
-		return;
-	auto &running = this->pipeline->busy_threads;
-	{
-		ScopedAtomicReversibleSet<State> scope(this->state, State::Yielding, ScopedAtomicReversibleSet<State>::CancelOnException);
-		ScopedDecrement<decltype(running)> inc(running);
-		size_t size = 0;
-		if (segment.get_type() == SegmentType::Data)
-			size = segment.get_data().size;
-		while (!this->sink_queue->try_push(segment))
-			this->throw_on_termination();
-		// Note: If we get to this point, the segment was definitely pushed. check_termination() throws.
-		this->bytes_written += size;
-	}
-	this->throw_on_termination();
-}
-
-void StreamProcessor::notify_thread_creation(){
-	this->pipeline->notify_thread_creation(this);
-}
-
-void StreamProcessor::notify_thread_end(){
-	this->pipeline->notify_thread_end(this);
-}
-
-void StreamProcessor::start(){
-	auto expected = State::Uninitialized;
-	if (!this->state.compare_exchange_strong(expected, State::Starting))
-		return;
-	this->state = State::Starting;
-#ifdef USE_THREADPOOL
-	this->thread = thread_pool->allocate_thread();
-	this->thread->run(std::make_unique<std::function<void()>>([this](){ this->thread_func(); }));
-#else
-	this->thread.reset(new std::thread([this](){ this->thread_func(); }));
-#endif
-}
-
-void StreamProcessor::thread_func(){
-	this->state = State::Running;
-	ScopedAtomicPostSet<State> scope(this->state, State::Completed);
-	auto &running = this->pipeline->busy_threads;
-	ScopedIncrement<decltype(running)> inc(running);
-	try{
-		this->work();
-	}catch (StreamProcessorStoppingException &){
-	}catch (std::exception &e){
-		this->pipeline->set_exception_message((std::string)this->class_name() + ": " + e.what());
-	}
-	this->notify_thread_end();
-}
-
-void StreamProcessor::join(){
-	if (!!this->thread){
-		this->thread->join();
-		this->thread.reset();
-	}
-	this->state = State::Completed;
-}
-
-void StreamProcessor::stop(){
-	while (true){
-		switch (this->state){
-			case State::Uninitialized:
-				return;
-			case State::Starting:
-				this->join();
-				return;
-			case State::Running:
-			case State::Yielding:
-				this->stop_requested = true;
-			case State::Completed:
-				this->join();
-				return;
-			case State::Ignore:
-				return;
-			default:
-				zekvok_assert(false);
-		}
-	}
-}
-
-#define USE_MACRO
-
-#define CONNECT_SOURCE_SINK(x, y)		\
-	zekvok_assert(!y.x##_queue);		\
-	if (x.y##_queue){					\
-		x.y##_queue->attach_##y(y);		\
-		y.x##_queue = x.y##_queue;		\
-	}else{								\
-		y.x##_queue.reset(new Queue);	\
-		y.x##_queue->attach_##x(x);		\
-		y.x##_queue->attach_##y(y);		\
-		x.y##_queue = y.x##_queue;		\
-	}
-
-void StreamProcessor::connect_to_source(StreamProcessor &p){
-	StreamProcessor &source = p;
-	StreamProcessor &sink = *this;
-	CONNECT_SOURCE_SINK(source, sink);
-}
-
-void StreamProcessor::connect_to_sink(StreamProcessor &p){
-	StreamProcessor &sink = p;
-	StreamProcessor &source = *this;
-	CONNECT_SOURCE_SINK(sink, source);
-}
-
-Segment StreamProcessor::allocate_segment() const{
-	return this->pipeline->allocate_segment();
-}
-
-void StreamPipeline::notify_thread_creation(StreamProcessor *p){
-	std::string name = p->class_name();
-	LOCK_MUTEX(this->processors_mutex);
-	this->processors[(uintptr_t)p] = name;
-}
-
-void StreamPipeline::notify_thread_end(StreamProcessor *p){
-	LOCK_MUTEX(this->processors_mutex);
-	auto it = this->processors.find((uintptr_t)p);
-	if (it == this->processors.end())
-		return;
-	this->processors.erase(it);
-}
-
-StreamPipeline::StreamPipeline(){
-	this->busy_threads = 0;
-}
-
-StreamPipeline::~StreamPipeline(){
-}
-
-void StreamPipeline::start(){
-	this->check_exceptions();
-	LOCK_MUTEX(this->processors_mutex);
-	for (auto &p : this->processors){
-		auto class_name = p.second;
-		((StreamProcessor *)p.first)->start();
-	}
-}
-
-void StreamPipeline::check_exceptions(){
-	decltype(this->exception_message) ex;
-	{
-		LOCK_MUTEX(this->exception_message_mutex);
-		ex = std::move(this->exception_message);
-	}
-	if (ex.is_initialized()){
-		auto message = ex.value();
-		throw StdStringException(message);
-	}
-}
-
-std::unique_ptr<buffer_t> StreamPipeline::allocate_buffer(){
-	{
-		LOCK_MUTEX(this->allocated_buffers_mutex);
-		if (this->allocated_buffers.size()){
-			auto ret = std::move(this->allocated_buffers.back());
-			this->allocated_buffers.pop_back();
-			return ret;
-		}
-	}
-	return std::make_unique<buffer_t>(default_buffer_size);
-}
-
-void StreamPipeline::release_buffer(std::unique_ptr<buffer_t> &buffer){
-	LOCK_MUTEX(this->allocated_buffers_mutex);
-	this->allocated_buffers.emplace_back(std::move(buffer));
-}
-
-Segment StreamPipeline::allocate_segment(){
-	return Segment(*this);
-}
-
-void StreamPipeline::set_exception_message(const std::string &s){
-	LOCK_MUTEX(this->exception_message_mutex);
-	this->exception_message = s;
-}
-
-FileSource::FileSource(const path_t &path, StreamPipeline &parent): StdStreamSource(parent){
-	std::unique_ptr<std::istream> stream(new boost::filesystem::ifstream(path, std::ios::binary));
-	if (!*stream)
-		throw std::exception("File not found!");
-	stream->seekg(0, std::ios::end);
-	this->stream_size = stream->tellg();
-	stream->seekg(0);
-	this->set_stream(stream);
-}
-
-Sink::~Sink(){
-}
-
-Sink::Sink(Sink &sink): StreamProcessor(sink.get_pipeline()){
-	this->pass_eof = false;
-	this->connect_to_sink(sink);
-}
-
-void Sink::flush(){
-	if (!this->source_queue)
-		return;
-	if (!this->source_queue->get_source()){
-		Segment eof(SegmentType::Eof);
-		this->source_queue->push(eof);
-		this->join();
-		return;
-	}
-	Event cv;
-	bool ready = false;
-	auto cb = std::make_unique<flush_callback_t>([&]{ ready = true; cv.signal(); });
-	auto segment = Segment::construct_flush(cb);
-	this->source_queue->push(segment);
-	while (!ready && this->state != State::Completed)
-		cv.wait_for(250);
-	if (!ready)
-		this->flush_impl();
-}
-
-Source::Source(Source &source) : StreamProcessor(source.get_pipeline()){
-	this->connect_to_source(source);
-}
-
-void Source::copy_to(Sink &sink){
-	this->pass_eof = false;
-	this->connect_to_sink(sink);
-	this->pipeline->start();
-	this->join();
-}
-
-void Source::discard_rest(){
-	this->sink_queue.reset();
-	Stream<zstreams::NullSink> null(*this->pipeline);
-	this->copy_to(*null);
-}
-
-SizedSource::~SizedSource(){}
-
-void StdStreamSink::work(){
-	while (true){
-		auto segment = this->read();
-		if (segment.get_type() == SegmentType::Eof)
-			break;
-		auto data = segment.get_data();
-		auto bytes_written = data.size;
-		this->stream->write(reinterpret_cast<const char *>(data.data), data.size);
-		this->report_bytes_written(bytes_written);
-	}
-}
-
-void StdStreamSink::flush_impl(){
-	if (this->stream)
-		this->stream->flush();
-}
-
-void StdStreamSink::set_stream(std::unique_ptr<std::ostream> &stream){
-	this->stream = std::move(stream);
-}
-
-FileSink::FileSink(const path_t &path, StreamPipeline &parent): StdStreamSink(parent){
-	std::unique_ptr<std::ostream> stream(new boost::filesystem::ofstream(path, std::ios::binary));
-	if (!*stream)
-		throw std::exception("Error opening file!");
-	this->set_stream(stream);
-}
-
-void StdStreamSource::work(){
-	while (this->stream){
-		auto segment = this->pipeline->allocate_segment();
-		auto data = segment.get_data();
-		this->stream->read(reinterpret_cast<char *>(data.data), data.size);
-		auto bytes_read = this->stream->gcount();
-		if (!bytes_read)
-			break;
-		this->report_bytes_read(bytes_read);
-		segment.trim_to_size(bytes_read);
-		this->write(segment);
-	}
-	Segment s(SegmentType::Eof);
-	this->write(s);
-}
-
-void StdStreamSource::set_stream(std::unique_ptr<std::istream> &stream){
-	this->stream = std::move(stream);
-}
-
-SynchronousSourceImpl::SynchronousSourceImpl(Source &source): Source(source){
-}
-
-SynchronousSourceImpl::~SynchronousSourceImpl(){
-	this->state = State::Ignore;
-}
-
-std::streamsize SynchronousSourceImpl::read(char *s, std::streamsize n){
-	if (this->at_eof)
-		return -1;
-	this->pipeline->start();
-	std::streamsize ret = 0;
-	while (n){
-		if (!this->current_segment){
-			this->current_segment = Source::read();
-			if (this->current_segment.get_type() == SegmentType::Eof){
-				if (!ret)
-					return -1;
-				this->at_eof = true;
-				break;
-			}
-		}
-		auto data = this->current_segment.get_data();
-		auto read_size = std::min<size_t>(n, data.size);
-		memcpy(s, data.data, read_size);
-		n -= read_size;
-		s += read_size;
-		ret += read_size;
-		this->current_segment.skip_bytes(read_size);
-		data = this->current_segment.get_data();
-		if (!data.size)
-			this->current_segment = Segment();
-	}
-	return ret;
-}
-
-SynchronousSinkImpl::SynchronousSinkImpl(Sink &sink): Sink(sink){
-}
-
-SynchronousSinkImpl::~SynchronousSinkImpl(){
-	this->try_write(true);
-	this->state = State::Ignore;
-}
-
-std::streamsize SynchronousSinkImpl::write(const char *s, std::streamsize n){
-	this->pipeline->start();
-	std::streamsize ret = 0;
-	while (n){
-		this->ensure_valid_segment();
-		auto data = this->current_segment.get_data();
-		auto write_size = std::min<size_t>(n, data.size - this->offset);
-		memcpy(data.data + this->offset, s, write_size);
-		this->offset += write_size;
-		n -= write_size;
-		s += write_size;
-		ret += write_size;
-		this->try_write();
-	}
-	return ret;
-}
-
-void SynchronousSinkImpl::ensure_valid_segment(){
-	if (!!this->current_segment)
-		return;
-
-	this->current_segment = this->pipeline->allocate_segment();
-	this->offset = 0;
-}
-
-void SynchronousSinkImpl::try_write(bool force){
-	if (!this->current_segment)
-		return;
-	auto data = this->current_segment.get_data();
-	if (!(force || this->offset == data.size))
-		return;
-	this->current_segment.trim_to_size(this->offset);
-	Sink::write(this->current_segment);
-}
-
-}
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "StreamProcessor.h"
+#include "Utility.h"
+#include "Exception.h"
+#include "NullStream.h"
+
+namespace zstreams{
+
+const Segment &Segment::operator=(Segment &&old){
+	this->release();
+	this->allocator = old.allocator;
+	old.allocator = nullptr;
+	this->type = old.type;
+	old.type = SegmentType::Undefined;
+	this->data = std::move(old.data);
+	this->default_subsegment = old.default_subsegment;
+	old.default_subsegment = SubSegment();
+	this->subsegment_override = old.subsegment_override;
+	old.subsegment_override = SubSegment();
+	this->flush_callback = std::move(old.flush_callback);
+	return *this;
+}
+
+void Segment::skip_bytes(size_t n){
+	auto addend = std::min(this->subsegment_override.size, n);
+	this->subsegment_override.data += addend;
+	this->subsegment_override.size -= addend;
+}
+
+void Segment::trim_to_size(size_t n){
+	if (n < this->subsegment_override.size)
+		this->subsegment_override.size = n;
+}
+
+Segment Segment::clone_and_trim(size_t max_size){
+	auto ret = this->clone();
+	ret.trim_to_size(max_size);
+	return ret;
+}
+
+Segment Segment::clone(){
+	if (this->type == SegmentType::Flush || this->type == SegmentType::FullFlush)
+		throw std::exception("Attempt to clone a flush signal.");
+	Segment ret;
+	auto &old = *this;
+	ret.allocator = old.allocator;
+	ret.type = old.type;
+	ret.data = old.data;
+	ret.default_subsegment = old.default_subsegment;
+	ret.subsegment_override = old.subsegment_override;
+	return ret;
+}
+
+Segment Segment::split(size_t n){
+	auto ret = this->clone_and_trim(n);
+	this->skip_bytes(n);
+	return ret;
+}
+
+void Segment::make_writable(){
+	if (!this->data.is_shared())
+		return;
+	PooledBuffer copy(this->data.get_size());
+	auto offset = this->get_offset();
+	memcpy(copy.get() + offset, this->subsegment_override.data, this->subsegment_override.size);
+	this->data = std::move(copy);
+	this->default_subsegment = this->construct_default_subsegment();
+	this->subsegment_override.data = this->default_subsegment.data + offset;
+}
+
+void Segment::release(){
+	this->data.reset();
+}
+
+Segment::Segment(StreamPipeline &pipeline, size_t size){
+	this->allocator = &pipeline;
+	this->data = PooledBuffer(size ? size : pipeline.get_segment_size());
+	this->type = SegmentType::Data;
+	this->subsegment_override = this->default_subsegment = this->construct_default_subsegment();
+}
+
+Segment Segment::construct_flush(flush_callback_ptr_t &callback){
+	Segment ret(SegmentType::Flush);
+	ret.flush_callback = std::move(callback);
+	return ret;
+}
+
+Segment Segment::construct_full_flush(flush_callback_ptr_t &callback){
+	Segment ret(SegmentType::FullFlush);
+	ret.flush_callback = std::move(callback);
+	return ret;
+}
+
+Segment::~Segment(){
+	this->release();
+}
+
+struct StreamProcessorStoppingException{};
+
+StreamProcessor::StreamProcessor(StreamPipeline &parent): pipeline(&parent), state(State::Uninitialized), stop_requested(false){
+}
+
+StreamProcessor::~StreamProcessor(){
+	this->stop();
+	this->join();
+	if (this->sink_queue)
+		this->sink_queue->detach_source();
+	if (this->source_queue)
+		this->source_queue->detach_sink();
+	if (this->bytes_written_dst)
+		*this->bytes_written_dst = this->bytes_written;
+	if (this->bytes_read_dst)
+		*this->bytes_read_dst = this->bytes_read;
+}
+
+Segment StreamProcessor::read(){
+	Segment eof(SegmentType::Eof);
+	while (true){
+		Segment ret;
+		{
+			auto t0 = profiler_clock::now();
+			auto &running = this->pipeline->busy_threads;
+			ScopedAtomicReversibleSet<State> scope(this->state, State::Yielding, ScopedAtomicReversibleSet<State>::CancelOnException);
+			ScopedDecrement<decltype(running)> inc(running);
+			while (!this->source_queue){
+				if (this->stop_requested)
+					return eof;
+				this->attach_event.wait();
+			}
+			auto depth = std::min(this->source_queue->size(), ProcessorStats::queue_depth_buckets - 1);
+			this->stats.queue_depth[depth]++;
+			while (!this->source_queue->try_pop(ret))
+				if (this->stop_requested)
+					return eof;
+			this->stats.starved_time += ProcessorStats::elapsed(t0);
+		}
+		if (ret.get_type() == SegmentType::Flush){
+			this->flush_impl();
+			ret.get_flush_callback()();
+			continue;
+		}
+		if (ret.get_type() == SegmentType::FullFlush){
+			this->flush_impl();
+			if (this->pass_flush())
+				this->pass_full_flush(ret);
+			else
+				ret.get_flush_callback()();
+			continue;
+		}
+		if (ret.get_type() == SegmentType::Data){
+			auto size = ret.get_data().size;
+			this->bytes_read += size;
+			this->stats.segments_read++;
+			this->stats.bytes_read += size;
+		}
+		return ret;
+	}
+}
+
+void StreamProcessor::throw_on_termination(){
+	if (this->stop_requested)
+		throw StreamProcessorStoppingException();
+}
+
+// Sets stop_requested and wakes up the processor if it's waiting on any of
+// its queues.
+void StreamProcessor::request_stop(){
+	this->stop_requested = true;
+	this->attach_event.signal();
+	if (this->source_queue)
+		this->source_queue->interrupt();
+	if (this->sink_queue)
+		this->sink_queue->interrupt();
+	for (auto &queue : this->extra_sink_queues)
+		queue->interrupt();
+}
+
+void StreamProcessor::put_back(Segment &segment){
+	size_t size = 0;
+	if (segment.get_type() == SegmentType::Data)
+		size = segment.get_data().size;
+	this->source_queue->put_back(segment);
+	this->bytes_read -= size;
+	if (size){
+		this->stats.segments_read--;
+		this->stats.bytes_read -= size;
+	}
+}
+
+void StreamProcessor::lightweight_work(){
+	while (true){
+		auto segment = this->read();
+		bool is_eof = segment.get_type() == SegmentType::Eof;
+		this->process_segment(segment);
+		if (is_eof)
+			break;
+	}
+}
+
+bool StreamProcessor::is_fused() const{
+	return this->pipeline->fusion_enabled && this->fusion_allowed && this->is_lightweight();
+}
+
+void StreamProcessor::push_fused(Segment &segment){
+	LOCK_MUTEX(this->fused_mutex);
+	this->throw_on_termination();
+	auto t0 = profiler_clock::now();
+	switch (segment.get_type()){
+		case SegmentType::Flush:
+			this->flush_impl();
+			segment.get_flush_callback()();
+			return;
+		case SegmentType::FullFlush:
+			this->flush_impl();
+			if (this->pass_flush())
+				this->pass_full_flush(segment);
+			else
+				segment.get_flush_callback()();
+			return;
+		case SegmentType::Data:
+			{
+				auto size = segment.get_data().size;
+				this->bytes_read += size;
+				this->stats.segments_read++;
+				this->stats.bytes_read += size;
+			}
+			break;
+		case SegmentType::Eof:
+			break;
+		default:
+			return;
+	}
+	if (this->state == State::Completed)
+		return;
+	bool is_eof = segment.get_type() == SegmentType::Eof;
+	this->process_segment(segment);
+	if (is_eof)
+		this->state = State::Completed;
+	this->stats.work_time += ProcessorStats::elapsed(t0);
+	if (is_eof && cpu_budget)
+		this->report_cpu_usage();
+}
+
+void StreamProcessor::pass_full_flush(Segment &segment){
+	this->write_to(*this->sink_queue, segment);
+}
+
+void StreamProcessor::write_to(Queue &queue, Segment &segment){
+	auto sink = queue.get_sink();
+	auto t0 = profiler_clock::now();
+	if (sink && sink->is_fused()){
+		sink->push_fused(segment);
+		this->stats.fused_time += ProcessorStats::elapsed(t0);
+		return;
+	}
+	auto &running = this->pipeline->busy_threads;
+	ScopedAtomicReversibleSet<State> scope(this->state, State::Yielding, ScopedAtomicReversibleSet<State>::CancelOnException);
+	ScopedDecrement<decltype(running)> inc(running);
+	while (!queue.try_push(segment))
+		this->throw_on_termination();
+	this->stats.backpressured_time += ProcessorStats::elapsed(t0);
+}
+
+void StreamProcessor::write(Segment &segment){
+	bool is_eof = segment.get_type() == SegmentType::Eof;
+	if (!this->pass_eof && is_eof)
+		return;
+	size_t size = 0;
+	if (segment.get_type() == SegmentType::Data)
+		size = segment.get_data().size;
+	this->write_to(*this->sink_queue, segment);
+	// Note: If we get to this point, the segment was definitely pushed. write_to() throws.
+	this->bytes_written += size;
+	if (size){
+		this->stats.segments_written++;
+		this->stats.bytes_written += size;
+	}
+	this->throw_on_termination();
+}
+
+std::shared_ptr<Queue> StreamProcessor::connect_extra_sink(StreamProcessor &sink){
+	zekvok_assert(!sink.source_queue);
+	auto ret = std::make_shared<Queue>();
+	ret->connect(*this, sink);
+	sink.source_queue = ret;
+	sink.attach_event.signal();
+	this->extra_sink_queues.push_back(ret);
+	return ret;
+}
+
+void StreamProcessor::record_cpu_time(CpuStage stage, unsigned threads){
+	cpu_budget->record(stage, this->stats.bytes_read, this->stats.get_active_time() * threads);
+}
+
+void StreamProcessor::notify_thread_creation(){
+	this->pipeline->notify_thread_creation(this);
+}
+
+void StreamProcessor::notify_thread_end(){
+	this->pipeline->notify_thread_end(this);
+}
+
+void StreamProcessor::start(){
+	auto expected = State::Uninitialized;
+	if (!this->state.compare_exchange_strong(expected, State::Starting))
+		return;
+	this->state = State::Starting;
+	if (this->is_fused()){
+		this->state = State::Running;
+		return;
+	}
+#if defined USE_EXECUTOR
+	this->thread = executor->spawn(std::make_unique<std::function<void()>>([this](){ this->thread_func(); }));
+#elif defined USE_THREADPOOL
+	this->thread = thread_pool->allocate_thread();
+	this->thread->run(std::make_unique<std::function<void()>>([this](){ this->thread_func(); }));
+#else
+	this->thread.reset(new std::thread([this](){ this->thread_func(); }));
+#endif
+}
+
+void StreamProcessor::thread_func(){
+	{
+		this->state = State::Running;
+		ScopedAtomicPostSet<State> scope(this->state, State::Completed);
+		auto &running = this->pipeline->busy_threads;
+		ScopedIncrement<decltype(running)> inc(running);
+		auto t0 = profiler_clock::now();
+		try{
+			this->work();
+		}catch (StreamProcessorStoppingException &){
+		}catch (std::exception &e){
+			this->pipeline->set_exception_message((std::string)this->class_name() + ": " + e.what());
+		}
+		this->stats.work_time += ProcessorStats::elapsed(t0);
+		if (cpu_budget)
+			this->report_cpu_usage();
+		this->notify_thread_end();
+	}
+	// Anybody waiting for a flush must now see that the state is Completed.
+	this->flush_event.signal();
+}
+
+void StreamProcessor::join(){
+	if (this->is_fused()){
+		// A fused processor is done when whatever is driving it is done.
+		auto source = this->source_queue ? this->source_queue->get_source() : nullptr;
+		if (source)
+			source->join();
+		if (this->state != State::Ignore)
+			this->state = State::Completed;
+		return;
+	}
+	if (!!this->thread){
+		this->thread->join();
+		this->thread.reset();
+	}
+	this->state = State::Completed;
+}
+
+void StreamProcessor::stop(){
+	if (this->is_fused()){
+		if (this->state == State::Ignore)
+			return;
+		// The upstream processor calls into this one, so it must be stopped
+		// before this processor can go away.
+		this->request_stop();
+		auto source = this->source_queue ? this->source_queue->get_source() : nullptr;
+		if (source)
+			source->stop();
+		this->state = State::Completed;
+		return;
+	}
+	while (true){
+		switch (this->state){
+			case State::Uninitialized:
+				return;
+			case State::Starting:
+				this->join();
+				return;
+			case State::Running:
+			case State::Yielding:
+				this->request_stop();
+			case State::Completed:
+				this->join();
+				return;
+			case State::Ignore:
+				return;
+			default:
+				zekvok_assert(false);
+		}
+	}
+}
+
+#define USE_MACRO
+
+#define CONNECT_SOURCE_SINK(x, y)		\
+	zekvok_assert(!y.x##_queue);		\
+	if (x.y##_queue){					\
+		x.y##_queue->attach_##y(y);		\
+		y.x##_queue = x.y##_queue;		\
+	}else{								\
+		y.x##_queue.reset(new Queue);	\
+		y.x##_queue->attach_##x(x);		\
+		y.x##_queue->attach_##y(y);		\
+		x.y##_queue = y.x##_queue;		\
+	}
+
+void StreamProcessor::connect_to_source(StreamProcessor &p){
+	StreamProcessor &source = p;
+	StreamProcessor &sink = *this;
+	CONNECT_SOURCE_SINK(source, sink);
+	sink.attach_event.signal();
+}
+
+void StreamProcessor::connect_to_sink(StreamProcessor &p){
+	StreamProcessor &sink = p;
+	StreamProcessor &source = *this;
+	CONNECT_SOURCE_SINK(sink, source);
+	sink.attach_event.signal();
+}
+
+// Starts the pipeline and waits until this processor completes. If the
+// processor that would drive this one (this one itself, unless it's fused)
+// hasn't started yet, it's run on the calling thread instead of on a thread
+// of its own.
+void StreamProcessor::drive_to_completion(){
+	StreamProcessor *driver = nullptr;
+	if (this->pipeline->fusion_enabled){
+		driver = this;
+		while (driver && driver->is_fused())
+			driver = driver->source_queue ? driver->source_queue->get_source() : nullptr;
+		auto expected = State::Uninitialized;
+		if (driver && !driver->state.compare_exchange_strong(expected, State::Starting))
+			driver = nullptr;
+	}
+	this->pipeline->start();
+	if (driver)
+		driver->thread_func();
+	this->join();
+}
+
+Segment StreamProcessor::allocate_segment(){
+	auto size = this->segment_size ? this->segment_size : this->pipeline->get_segment_size();
+	if (this->waits_for_memory()){
+		auto t0 = profiler_clock::now();
+		buffer_pool->wait_for_memory(size);
+		this->stats.backpressured_time += ProcessorStats::elapsed(t0);
+	}
+	return this->pipeline->allocate_segment(size);
+}
+
+void StreamPipeline::notify_thread_creation(StreamProcessor *p){
+	std::string name = p->class_name();
+	LOCK_MUTEX(this->processors_mutex);
+	this->processors[(uintptr_t)p] = name;
+}
+
+void StreamPipeline::notify_thread_end(StreamProcessor *p){
+	LOCK_MUTEX(this->processors_mutex);
+	auto it = this->processors.find((uintptr_t)p);
+	if (it == this->processors.end())
+		return;
+	auto &stats = this->stats[it->second];
+	stats.add(p->get_stats());
+	stats.instances++;
+	this->processors.erase(it);
+}
+
+StreamPipeline::StreamPipeline(){
+	this->busy_threads = 0;
+}
+
+StreamPipeline::~StreamPipeline(){
+	for (auto &p : this->stats)
+		profiler.add(p.first, p.second);
+}
+
+void StreamPipeline::start(){
+	this->check_exceptions();
+	LOCK_MUTEX(this->processors_mutex);
+	for (auto &p : this->processors){
+		auto class_name = p.second;
+		((StreamProcessor *)p.first)->start();
+	}
+}
+
+void StreamPipeline::check_exceptions(){
+	decltype(this->exception_message) ex;
+	{
+		LOCK_MUTEX(this->exception_message_mutex);
+		ex = std::move(this->exception_message);
+	}
+	if (ex.is_initialized()){
+		auto message = ex.value();
+		throw StdStringException(message);
+	}
+}
+
+Segment StreamPipeline::allocate_segment(size_t size){
+	return Segment(*this, size);
+}
+
+void StreamPipeline::set_exception_message(const std::string &s){
+	LOCK_MUTEX(this->exception_message_mutex);
+	this->exception_message = s;
+}
+
+FileSource::FileSource(const path_t &path, StreamPipeline &parent): StdStreamSource(parent){
+	std::unique_ptr<std::istream> stream(new boost::filesystem::ifstream(path, std::ios::binary));
+	if (!*stream)
+		throw std::exception("File not found!");
+	stream->seekg(0, std::ios::end);
+	this->stream_size = stream->tellg();
+	stream->seekg(0);
+	this->set_stream(stream);
+}
+
+Sink::~Sink(){
+}
+
+Sink::Sink(Sink &sink): StreamProcessor(sink.get_pipeline()){
+	this->pass_eof = false;
+	this->connect_to_sink(sink);
+}
+
+void Sink::flush(){
+	if (!this->source_queue)
+		return;
+	if (this->is_fused()){
+		if (!this->source_queue->get_source()){
+			Segment eof(SegmentType::Eof);
+			this->push_fused(eof);
+		}else{
+			// Everything the source has written so far has already been
+			// processed.
+			LOCK_MUTEX(this->fused_mutex);
+			this->flush_impl();
+		}
+		return;
+	}
+	if (!this->source_queue->get_source()){
+		Segment eof(SegmentType::Eof);
+		this->source_queue->push(eof);
+		this->join();
+		return;
+	}
+	std::atomic<bool> ready(false);
+	auto cb = std::make_unique<flush_callback_t>([this, &ready]{ ready = true; this->flush_event.signal(); });
+	auto segment = Segment::construct_flush(cb);
+	this->source_queue->push(segment);
+	while (!ready && this->state != State::Completed)
+		this->flush_event.wait();
+	if (!ready)
+		this->flush_impl();
+}
+
+Source::Source(Source &source) : StreamProcessor(source.get_pipeline()){
+	this->connect_to_source(source);
+}
+
+void Source::copy_to(Sink &sink){
+	this->pass_eof = false;
+	this->connect_to_sink(sink);
+	this->drive_to_completion();
+}
+
+void Source::discard_rest(){
+	this->sink_queue.reset();
+	Stream<zstreams::NullSink> null(*this->pipeline);
+	this->copy_to(*null);
+}
+
+SizedSource::~SizedSource(){}
+
+void StdStreamSink::work(){
+	while (true){
+		auto segment = this->read();
+		if (segment.get_type() == SegmentType::Eof)
+			break;
+		auto data = segment.get_data();
+		auto bytes_written = data.size;
+		this->stream->write(reinterpret_cast<const char *>(data.data), data.size);
+		this->report_bytes_written(bytes_written);
+	}
+}
+
+void StdStreamSink::flush_impl(){
+	if (this->stream)
+		this->stream->flush();
+}
+
+void StdStreamSink::set_stream(std::unique_ptr<std::ostream> &stream){
+	this->stream = std::move(stream);
+}
+
+FileSink::FileSink(const path_t &path, StreamPipeline &parent): StdStreamSink(parent){
+	std::unique_ptr<std::ostream> stream(new boost::filesystem::ofstream(path, std::ios::binary));
+	if (!*stream)
+		throw std::exception("Error opening file!");
+	this->set_stream(stream);
+}
+
+void StdStreamSource::work(){
+	while (this->stream){
+		auto segment = this->allocate_segment();
+		auto data = segment.get_data();
+		this->stream->read(reinterpret_cast<char *>(data.data), data.size);
+		auto bytes_read = this->stream->gcount();
+		if (!bytes_read)
+			break;
+		this->report_bytes_read(bytes_read);
+		segment.trim_to_size(bytes_read);
+		this->write(segment);
+	}
+	Segment s(SegmentType::Eof);
+	this->write(s);
+}
+
+void StdStreamSource::set_stream(std::unique_ptr<std::istream> &stream){
+	this->stream = std::move(stream);
+}
+
+SynchronousSourceImpl::SynchronousSourceImpl(Source &source): Source(source){
+}
+
+SynchronousSourceImpl::~SynchronousSourceImpl(){
+	this->state = State::Ignore;
+}
+
+std::streamsize SynchronousSourceImpl::read(char *s, std::streamsize n){
+	if (this->at_eof)
+		return -1;
+	this->pipeline->start();
+	std::streamsize ret = 0;
+	while (n){
+		if (!this->current_segment){
+			this->current_segment = Source::read();
+			if (this->current_segment.get_type() == SegmentType::Eof){
+				if (!ret)
+					return -1;
+				this->at_eof = true;
+				break;
+			}
+		}
+		auto data = this->current_segment.get_data();
+		auto read_size = std::min<size_t>(n, data.size);
+		memcpy(s, data.data, read_size);
+		n -= read_size;
+		s += read_size;
+		ret += read_size;
+		this->current_segment.skip_bytes(read_size);
+		data = this->current_segment.get_data();
+		if (!data.size)
+			this->current_segment = Segment();
+	}
+	return ret;
+}
+
+SynchronousSinkImpl::SynchronousSinkImpl(Sink &sink): Sink(sink){
+	// This adapter produces segments on behalf of the caller, so it uses
+	// whatever size the sink it writes to expects.
+	this->segment_size = sink.get_segment_size();
+}
+
+SynchronousSinkImpl::~SynchronousSinkImpl(){
+	this->try_write(true);
+	this->state = State::Ignore;
+}
+
+std::streamsize SynchronousSinkImpl::write(const char *s, std::streamsize n){
+	this->pipeline->start();
+	std::streamsize ret = 0;
+	while (n){
+		this->ensure_valid_segment();
+		auto data = this->current_segment.get_data();
+		auto write_size = std::min<size_t>(n, data.size - this->offset);
+		memcpy(data.data + this->offset, s, write_size);
+		this->offset += write_size;
+		n -= write_size;
+		s += write_size;
+		ret += write_size;
+		this->try_write();
+	}
+	return ret;
+}
+
+void SynchronousSinkImpl::ensure_valid_segment(){
+	if (!!this->current_segment)
+		return;
+
+	this->current_segment = this->allocate_segment();
+	this->offset = 0;
+}
+
+void SynchronousSinkImpl::try_write(bool force){
+	if (!this->current_segment)
+		return;
+	auto data = this->current_segment.get_data();
+	if (!(force || this->offset == data.size))
+		return;
+	this->current_segment.trim_to_size(this->offset);
+	Sink::write(this->current_segment);
+}
+
+}
@@ -0,0 +1,282 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "../stdafx.h"
+#include "BufferPool.h"
+#include "Threads.h"
+#include "../AutoHandle.h"
+#include "../Utility.h"
+
+std::unique_ptr<BufferPool> buffer_pool;
+
+// Every buffer is preceded by one cache line that holds its header.
+struct BufferHeader{
+	unsigned size_class;
+	std::atomic<unsigned> references;
+};
+
+static_assert(sizeof(BufferHeader) <= BufferPool::alignment, "BufferHeader must fit in one cache line.");
+
+const size_t slab_granularity = 1 << 21;
+
+// Maximum number of free buffers a thread may keep for each size class.
+const size_t thread_cache_limits[BufferPool::SizeClassCount] = {
+	64,
+	16,
+	4,
+};
+
+namespace{
+
+struct ThreadCache{
+	BufferPool *pool = nullptr;
+	std::vector<std::uint8_t *> buffers[BufferPool::SizeClassCount];
+
+	~ThreadCache(){
+		if (!this->pool || this->pool != buffer_pool.get())
+			return;
+		for (unsigned i = 0; i < BufferPool::SizeClassCount; i++)
+			this->pool->give(i, this->buffers[i], this->buffers[i].size());
+	}
+	void bind(BufferPool *pool){
+		if (this->pool == pool)
+			return;
+		// The buffers belonged to a pool that no longer exists.
+		for (auto &v : this->buffers)
+			v.clear();
+		this->pool = pool;
+	}
+};
+
+thread_local ThreadCache thread_cache;
+
+}
+
+size_t BufferPool::get_class_size(unsigned size_class){
+	static const size_t sizes[] = {
+		small_size,
+		medium_size,
+		large_size,
+	};
+	return sizes[size_class];
+}
+
+unsigned BufferPool::get_size_class(size_t size){
+	for (unsigned i = 0; i < SizeClassCount; i++)
+		if (size <= get_class_size(i))
+			return i;
+	// Handing out a smaller buffer than was asked for would let the caller
+	// write past its end.
+	throw IncorrectImplementationException();
+}
+
+BufferPool::BufferPool():
+		use_large_pages(false),
+		memory_limit(0),
+		memory_in_use(0),
+		releases(0),
+		memory_waiters(0),
+		queue_depth(default_queue_depth){
+	this->large_page_size = GetLargePageMinimum();
+}
+
+BufferPool::~BufferPool(){
+	for (auto &slab : this->slabs)
+		VirtualFree(slab.first, 0, MEM_RELEASE);
+}
+
+static bool enable_lock_memory_privilege(){
+	HANDLE token;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+		return false;
+	AutoHandle ah(token);
+	TOKEN_PRIVILEGES tp;
+	tp.PrivilegeCount = 1;
+	tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	if (!LookupPrivilegeValueW(nullptr, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid))
+		return false;
+	if (!AdjustTokenPrivileges(token, false, &tp, 0, nullptr, nullptr))
+		return false;
+	return GetLastError() == ERROR_SUCCESS;
+}
+
+bool BufferPool::set_use_large_pages(bool use){
+	if (use && (!this->large_page_size || !enable_lock_memory_privilege()))
+		use = false;
+	this->use_large_pages = use;
+	return use;
+}
+
+void BufferPool::set_memory_limit(std::uint64_t limit){
+	this->memory_limit = limit;
+	this->memory_released.signal();
+}
+
+// How long wait_for_memory() waits without seeing any buffer released
+// before giving up.
+const unsigned memory_wait_timeout = 1000;
+
+void BufferPool::wait_for_memory(size_t size){
+	size = get_class_size(get_size_class(size));
+	while (true){
+		auto limit = this->memory_limit.load();
+		auto in_use = this->memory_in_use.load();
+		if (!limit || !in_use || in_use + size <= limit)
+			return;
+		auto releases = this->releases.load();
+		this->memory_waiters++;
+		in_use = this->memory_in_use.load();
+		if (!in_use || in_use + size <= limit){
+			this->memory_waiters--;
+			return;
+		}
+		this->memory_released.wait_for(memory_wait_timeout);
+		this->memory_waiters--;
+		if (this->releases == releases)
+			return;
+	}
+}
+
+void BufferPool::set_queue_depth(size_t depth){
+	this->queue_depth = depth ? depth : default_queue_depth;
+}
+
+size_t BufferPool::get_queue_depth(size_t capacity) const{
+	const size_t min_depth = 2;
+	capacity = std::min<size_t>(capacity, this->queue_depth);
+	auto limit = this->memory_limit.load();
+	if (!limit)
+		return capacity;
+	auto in_use = this->memory_in_use.load();
+	// Full depth up to half the limit, then shrink linearly.
+	if (in_use <= limit / 2)
+		return capacity;
+	if (in_use >= limit)
+		return min_depth;
+	auto ret = (size_t)(capacity * (limit - in_use) / (limit / 2));
+	return std::max(ret, min_depth);
+}
+
+void *BufferPool::allocate_pages(size_t &size){
+	if (this->use_large_pages){
+		auto large_size = (size + this->large_page_size - 1) / this->large_page_size * this->large_page_size;
+		auto ret = VirtualAlloc(nullptr, large_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (ret){
+			size = large_size;
+			return ret;
+		}
+		// Large pages can fail at any time due to fragmentation. Don't keep
+		// trying.
+		this->use_large_pages = false;
+	}
+	auto ret = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (!ret)
+		throw std::bad_alloc();
+	return ret;
+}
+
+void BufferPool::allocate_slab(unsigned size_class, std::vector<std::uint8_t *> &dst){
+	auto stride = alignment + get_class_size(size_class);
+	size_t size = std::max(stride * 4, slab_granularity);
+	size = (size + slab_granularity - 1) / slab_granularity * slab_granularity;
+	auto slab = (std::uint8_t *)this->allocate_pages(size);
+	{
+		LOCK_MUTEX(this->slabs_mutex);
+		this->slabs.push_back(std::make_pair(slab, size));
+	}
+	for (size_t offset = 0; offset + stride <= size; offset += stride){
+		auto header = new (slab + offset) BufferHeader;
+		header->size_class = size_class;
+		header->references = 0;
+		dst.push_back(slab + offset + alignment);
+	}
+}
+
+void BufferPool::take(unsigned size_class, std::vector<std::uint8_t *> &dst, size_t count){
+	auto &list = this->free_lists[size_class];
+	LOCK_MUTEX(list.mutex);
+	if (!list.buffers.size())
+		this->allocate_slab(size_class, list.buffers);
+	count = std::min(count, list.buffers.size());
+	dst.insert(dst.end(), list.buffers.end() - count, list.buffers.end());
+	list.buffers.resize(list.buffers.size() - count);
+}
+
+void BufferPool::give(unsigned size_class, std::vector<std::uint8_t *> &src, size_t count){
+	auto &list = this->free_lists[size_class];
+	count = std::min(count, src.size());
+	{
+		LOCK_MUTEX(list.mutex);
+		list.buffers.insert(list.buffers.end(), src.end() - count, src.end());
+	}
+	src.resize(src.size() - count);
+}
+
+static BufferHeader *get_header(const std::uint8_t *buffer){
+	return (BufferHeader *)(buffer - BufferPool::alignment);
+}
+
+unsigned BufferPool::get_buffer_size_class(const std::uint8_t *buffer){
+	return get_header(buffer)->size_class;
+}
+
+void BufferPool::add_reference(std::uint8_t *buffer){
+	get_header(buffer)->references.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool BufferPool::remove_reference(std::uint8_t *buffer){
+	return get_header(buffer)->references.fetch_sub(1, std::memory_order_acq_rel) == 1;
+}
+
+unsigned BufferPool::get_reference_count(const std::uint8_t *buffer){
+	return get_header(buffer)->references.load(std::memory_order_acquire);
+}
+
+std::uint8_t *BufferPool::allocate(unsigned size_class){
+	auto &cache = thread_cache;
+	cache.bind(this);
+	auto &list = cache.buffers[size_class];
+	if (!list.size())
+		this->take(size_class, list, std::max<size_t>(thread_cache_limits[size_class] / 2, 1));
+	auto ret = list.back();
+	list.pop_back();
+	get_header(ret)->references = 1;
+	this->memory_in_use += get_class_size(size_class);
+	return ret;
+}
+
+void BufferPool::release(std::uint8_t *buffer){
+	auto size_class = get_buffer_size_class(buffer);
+	this->memory_in_use -= get_class_size(size_class);
+	if (this->memory_limit){
+		this->releases++;
+		if (this->memory_waiters)
+			this->memory_released.signal();
+	}
+	auto &cache = thread_cache;
+	cache.bind(this);
+	auto &list = cache.buffers[size_class];
+	list.push_back(buffer);
+	auto limit = thread_cache_limits[size_class];
+	if (list.size() > limit)
+		this->give(size_class, list, limit / 2);
+}
+
+PooledBuffer::PooledBuffer(size_t size){
+	auto size_class = BufferPool::get_size_class(size);
+	this->data = buffer_pool->allocate(size_class);
+	this->size = BufferPool::get_class_size(size_class);
+}
+
+void PooledBuffer::reset(){
+	if (!this->data)
+		return;
+	if (BufferPool::remove_reference(this->data))
+		buffer_pool->release(this->data);
+	this->data = nullptr;
+	this->size = 0;
+}
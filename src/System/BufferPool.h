@@ -0,0 +1,154 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#include "Threads.h"
+
+// Process-wide allocator for stream segment buffers. Buffers come in a few
+// fixed size classes and are carved out of large slabs. They're aligned to
+// cache lines and are NOT initialized. Each thread keeps a small cache of
+// free buffers for every size class, so allocating and releasing a buffer
+// normally doesn't take a lock. Buffers are reference counted, so several
+// owners may share one. Slabs are only returned to the system when the pool
+// is destroyed.
+// The pool keeps track of how much memory is in buffers that are in use, and
+// may be given a limit for it. The limit isn't enforced by allocate(). It's
+// up to whoever introduces new data into a pipeline to wait_for_memory(), and
+// up to the queues to shrink as the limit is approached.
+class BufferPool{
+public:
+	static const size_t alignment = 64;
+	enum SizeClass{
+		Small,
+		Medium,
+		Large,
+		SizeClassCount,
+	};
+	static const size_t small_size = 1 << 12;
+	static const size_t medium_size = 1 << 16;
+	static const size_t large_size = 1 << 20;
+	// How many segments a queue holds when nothing else limits it.
+	static const size_t default_queue_depth = 16;
+	static size_t get_class_size(unsigned size_class);
+	// Returns the smallest size class that fits the requested size. Asking
+	// for more than large_size is an error; callers that take sizes from
+	// outside (e.g. from an archive) must check them first.
+	static unsigned get_size_class(size_t size);
+
+private:
+	struct FreeList{
+		std::mutex mutex;
+		std::vector<std::uint8_t *> buffers;
+	};
+	FreeList free_lists[SizeClassCount];
+	std::vector<std::pair<void *, size_t>> slabs;
+	std::mutex slabs_mutex;
+	std::atomic<bool> use_large_pages;
+	size_t large_page_size;
+	std::atomic<std::uint64_t> memory_limit,
+		memory_in_use,
+		releases;
+	std::atomic<unsigned> memory_waiters;
+	std::atomic<size_t> queue_depth;
+	Event memory_released;
+
+	void allocate_slab(unsigned size_class, std::vector<std::uint8_t *> &dst);
+	void *allocate_pages(size_t &size);
+
+public:
+	BufferPool();
+	~BufferPool();
+	BufferPool(const BufferPool &) = delete;
+	void operator=(const BufferPool &) = delete;
+	// Only affects slabs allocated after the call. Returns false if large
+	// pages are not available to this process.
+	bool set_use_large_pages(bool);
+	// Zero means no limit.
+	void set_memory_limit(std::uint64_t);
+	std::uint64_t get_memory_limit() const{
+		return this->memory_limit;
+	}
+	std::uint64_t get_memory_in_use() const{
+		return this->memory_in_use;
+	}
+	// Blocks until a buffer that can hold size bytes can be allocated
+	// without going over the limit. To avoid deadlocks between pipelines, it
+	// gives up if no buffers are released for a while, so the limit may be
+	// exceeded somewhat.
+	void wait_for_memory(size_t size);
+	// Zero restores default_queue_depth.
+	void set_queue_depth(size_t);
+	size_t get_queue_depth_setting() const{
+		return this->queue_depth;
+	}
+	// Returns how many segments a queue that can hold up to capacity
+	// segments should hold, given the queue depth and how close the limit
+	// is.
+	size_t get_queue_depth(size_t capacity) const;
+	std::uint8_t *allocate(unsigned size_class);
+	void release(std::uint8_t *);
+	// Used by the per-thread caches.
+	void take(unsigned size_class, std::vector<std::uint8_t *> &dst, size_t count);
+	void give(unsigned size_class, std::vector<std::uint8_t *> &src, size_t count);
+	static unsigned get_buffer_size_class(const std::uint8_t *);
+	static void add_reference(std::uint8_t *);
+	// Returns true if the caller held the last reference.
+	static bool remove_reference(std::uint8_t *);
+	static unsigned get_reference_count(const std::uint8_t *);
+};
+
+extern std::unique_ptr<BufferPool> buffer_pool;
+
+// Holds a reference to a buffer from buffer_pool. Copies share the buffer.
+class PooledBuffer{
+	std::uint8_t *data = nullptr;
+	size_t size = 0;
+public:
+	PooledBuffer(){}
+	PooledBuffer(size_t size);
+	PooledBuffer(const PooledBuffer &old){
+		*this = old;
+	}
+	PooledBuffer(PooledBuffer &&old){
+		*this = std::move(old);
+	}
+	~PooledBuffer(){
+		this->reset();
+	}
+	const PooledBuffer &operator=(const PooledBuffer &old){
+		if (old.data)
+			BufferPool::add_reference(old.data);
+		this->reset();
+		this->data = old.data;
+		this->size = old.size;
+		return *this;
+	}
+	const PooledBuffer &operator=(PooledBuffer &&old){
+		if (this == &old)
+			return *this;
+		this->reset();
+		this->data = old.data;
+		this->size = old.size;
+		old.data = nullptr;
+		old.size = 0;
+		return *this;
+	}
+	void reset();
+	std::uint8_t *get() const{
+		return this->data;
+	}
+	size_t get_size() const{
+		return this->size;
+	}
+	bool operator!() const{
+		return !this->data;
+	}
+	bool is_shared() const{
+		return this->data && BufferPool::get_reference_count(this->data) > 1;
+	}
+};
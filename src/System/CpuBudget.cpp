@@ -0,0 +1,124 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "../stdafx.h"
+#include "CpuBudget.h"
+#include "Executor.h"
+
+std::unique_ptr<CpuBudget> cpu_budget;
+
+// Until both have been measured, compression is assumed to take this
+// fraction of the CPU time.
+const double default_compression_share = 0.75;
+
+static unsigned get_hardware_threads(){
+	return std::max(std::thread::hardware_concurrency(), 1U);
+}
+
+CpuBudget::CpuBudget(): max_threads(get_hardware_threads()){}
+
+void CpuBudget::set_max_threads(unsigned threads){
+	LOCK_MUTEX(this->mutex);
+	this->max_threads = threads ? threads : get_hardware_threads();
+	this->update_executor();
+}
+
+unsigned CpuBudget::get_max_threads() const{
+	LOCK_MUTEX(this->mutex);
+	return this->max_threads;
+}
+
+void CpuBudget::set_compression_threads(unsigned threads){
+	LOCK_MUTEX(this->mutex);
+	this->compression_threads = threads;
+}
+
+unsigned CpuBudget::get_compression_threads() const{
+	LOCK_MUTEX(this->mutex);
+	return this->compression_threads;
+}
+
+bool CpuBudget::set_priority(CpuPriority priority){
+	LOCK_MUTEX(this->mutex);
+	if (priority == this->priority)
+		return true;
+	auto process = GetCurrentProcess();
+	if (this->priority == CpuPriority::Background)
+		SetPriorityClass(process, PROCESS_MODE_BACKGROUND_END);
+	BOOL success = false;
+	switch (priority){
+		case CpuPriority::Normal:
+			success = SetPriorityClass(process, NORMAL_PRIORITY_CLASS);
+			break;
+		case CpuPriority::Low:
+			success = SetPriorityClass(process, BELOW_NORMAL_PRIORITY_CLASS);
+			break;
+		case CpuPriority::Background:
+			success = SetPriorityClass(process, PROCESS_MODE_BACKGROUND_BEGIN);
+			break;
+	}
+	// Background mode is left above even on failure.
+	this->priority = success ? priority : CpuPriority::Normal;
+	return !!success;
+}
+
+void CpuBudget::record(CpuStage stage, std::uint64_t bytes, std::uint64_t nanoseconds){
+	if (!bytes)
+		return;
+	LOCK_MUTEX(this->mutex);
+	auto &cost = this->costs[(size_t)stage];
+	cost.nanoseconds += nanoseconds;
+	cost.bytes += bytes;
+}
+
+double CpuBudget::get_compression_share() const{
+	double total = 0;
+	double costs[(size_t)CpuStage::Count];
+	for (size_t i = 0; i < (size_t)CpuStage::Count; i++){
+		auto &cost = this->costs[i];
+		costs[i] = cost.bytes ? (double)cost.nanoseconds / cost.bytes : 0;
+		total += costs[i];
+	}
+	auto compression = costs[(size_t)CpuStage::Compression];
+	if (!compression || compression == total)
+		return default_compression_share;
+	return compression / total;
+}
+
+// The mutex must be held.
+void CpuBudget::update_executor(){
+	if (!executor)
+		return;
+	auto threads = this->max_threads > this->granted_threads ? this->max_threads - this->granted_threads : 1;
+	executor->set_thread_limit(threads);
+}
+
+unsigned CpuBudget::acquire_compression_threads(){
+	LOCK_MUTEX(this->mutex);
+	auto wanted = this->compression_threads;
+	if (!wanted)
+		wanted = (unsigned)std::lround(this->max_threads * this->get_compression_share());
+	// At least one thread is left for the executor, which runs everything
+	// else.
+	auto used = this->granted_threads + 1;
+	auto available = this->max_threads > used ? this->max_threads - used : 0;
+	auto ret = std::min(wanted, available);
+	// A single worker would only do what the compressor's own task can.
+	if (ret < 2)
+		return 0;
+	this->granted_threads += ret;
+	this->update_executor();
+	return ret;
+}
+
+void CpuBudget::release_compression_threads(unsigned threads){
+	if (!threads)
+		return;
+	LOCK_MUTEX(this->mutex);
+	this->granted_threads -= threads;
+	this->update_executor();
+}
@@ -0,0 +1,74 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#include "Threads.h"
+
+// The stages whose costs CpuBudget weighs against each other.
+enum class CpuStage{
+	Compression,
+	Hashing,
+	Encryption,
+	Count,
+};
+
+enum class CpuPriority{
+	Normal,
+	// Other programs take precedence for the CPU.
+	Low,
+	// Low CPU, I/O and memory priority, so that the rest of the machine
+	// barely notices the backup.
+	Background,
+};
+
+// Keeps the process within a fixed number of threads doing CPU work. Most of
+// the work (reading, hashing, encryption, writing) is done by tasks on the
+// executor, but compressors run worker threads of their own. Each compressor
+// that wants to run multithreaded is given a share of the budget in
+// proportion to how much CPU time compression takes per byte, compared to
+// hashing and encryption, as measured so far. The executor is limited to
+// whatever the compressors leave.
+class CpuBudget{
+	struct Cost{
+		std::uint64_t nanoseconds = 0,
+			bytes = 0;
+	};
+	mutable std::mutex mutex;
+	unsigned max_threads;
+	unsigned compression_threads = 0;
+	unsigned granted_threads = 0;
+	Cost costs[(size_t)CpuStage::Count];
+	CpuPriority priority = CpuPriority::Normal;
+
+	double get_compression_share() const;
+	void update_executor();
+public:
+	CpuBudget();
+	CpuBudget(const CpuBudget &) = delete;
+	void operator=(const CpuBudget &) = delete;
+	// Zero means one thread per hardware thread.
+	void set_max_threads(unsigned);
+	unsigned get_max_threads() const;
+	// Fixes how many threads compressors ask for, rather than deriving it
+	// from the measurements. They still don't get more than the budget
+	// allows. Zero undoes it.
+	void set_compression_threads(unsigned);
+	unsigned get_compression_threads() const;
+	// Returns false if the priority couldn't be changed.
+	bool set_priority(CpuPriority);
+	// Called by the stages when they finish. nanoseconds is the CPU time
+	// summed over every thread the stage kept busy.
+	void record(CpuStage, std::uint64_t bytes, std::uint64_t nanoseconds);
+	// Returns how many worker threads a new compressor may start. Zero means
+	// it should compress on its own task instead. The threads must be given
+	// back with release_compression_threads().
+	unsigned acquire_compression_threads();
+	void release_compression_threads(unsigned);
+};
+
+extern std::unique_ptr<CpuBudget> cpu_budget;
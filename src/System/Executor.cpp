@@ -0,0 +1,332 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "../stdafx.h"
+#include "Executor.h"
+
+std::unique_ptr<Executor> executor;
+
+// The state of a task is packed together with the ticket of its last
+// suspension, so that a late wake-up meant for an earlier suspension can be
+// told apart and ignored.
+enum class TaskState{
+	Running,
+	// The task is about to switch back to the scheduler.
+	Suspending,
+	Suspended,
+	// The task was woken. If it was woken while still Suspending, the
+	// scheduler puts it back in the ready queue as soon as it switches out.
+	Woken,
+};
+
+static std::uint64_t pack_state(std::uint64_t ticket, TaskState state){
+	return (ticket << 2) | (std::uint64_t)state;
+}
+
+class ExecutorTask{
+public:
+	enum class Exit{
+		Suspend,
+		Finish,
+	};
+
+	Executor *executor;
+	void *fiber = nullptr;
+	std::unique_ptr<std::function<void()>> job;
+	std::shared_ptr<TaskHandle> handle;
+	std::atomic<std::uint64_t> state;
+	std::uint64_t ticket = 0;
+	Exit exit = Exit::Finish;
+	bool timer_set = false;
+	std::multimap<std::chrono::steady_clock::time_point, std::pair<ExecutorTask *, std::uint64_t>>::iterator timer;
+
+	ExecutorTask(Executor *executor): executor(executor), state(0){}
+};
+
+static thread_local ExecutorTask *current_task = nullptr;
+static thread_local void *current_scheduler_fiber = nullptr;
+
+// Fibers are switched to with SwitchToFiber() and never return. A fiber is
+// reused for as many jobs as the executor needs to run.
+static void CALLBACK task_fiber_proc(void *p){
+	auto task = (ExecutorTask *)p;
+	while (true){
+		try{
+			(*task->job)();
+		}catch (...){
+		}
+		task->exit = ExecutorTask::Exit::Finish;
+		SwitchToFiber(current_scheduler_fiber);
+	}
+}
+
+void TaskHandle::join(){
+	while (!this->finished)
+		this->done.wait();
+	// Let any other joiner through.
+	this->done.signal();
+}
+
+Executor::Executor(unsigned threads):
+		ready_count(0),
+		idle_workers(0),
+		next_worker(0),
+		stopping(false){
+	if (!threads)
+		threads = std::max(std::thread::hardware_concurrency(), 2U);
+	this->thread_limit = threads;
+	this->workers.reserve(threads);
+	for (unsigned i = 0; i < threads; i++)
+		this->workers.emplace_back(std::make_unique<Worker>());
+	for (unsigned i = 0; i < threads; i++){
+		auto worker = this->workers[i].get();
+		worker->thread = std::thread([this, worker, i](){ this->worker_func(*worker, i); });
+	}
+}
+
+Executor::~Executor(){
+	this->stopping = true;
+	{
+		std::lock_guard<std::mutex> lock(this->idle_mutex);
+		this->idle_cv.notify_all();
+		this->parked_cv.notify_all();
+	}
+	for (auto &w : this->workers)
+		w->thread.join();
+	for (auto task : this->all_tasks){
+		DeleteFiber(task->fiber);
+		delete task;
+	}
+}
+
+std::shared_ptr<TaskHandle> Executor::spawn(std::unique_ptr<std::function<void()>> &&job){
+	ExecutorTask *task = nullptr;
+	{
+		LOCK_MUTEX(this->tasks_mutex);
+		if (this->free_tasks.size()){
+			task = this->free_tasks.back();
+			this->free_tasks.pop_back();
+		}
+	}
+	if (!task){
+		std::unique_ptr<ExecutorTask> new_task(new ExecutorTask(this));
+		new_task->fiber = CreateFiber(0, task_fiber_proc, new_task.get());
+		if (!new_task->fiber)
+			throw std::exception("Failed to create a fiber.");
+		task = new_task.release();
+		LOCK_MUTEX(this->tasks_mutex);
+		this->all_tasks.push_back(task);
+	}
+	task->job = std::move(job);
+	task->handle = std::make_shared<TaskHandle>();
+	task->state = pack_state(task->ticket, TaskState::Running);
+	auto ret = task->handle;
+	this->schedule(task);
+	return ret;
+}
+
+void Executor::recycle(ExecutorTask *task){
+	auto handle = std::move(task->handle);
+	task->job.reset();
+	{
+		LOCK_MUTEX(this->tasks_mutex);
+		this->free_tasks.push_back(task);
+	}
+	handle->finished = true;
+	handle->done.signal();
+}
+
+void Executor::schedule(ExecutorTask *task){
+	Worker *worker = nullptr;
+	for (auto &w : this->workers){
+		if (w->scheduler_fiber && w->scheduler_fiber == current_scheduler_fiber){
+			worker = w.get();
+			break;
+		}
+	}
+	if (!worker)
+		worker = this->workers[this->next_worker++ % this->thread_limit].get();
+	{
+		LOCK_MUTEX(worker->mutex);
+		worker->ready.push_back(task);
+	}
+	this->ready_count++;
+	if (this->idle_workers){
+		std::lock_guard<std::mutex> lock(this->idle_mutex);
+		this->idle_cv.notify_one();
+	}
+}
+
+ExecutorTask *Executor::get_ready_task(Worker &worker){
+	ExecutorTask *ret = nullptr;
+	if (!this->ready_count)
+		return ret;
+	{
+		// Tasks are long-lived loops that are woken over and over, so the
+		// local queue is FIFO to keep any of them from starving.
+		LOCK_MUTEX(worker.mutex);
+		if (worker.ready.size()){
+			ret = worker.ready.front();
+			worker.ready.pop_front();
+		}
+	}
+	auto n = this->workers.size();
+	auto start = this->next_worker++;
+	for (size_t i = 0; !ret && i < n; i++){
+		auto &victim = *this->workers[(start + i) % n];
+		if (&victim == &worker)
+			continue;
+		LOCK_MUTEX(victim.mutex);
+		if (victim.ready.size()){
+			ret = victim.ready.back();
+			victim.ready.pop_back();
+		}
+	}
+	if (ret)
+		this->ready_count--;
+	return ret;
+}
+
+void Executor::run(Worker &worker, ExecutorTask *task){
+	current_task = task;
+	SwitchToFiber(task->fiber);
+	current_task = nullptr;
+	if (task->exit == ExecutorTask::Exit::Finish){
+		this->recycle(task);
+		return;
+	}
+	auto expected = pack_state(task->ticket, TaskState::Suspending);
+	if (!task->state.compare_exchange_strong(expected, pack_state(task->ticket, TaskState::Suspended))){
+		// Woken before it could be suspended.
+		LOCK_MUTEX(worker.mutex);
+		worker.ready.push_back(task);
+		this->ready_count++;
+	}
+}
+
+void Executor::fire_timers(){
+	LOCK_MUTEX(this->timers_mutex);
+	auto now = clock::now();
+	while (this->timers.size() && this->timers.begin()->first <= now){
+		auto entry = this->timers.begin()->second;
+		this->timers.erase(this->timers.begin());
+		entry.first->timer_set = false;
+		wake(entry.first, entry.second);
+	}
+}
+
+Executor::clock::time_point Executor::get_next_deadline(){
+	LOCK_MUTEX(this->timers_mutex);
+	if (this->timers.size())
+		return this->timers.begin()->first;
+	return clock::time_point::max();
+}
+
+void Executor::set_thread_limit(unsigned threads){
+	threads = std::max(std::min(threads, (unsigned)this->workers.size()), 1U);
+	std::lock_guard<std::mutex> lock(this->idle_mutex);
+	this->thread_limit = threads;
+	this->parked_cv.notify_all();
+	// Idle threads beyond the limit must wake up to park.
+	this->idle_cv.notify_all();
+}
+
+// Returns false if the executor is stopping. Parked threads wait on their
+// own condition variable, so that schedule() never wakes one of them
+// instead of an active thread.
+bool Executor::park(unsigned index){
+	std::unique_lock<std::mutex> lock(this->idle_mutex);
+	// Tasks that were left in this thread's queue are stolen by the others.
+	if (this->ready_count)
+		this->idle_cv.notify_all();
+	while (!this->stopping && index >= this->thread_limit)
+		this->parked_cv.wait(lock);
+	return !this->stopping;
+}
+
+void Executor::worker_func(Worker &worker, unsigned index){
+	worker.scheduler_fiber = ConvertThreadToFiber(nullptr);
+	current_scheduler_fiber = worker.scheduler_fiber;
+	while (true){
+		if (index >= this->thread_limit && !this->park(index))
+			break;
+		this->fire_timers();
+		auto task = this->get_ready_task(worker);
+		if (task){
+			this->run(worker, task);
+			continue;
+		}
+		auto deadline = this->get_next_deadline();
+		std::unique_lock<std::mutex> lock(this->idle_mutex);
+		if (this->stopping)
+			break;
+		this->idle_workers++;
+		if (!this->ready_count){
+			if (deadline == clock::time_point::max())
+				this->idle_cv.wait(lock);
+			else
+				this->idle_cv.wait_until(lock, deadline);
+		}
+		this->idle_workers--;
+	}
+	current_scheduler_fiber = nullptr;
+	ConvertFiberToThread();
+}
+
+ExecutorTask *Executor::get_current_task(){
+	return current_task;
+}
+
+std::uint64_t Executor::prepare_suspend(){
+	auto task = current_task;
+	auto ticket = ++task->ticket;
+	task->state = pack_state(ticket, TaskState::Suspending);
+	return ticket;
+}
+
+void Executor::suspend(unsigned timeout_ms){
+	auto task = current_task;
+	auto executor = task->executor;
+	bool timed = timeout_ms != infinite;
+	if (timed){
+		auto deadline = clock::now() + std::chrono::milliseconds(timeout_ms);
+		LOCK_MUTEX(executor->timers_mutex);
+		task->timer = executor->timers.insert(std::make_pair(deadline, std::make_pair(task, task->ticket)));
+		task->timer_set = true;
+	}
+	task->exit = ExecutorTask::Exit::Suspend;
+	SwitchToFiber(current_scheduler_fiber);
+	// At this point the task may be running on a different thread.
+	if (timed){
+		LOCK_MUTEX(executor->timers_mutex);
+		if (task->timer_set){
+			executor->timers.erase(task->timer);
+			task->timer_set = false;
+		}
+	}
+	task->state = pack_state(task->ticket, TaskState::Running);
+}
+
+void Executor::wake(ExecutorTask *task, std::uint64_t ticket){
+	auto state = task->state.load();
+	while (state >> 2 == ticket){
+		switch ((TaskState)(state & 3)){
+			case TaskState::Suspending:
+				if (task->state.compare_exchange_weak(state, pack_state(ticket, TaskState::Woken)))
+					return;
+				break;
+			case TaskState::Suspended:
+				if (task->state.compare_exchange_weak(state, pack_state(ticket, TaskState::Woken))){
+					task->executor->schedule(task);
+					return;
+				}
+				break;
+			default:
+				return;
+		}
+	}
+}
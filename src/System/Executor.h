@@ -0,0 +1,105 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#include "Threads.h"
+
+class ExecutorTask;
+
+class TaskHandle{
+	friend class Executor;
+	std::atomic<bool> finished;
+	Event done;
+public:
+	TaskHandle(): finished(false){}
+	TaskHandle(const TaskHandle &) = delete;
+	void operator=(const TaskHandle &) = delete;
+	// Waits until the job has returned. May be called from another task.
+	void join();
+};
+
+// Runs jobs as cooperative tasks on a fixed number of threads (one per
+// core, by default). Each task runs on a fiber of its own. When a task waits
+// on an Event (e.g. because the queue it reads from is empty or the one it
+// writes to is full) it's suspended and its thread moves on to other tasks,
+// so the number of threads doesn't depend on how many tasks are alive. Each
+// thread keeps its own queue of ready tasks and steals from the others when
+// it runs out. Some of the threads may be parked, to keep the process within
+// a CPU budget (see CpuBudget).
+//
+// A suspended task may be resumed by a different thread than the one that
+// suspended it, so tasks must not hold a std::mutex (use TaskMutex) across a
+// wait. For the same reason, the project must be compiled with fiber-safe
+// optimizations (/GT), so that addresses of thread_local variables aren't
+// cached across calls that may suspend.
+class Executor{
+	struct Worker{
+		std::mutex mutex;
+		std::deque<ExecutorTask *> ready;
+		std::thread thread;
+		void *scheduler_fiber = nullptr;
+	};
+	typedef std::chrono::steady_clock clock;
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<size_t> ready_count;
+	std::atomic<unsigned> idle_workers;
+	std::atomic<unsigned> next_worker;
+	std::atomic<bool> stopping;
+	std::atomic<unsigned> thread_limit;
+	std::mutex idle_mutex;
+	std::condition_variable idle_cv,
+		parked_cv;
+	std::multimap<clock::time_point, std::pair<ExecutorTask *, std::uint64_t>> timers;
+	std::mutex timers_mutex;
+	std::vector<ExecutorTask *> all_tasks,
+		free_tasks;
+	std::mutex tasks_mutex;
+
+	void worker_func(Worker &, unsigned index);
+	bool park(unsigned index);
+	ExecutorTask *get_ready_task(Worker &);
+	void run(Worker &, ExecutorTask *);
+	void schedule(ExecutorTask *);
+	void fire_timers();
+	clock::time_point get_next_deadline();
+	void recycle(ExecutorTask *);
+
+public:
+	static const unsigned infinite = Event::infinite;
+
+	// Zero means one thread per hardware thread.
+	Executor(unsigned threads = 0);
+	~Executor();
+	Executor(const Executor &) = delete;
+	void operator=(const Executor &) = delete;
+	std::shared_ptr<TaskHandle> spawn(std::unique_ptr<std::function<void()>> &&);
+	// Returns how many threads may run tasks at once.
+	size_t get_thread_count() const{
+		return this->thread_limit;
+	}
+	// Parks the threads beyond the first threads, once they finish their
+	// current tasks. The limit is clamped to the number of threads the
+	// executor was created with.
+	void set_thread_limit(unsigned threads);
+
+	// The functions below implement waiting on behalf of Event.
+
+	// Returns null if the caller isn't running as a task.
+	static ExecutorTask *get_current_task();
+	// Must be called by the current task before it makes itself visible to
+	// whoever will wake it. Returns a ticket to pass to wake().
+	static std::uint64_t prepare_suspend();
+	// Suspends the current task until wake() is called with the ticket
+	// returned by the last prepare_suspend(), or until the timeout expires.
+	static void suspend(unsigned timeout_ms);
+	// Does nothing if the task has already been woken for this ticket.
+	static void wake(ExecutorTask *, std::uint64_t ticket);
+};
+
+extern std::unique_ptr<Executor> executor;
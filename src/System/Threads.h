@@ -1,166 +1,349 @@
-/*
-Copyright (c), Helios
-All rights reserved.
-
-Distributed under a permissive license. See COPYING.txt for details.
-*/
-
-#pragma once
-
-#define LOCK_MUTEX(x) std::lock_guard<decltype(x)> _CONCAT(LOCK_MUTEX_lock, __COUNTER__)(x)
-
-class Event{
-	bool signalled = false;
-	std::mutex mutex;
-	std::condition_variable cv;
-public:
-	void signal();
-	void wait();
-	void wait_for(unsigned ms);
-};
-
-class QueueBeingDestructed : public std::exception{
-public:
-	const char *what() const{
-		return "An attempt to pop a thread-safe queue could not be completed because the queue is being destructed.";
-	}
-};
-
-template <typename T>
-class CircularQueue{
-	std::unique_ptr<T[]> datap;
-	T *data;
-	size_t head, tail;
-	size_t size;
-	const size_t capacity;
-	std::mutex mutex;
-	Event pop_notification,
-		push_notification;
-
-public:
-	CircularQueue(size_t max_size):
-		datap(new T[max_size]),
-		data(datap.get()),
-		head(0),
-		tail(0),
-		size(0),
-		capacity(max_size){}
-	bool try_push(T &i, unsigned timeout_ms = 100){
-		const auto n = this->capacity;
-		for (int j = 0; ;){
-			{
-				LOCK_MUTEX(this->mutex);
-				if (this->size < n){
-					this->data[this->tail++ % n] = std::move(i);
-					this->tail %= n;
-					this->size++;
-					this->push_notification.signal();
-					return true;
-				}
-			}
-			if (++j == 2)
-				break;
-			this->pop_notification.wait_for(timeout_ms);
-		}
-		return false;
-	}
-	bool try_pop(T &dst, unsigned timeout_ms = 100){
-		const auto n = this->capacity;
-		for (int j = 0; ;){
-			{
-				LOCK_MUTEX(this->mutex);
-				if (this->size){
-					dst = std::move(this->data[this->head++]);
-					this->head %= n;
-					this->size--;
-					this->pop_notification.signal();
-					return true;
-				}
-			}
-			if (++j == 2)
-				break;
-			this->push_notification.wait_for(timeout_ms);
-		}
-		return false;
-	}
-};
-
-class ThreadPool;
-
-class PooledThread{
-	friend class ThreadWrapper;
-	std::shared_ptr<std::thread> thread;
-	Event requested_state_cv,
-		reported_state_cv;
-	enum class RequestedState{
-		None,
-		JobReady,
-		Terminate,
-	};
-	enum class ReportedState{
-		WaitingForJob,
-		RunningJob,
-		Stopping,
-		Stopped,
-	};
-	std::atomic<RequestedState> requested_state;
-	std::atomic<ReportedState> reported_state;
-	std::unique_ptr<std::function<void()>> job;
-	ThreadPool *pool = nullptr;
-
-	void thread_func();
-	void thread_func2();
-	bool wait_for_request();
-	void wait_for_none();
-public:
-	PooledThread(ThreadPool *pool);
-	PooledThread(const PooledThread &) = delete;
-	PooledThread(PooledThread &&) = delete;
-	~PooledThread();
-	void set_pool(ThreadPool *pool){
-		this->pool = pool;
-	}
-	void stop();
-	void join();
-	void run(std::unique_ptr<std::function<void()>> &&);
-};
-
-class ThreadWrapper{
-	PooledThread *thread = nullptr;
-public:
-	ThreadWrapper(){}
-	ThreadWrapper(PooledThread *thread): thread(thread){}
-	ThreadWrapper(ThreadWrapper &&tw): thread(nullptr){
-		*this = std::move(tw);
-	}
-	const ThreadWrapper &operator=(ThreadWrapper &&tw){
-		this->thread = tw.thread;
-		tw.thread = nullptr;
-		return *this;
-	}
-	const ThreadWrapper &operator=(const ThreadWrapper &) = delete;
-	~ThreadWrapper();
-	PooledThread &operator*() const{
-		return *this->thread;
-	}
-	PooledThread *operator->() const{
-		return this->thread;
-	}
-	bool operator!() const{
-		return !this->thread;
-	}
-	void reset();
-};
-
-class ThreadPool{
-	std::vector<std::shared_ptr<PooledThread>> all_threads;
-	std::vector<PooledThread *> inactive_threads;
-	std::mutex mutex;
-public:
-	ThreadPool();
-	~ThreadPool();
-	ThreadWrapper allocate_thread();
-	void release_thread(PooledThread *);
-};
-
-extern std::unique_ptr<ThreadPool> thread_pool;
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#define LOCK_MUTEX(x) std::lock_guard<decltype(x)> _CONCAT(LOCK_MUTEX_lock, __COUNTER__)(x)
+
+class ExecutorTask;
+
+// Auto-reset event. If the waiter is running as an executor task (see
+// Executor.h), it's suspended rather than blocking its thread.
+class Event{
+	bool signalled = false;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<std::pair<ExecutorTask *, std::uint64_t>> suspended_tasks;
+
+	bool suspend_task(unsigned ms);
+public:
+	static const unsigned infinite = std::numeric_limits<unsigned>::max();
+
+	void signal();
+	void wait();
+	// Waits until the event is signalled or until the timeout expires. An
+	// infinite timeout is the same as wait().
+	void wait_for(unsigned ms);
+};
+
+// Unlike std::mutex, it may be released by a thread other than the one that
+// acquired it, which happens when an executor task that holds it is
+// suspended and later resumed elsewhere. Contention is expected to be rare.
+class TaskMutex{
+	std::atomic<bool> locked;
+	Event released;
+public:
+	TaskMutex(): locked(false){}
+	TaskMutex(const TaskMutex &) = delete;
+	void operator=(const TaskMutex &) = delete;
+	void lock(){
+		while (this->locked.exchange(true, std::memory_order_acquire))
+			this->released.wait();
+	}
+	void unlock(){
+		this->locked.store(false, std::memory_order_release);
+		this->released.signal();
+	}
+};
+
+class QueueBeingDestructed : public std::exception{
+public:
+	const char *what() const{
+		return "An attempt to pop a thread-safe queue could not be completed because the queue is being destructed.";
+	}
+};
+
+template <typename T>
+class CircularQueue{
+	std::unique_ptr<T[]> datap;
+	T *data;
+	size_t head, tail;
+	size_t size;
+	const size_t capacity;
+	std::mutex mutex;
+	Event pop_notification,
+		push_notification;
+
+public:
+	CircularQueue(size_t max_size):
+		datap(new T[max_size]),
+		data(datap.get()),
+		head(0),
+		tail(0),
+		size(0),
+		capacity(max_size){}
+	// Wakes up any thread waiting on the queue, whose call then fails.
+	void interrupt(){
+		this->pop_notification.signal();
+		this->push_notification.signal();
+	}
+	bool try_push(T &i, unsigned timeout_ms = 100){
+		const auto n = this->capacity;
+		for (int j = 0; ;){
+			{
+				LOCK_MUTEX(this->mutex);
+				if (this->size < n){
+					this->data[this->tail++ % n] = std::move(i);
+					this->tail %= n;
+					this->size++;
+					this->push_notification.signal();
+					return true;
+				}
+			}
+			if (++j == 2)
+				break;
+			this->pop_notification.wait_for(timeout_ms);
+		}
+		return false;
+	}
+	bool try_pop(T &dst, unsigned timeout_ms = 100){
+		const auto n = this->capacity;
+		for (int j = 0; ;){
+			{
+				LOCK_MUTEX(this->mutex);
+				if (this->size){
+					dst = std::move(this->data[this->head++]);
+					this->head %= n;
+					this->size--;
+					this->pop_notification.signal();
+					return true;
+				}
+			}
+			if (++j == 2)
+				break;
+			this->push_notification.wait_for(timeout_ms);
+		}
+		return false;
+	}
+};
+
+// Lock-free single-producer/single-consumer ring buffer. At most one thread
+// may push and at most one thread may pop at any given time (the threads may
+// change over time, as long as the hand-off is otherwise synchronized).
+// The producer and consumer indices live on separate cache lines, and each
+// side keeps a private copy of the other side's index, so the shared line is
+// only touched when the queue looks full (or empty). A side only parks when
+// the queue is actually full (or empty), and the other side only pays for a
+// wake-up when somebody is actually parked. A parked producer is only woken
+// once the consumer has freed half the ring, so that it publishes in batches
+// rather than ping-ponging one element at a time.
+template <typename T>
+class SpscQueue{
+	static const size_t cache_line_size = 64;
+
+	std::unique_ptr<T[]> datap;
+	T *data;
+	const size_t capacity;
+	const size_t mask;
+	// May be lowered below the capacity to make the queue shallower.
+	std::atomic<size_t> limit;
+	char padding0[cache_line_size];
+
+	// Owned by the consumer.
+	std::atomic<size_t> head;
+	size_t cached_tail;
+	char padding1[cache_line_size];
+
+	// Owned by the producer.
+	std::atomic<size_t> tail;
+	size_t cached_head;
+	char padding2[cache_line_size];
+
+	std::atomic<bool> consumer_parked,
+		producer_parked;
+	Event pop_notification,
+		push_notification;
+
+	static size_t round_up_capacity(size_t n){
+		size_t ret = 1;
+		while (ret < n)
+			ret <<= 1;
+		return ret;
+	}
+	bool push_nonblocking(T &i){
+		auto tail = this->tail.load(std::memory_order_relaxed);
+		auto limit = this->limit.load(std::memory_order_relaxed);
+		if (tail - this->cached_head >= limit){
+			this->cached_head = this->head.load(std::memory_order_acquire);
+			if (tail - this->cached_head >= limit)
+				return false;
+		}
+		this->data[tail & this->mask] = std::move(i);
+		this->tail.store(tail + 1, std::memory_order_release);
+		// Pairs with the fence in pop(). Either the consumer sees the new tail
+		// before parking, or we see that it's parked.
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (this->consumer_parked.load(std::memory_order_relaxed) && this->consumer_parked.exchange(false))
+			this->push_notification.signal();
+		return true;
+	}
+	bool pop_nonblocking(T &dst){
+		auto head = this->head.load(std::memory_order_relaxed);
+		if (head == this->cached_tail){
+			this->cached_tail = this->tail.load(std::memory_order_acquire);
+			if (head == this->cached_tail)
+				return false;
+		}
+		dst = std::move(this->data[head & this->mask]);
+		this->head.store(head + 1, std::memory_order_release);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (this->producer_parked.load(std::memory_order_relaxed)){
+			auto used = this->tail.load(std::memory_order_relaxed) - (head + 1);
+			if (used <= this->limit.load(std::memory_order_relaxed) / 2 && this->producer_parked.exchange(false))
+				this->pop_notification.signal();
+		}
+		return true;
+	}
+
+public:
+	SpscQueue(size_t max_size):
+			capacity(round_up_capacity(max_size)),
+			mask(round_up_capacity(max_size) - 1),
+			limit(round_up_capacity(max_size)),
+			cached_tail(0),
+			cached_head(0){
+		this->datap.reset(new T[this->capacity]);
+		this->data = this->datap.get();
+		this->head = 0;
+		this->tail = 0;
+		this->consumer_parked = false;
+		this->producer_parked = false;
+	}
+	SpscQueue(const SpscQueue &) = delete;
+	void operator=(const SpscQueue &) = delete;
+	size_t get_capacity() const{
+		return this->capacity;
+	}
+	// Only affects pushes. Segments already in the queue stay there.
+	void set_limit(size_t limit){
+		this->limit.store(std::max<size_t>(std::min(limit, this->capacity), 1), std::memory_order_relaxed);
+	}
+	// Approximate. Exact only when called by the producer or the consumer
+	// while the other side is idle.
+	size_t size() const{
+		return this->tail.load(std::memory_order_relaxed) - this->head.load(std::memory_order_relaxed);
+	}
+	// Wakes up any thread waiting on the queue, whose call then fails.
+	void interrupt(){
+		this->pop_notification.signal();
+		this->push_notification.signal();
+	}
+	bool try_push(T &i, unsigned timeout_ms = 100){
+		for (int j = 0; ;){
+			if (this->push_nonblocking(i))
+				return true;
+			if (++j == 2)
+				break;
+			this->producer_parked = true;
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (this->push_nonblocking(i)){
+				this->producer_parked = false;
+				return true;
+			}
+			this->pop_notification.wait_for(timeout_ms);
+			this->producer_parked = false;
+		}
+		return false;
+	}
+	bool try_pop(T &dst, unsigned timeout_ms = 100){
+		for (int j = 0; ;){
+			if (this->pop_nonblocking(dst))
+				return true;
+			if (++j == 2)
+				break;
+			this->consumer_parked = true;
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (this->pop_nonblocking(dst)){
+				this->consumer_parked = false;
+				return true;
+			}
+			this->push_notification.wait_for(timeout_ms);
+			this->consumer_parked = false;
+		}
+		return false;
+	}
+};
+
+class ThreadPool;
+
+class PooledThread{
+	friend class ThreadWrapper;
+	std::shared_ptr<std::thread> thread;
+	Event requested_state_cv,
+		reported_state_cv;
+	enum class RequestedState{
+		None,
+		JobReady,
+		Terminate,
+	};
+	enum class ReportedState{
+		WaitingForJob,
+		RunningJob,
+		Stopping,
+		Stopped,
+	};
+	std::atomic<RequestedState> requested_state;
+	std::atomic<ReportedState> reported_state;
+	std::unique_ptr<std::function<void()>> job;
+	ThreadPool *pool = nullptr;
+
+	void thread_func();
+	void thread_func2();
+	bool wait_for_request();
+	void wait_for_none();
+public:
+	PooledThread(ThreadPool *pool);
+	PooledThread(const PooledThread &) = delete;
+	PooledThread(PooledThread &&) = delete;
+	~PooledThread();
+	void set_pool(ThreadPool *pool){
+		this->pool = pool;
+	}
+	void stop();
+	void join();
+	void run(std::unique_ptr<std::function<void()>> &&);
+};
+
+class ThreadWrapper{
+	PooledThread *thread = nullptr;
+public:
+	ThreadWrapper(){}
+	ThreadWrapper(PooledThread *thread): thread(thread){}
+	ThreadWrapper(ThreadWrapper &&tw): thread(nullptr){
+		*this = std::move(tw);
+	}
+	const ThreadWrapper &operator=(ThreadWrapper &&tw){
+		this->thread = tw.thread;
+		tw.thread = nullptr;
+		return *this;
+	}
+	const ThreadWrapper &operator=(const ThreadWrapper &) = delete;
+	~ThreadWrapper();
+	PooledThread &operator*() const{
+		return *this->thread;
+	}
+	PooledThread *operator->() const{
+		return this->thread;
+	}
+	bool operator!() const{
+		return !this->thread;
+	}
+	void reset();
+};
+
+class ThreadPool{
+	std::vector<std::shared_ptr<PooledThread>> all_threads;
+	std::vector<PooledThread *> inactive_threads;
+	std::mutex mutex;
+public:
+	ThreadPool();
+	~ThreadPool();
+	ThreadWrapper allocate_thread();
+	void release_thread(PooledThread *);
+};
+
+extern std::unique_ptr<ThreadPool> thread_pool;
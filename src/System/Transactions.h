@@ -1,29 +1,33 @@
-/*
-Copyright (c), Helios
-All rights reserved.
-
-Distributed under a permissive license. See COPYING.txt for details.
-*/
-
-#pragma once
-
-class KernelTransaction{
-	HANDLE tx;
-	void commit();
-	void rollback();
-	void release();
-public:
-	KernelTransaction();
-	KernelTransaction(const KernelTransaction &) = delete;
-	~KernelTransaction();
-	HANDLE get_handle() const{
-		return this->tx;
-	}
-};
-
-class TransactedFileSink : public boost::iostreams::sink{
-	std::shared_ptr<HANDLE> handle;
-public:
-	TransactedFileSink(const KernelTransaction &tx, const wchar_t *path);
-	std::streamsize write(const char* s, std::streamsize n);
-};
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+class KernelTransaction{
+	HANDLE tx;
+	void commit();
+	void rollback();
+	void release();
+public:
+	KernelTransaction();
+	KernelTransaction(const KernelTransaction &) = delete;
+	~KernelTransaction();
+	HANDLE get_handle() const{
+		return this->tx;
+	}
+};
+
+class TransactedFileSink : public boost::iostreams::sink{
+	std::shared_ptr<HANDLE> handle;
+public:
+	// If append is false, the file is truncated.
+	TransactedFileSink(const KernelTransaction &tx, const wchar_t *path, bool append = true);
+	std::streamsize write(const char* s, std::streamsize n);
+};
+
+// Replaces dst with src, as part of the transaction.
+void transacted_move(const KernelTransaction &tx, const wchar_t *src, const wchar_t *dst);
@@ -0,0 +1,118 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#include "StreamProcessor.h"
+
+namespace zstreams{
+
+// Passes every segment through to its normal output, and also sends a view
+// of it (see Segment::clone()) to any number of branch sinks. Branches that
+// aren't fused run in parallel with the main output and with each other.
+// The branches belong to the tee, so they always get Eof when it does, even
+// if the normal output doesn't (as with a TeeSink, whose output is shared).
+// A FullFlush is sent to every output, and its callback runs once all of
+// them have processed it. A Flush is local, as usual.
+template <typename Base>
+class TeeFilter : public Base{
+	std::vector<std::shared_ptr<Queue>> branches;
+	bool branches_ended = false;
+
+	LIGHTWEIGHT_PROCESSOR
+	void process_segment(Segment &segment) override{
+		if (segment.get_type() == SegmentType::Eof)
+			this->send_eof_to_branches();
+		else{
+			for (auto &branch : this->branches){
+				auto view = segment.clone();
+				this->write_to(*branch, view);
+			}
+		}
+		this->write(segment);
+	}
+	void pass_full_flush(Segment &segment) override{
+		if (!this->branches.size()){
+			Base::pass_full_flush(segment);
+			return;
+		}
+		auto remaining = std::make_shared<std::atomic<size_t>>(this->branches.size() + 1);
+		auto callback = std::make_shared<flush_callback_t>(std::move(segment.get_flush_callback()));
+		auto f = [remaining, callback](){
+			if (!--*remaining)
+				(*callback)();
+		};
+		for (auto &branch : this->branches){
+			auto cb = std::make_unique<flush_callback_t>(f);
+			auto s = Segment::construct_full_flush(cb);
+			this->write_to(*branch, s);
+		}
+		auto cb = std::make_unique<flush_callback_t>(f);
+		auto s = Segment::construct_full_flush(cb);
+		Base::pass_full_flush(s);
+	}
+protected:
+	void send_eof_to_branches(){
+		if (this->branches_ended)
+			return;
+		this->branches_ended = true;
+		for (auto &branch : this->branches){
+			Segment eof(SegmentType::Eof);
+			this->write_to(*branch, eof);
+		}
+	}
+	void join_branches(){
+		for (auto &branch : this->branches){
+			auto sink = branch->get_sink();
+			if (!sink)
+				continue;
+			// If nothing was ever written to the tee, the pipeline may not
+			// have started the branch, and it would never see the Eof.
+			sink->start();
+			sink->join();
+		}
+	}
+public:
+	template <typename T>
+	TeeFilter(T &main): Base(main){}
+	virtual ~TeeFilter(){
+		StreamProcessor::stop();
+		for (auto &branch : this->branches)
+			branch->detach_source();
+	}
+	void add_branch(Sink &sink){
+		this->branches.push_back(this->connect_extra_sink(sink));
+	}
+};
+
+class TeeSink : public TeeFilter<Sink>{
+public:
+	TeeSink(Sink &main): TeeFilter<Sink>(main){}
+	// A TeeSink written to with copy_to() never sees the end of its input,
+	// so whoever writes to it must call this once it's done. Sends Eof to the
+	// branches after everything written so far, and waits until they've
+	// processed it, so that whatever they compute (e.g. a digest) is
+	// complete.
+	void end_branches(){
+		this->flush();
+		this->send_eof_to_branches();
+		this->join_branches();
+	}
+	const char *class_name() const override{
+		return "TeeSink";
+	}
+};
+
+class TeeSource : public TeeFilter<Source>{
+public:
+	TeeSource(Source &upstream): TeeFilter<Source>(upstream){}
+	const char *class_name() const override{
+		return "TeeSource";
+	}
+};
+
+}
@@ -1,44 +1,52 @@
-/*
-Copyright (c), Helios
-All rights reserved.
-
-Distributed under a permissive license. See COPYING.txt for details.
-*/
-
-#include "stdafx.h"
-#include "Utility.h"
-
-std::set<std::wstring, strcmpci> known_text_extensions = {
-	L"asm",
-	L"bat",
-	L"c",
-	L"cpp",
-	L"cs",
-	L"cxx",
-	L"f",
-	L"gcl",
-	L"gitignore",
-	L"gitmodules",
-	L"h",
-	L"hpp",
-	L"hs",
-	L"htm",
-	L"html",
-	L"hxx",
-	L"java",
-	L"js",
-	L"log",
-	L"lua",
-	L"pas",
-	L"py",
-	L"qbk",
-	L"s",
-	L"sh",
-	L"ss",
-	L"txt",
-	L"xml",
-};
-
-bool is_text_extension(const std::wstring &ext){
-	return known_text_extensions.find(ext) != known_text_extensions.end();
-}
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "Utility.h"
+
+std::set<std::wstring, strcmpci> known_text_extensions = {
+	L"asm",
+	L"bat",
+	L"c",
+	L"cpp",
+	L"cs",
+	L"cxx",
+	L"f",
+	L"gcl",
+	L"gitignore",
+	L"gitmodules",
+	L"h",
+	L"hpp",
+	L"hs",
+	L"htm",
+	L"html",
+	L"hxx",
+	L"java",
+	L"js",
+	L"log",
+	L"lua",
+	L"pas",
+	L"py",
+	L"qbk",
+	L"s",
+	L"sh",
+	L"ss",
+	L"txt",
+	L"xml",
+};
+
+bool is_text_extension(const std::wstring &ext){
+	return known_text_extensions.find(ext) != known_text_extensions.end();
+}
+
+bool extension_sort(const std::wstring &a, const std::wstring &b){
+	auto a_is_text = is_text_extension(a);
+	auto b_is_text = is_text_extension(b);
+	if (a_is_text != b_is_text)
+		return a_is_text && !b_is_text;
+	return strcmpci::less_than(a, b);
+}
@@ -0,0 +1,314 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "Xxh3.h"
+#include <intrin.h>
+
+static const std::uint32_t prime32_1 = 0x9E3779B1;
+static const std::uint32_t prime32_2 = 0x85EBCA77;
+static const std::uint32_t prime32_3 = 0xC2B2AE3D;
+static const std::uint64_t prime64_1 = 0x9E3779B185EBCA87;
+static const std::uint64_t prime64_2 = 0xC2B2AE3D27D4EB4F;
+static const std::uint64_t prime64_3 = 0x165667B19E3779F9;
+static const std::uint64_t prime64_4 = 0x85EBCA77C2B2AE63;
+static const std::uint64_t prime64_5 = 0x27D4EB2F165667C5;
+static const std::uint64_t prime_mx1 = 0x165667919E3779F9;
+static const std::uint64_t prime_mx2 = 0x9FB21C651E98DF25;
+
+static const size_t secret_size = 192;
+static const size_t stripes_per_block = (secret_size - Xxh3_128::stripe_size) / 8;
+static_assert(stripes_per_block * Xxh3_128::stripe_size == Xxh3_128::block_size, "Inconsistent XXH3 block size.");
+
+alignas(16) static const std::uint8_t secret[secret_size] = {
+	0xB8, 0xFE, 0x6C, 0x39, 0x23, 0xA4, 0x4B, 0xBE, 0x7C, 0x01, 0x81, 0x2C, 0xF7, 0x21, 0xAD, 0x1C,
+	0xDE, 0xD4, 0x6D, 0xE9, 0x83, 0x90, 0x97, 0xDB, 0x72, 0x40, 0xA4, 0xA4, 0xB7, 0xB3, 0x67, 0x1F,
+	0xCB, 0x79, 0xE6, 0x4E, 0xCC, 0xC0, 0xE5, 0x78, 0x82, 0x5A, 0xD0, 0x7D, 0xCC, 0xFF, 0x72, 0x21,
+	0xB8, 0x08, 0x46, 0x74, 0xF7, 0x43, 0x24, 0x8E, 0xE0, 0x35, 0x90, 0xE6, 0x81, 0x3A, 0x26, 0x4C,
+	0x3C, 0x28, 0x52, 0xBB, 0x91, 0xC3, 0x00, 0xCB, 0x88, 0xD0, 0x65, 0x8B, 0x1B, 0x53, 0x2E, 0xA3,
+	0x71, 0x64, 0x48, 0x97, 0xA2, 0x0D, 0xF9, 0x4E, 0x38, 0x19, 0xEF, 0x46, 0xA9, 0xDE, 0xAC, 0xD8,
+	0xA8, 0xFA, 0x76, 0x3F, 0xE3, 0x9C, 0x34, 0x3F, 0xF9, 0xDC, 0xBB, 0xC7, 0xC7, 0x0B, 0x4F, 0x1D,
+	0x8A, 0x51, 0xE0, 0x4B, 0xCD, 0xB4, 0x59, 0x31, 0xC8, 0x9F, 0x7E, 0xC9, 0xD9, 0x78, 0x73, 0x64,
+	0xEA, 0xC5, 0xAC, 0x83, 0x34, 0xD3, 0xEB, 0xC3, 0xC5, 0x81, 0xA0, 0xFF, 0xFA, 0x13, 0x63, 0xEB,
+	0x17, 0x0D, 0xDD, 0x51, 0xB7, 0xF0, 0xDA, 0x49, 0xD3, 0x16, 0x55, 0x26, 0x29, 0xD4, 0x68, 0x9E,
+	0x2B, 0x16, 0xBE, 0x58, 0x7D, 0x47, 0xA1, 0xFC, 0x8F, 0xF8, 0xB8, 0xD1, 0x7A, 0xD0, 0x31, 0xCE,
+	0x45, 0xCB, 0x3A, 0x8F, 0x95, 0x16, 0x04, 0x28, 0xAF, 0xD7, 0xFB, 0xCA, 0xBB, 0x4B, 0x40, 0x7E,
+};
+
+struct Hash128{
+	std::uint64_t low,
+		high;
+};
+
+static std::uint32_t read32(const std::uint8_t *p){
+	std::uint32_t ret;
+	memcpy(&ret, p, sizeof(ret));
+	return ret;
+}
+
+static std::uint64_t read64(const std::uint8_t *p){
+	std::uint64_t ret;
+	memcpy(&ret, p, sizeof(ret));
+	return ret;
+}
+
+static std::uint32_t swap32(std::uint32_t x){
+	return (x << 24) | ((x << 8) & 0x00FF0000) | ((x >> 8) & 0x0000FF00) | (x >> 24);
+}
+
+static std::uint64_t swap64(std::uint64_t x){
+	return ((std::uint64_t)swap32((std::uint32_t)x) << 32) | swap32((std::uint32_t)(x >> 32));
+}
+
+static std::uint32_t rotate_left32(std::uint32_t x, int n){
+	return (x << n) | (x >> (32 - n));
+}
+
+static std::uint64_t rotate_left64(std::uint64_t x, int n){
+	return (x << n) | (x >> (64 - n));
+}
+
+static Hash128 multiply(std::uint64_t a, std::uint64_t b){
+	Hash128 ret;
+#if defined _M_X64
+	ret.low = _umul128(a, b, &ret.high);
+#else
+	// Only x64 has a 64x64->128 multiplication, so it's put together from
+	// four 32x32->64 ones.
+	auto lo_lo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+	auto hi_lo = (a >> 32) * (b & 0xFFFFFFFF);
+	auto lo_hi = (a & 0xFFFFFFFF) * (b >> 32);
+	auto hi_hi = (a >> 32) * (b >> 32);
+	auto cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+	ret.high = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+	ret.low = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+#endif
+	return ret;
+}
+
+static std::uint64_t multiply_fold(std::uint64_t a, std::uint64_t b){
+	auto product = multiply(a, b);
+	return product.low ^ product.high;
+}
+
+static std::uint64_t xxh64_avalanche(std::uint64_t h){
+	h ^= h >> 33;
+	h *= prime64_2;
+	h ^= h >> 29;
+	h *= prime64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+static std::uint64_t avalanche(std::uint64_t h){
+	h ^= h >> 37;
+	h *= prime_mx1;
+	h ^= h >> 32;
+	return h;
+}
+
+static std::uint64_t mix16(const std::uint8_t *input, const std::uint8_t *secret){
+	return multiply_fold(read64(input) ^ read64(secret), read64(input + 8) ^ read64(secret + 8));
+}
+
+static void mix32(Hash128 &acc, const std::uint8_t *input1, const std::uint8_t *input2, const std::uint8_t *secret){
+	acc.low += mix16(input1, secret);
+	acc.low ^= read64(input2) + read64(input2 + 8);
+	acc.high += mix16(input2, secret + 16);
+	acc.high ^= read64(input1) + read64(input1 + 8);
+}
+
+static Hash128 finish_mid_size(const Hash128 &acc, size_t size){
+	Hash128 ret;
+	ret.low = avalanche(acc.low + acc.high);
+	ret.high = 0 - avalanche(acc.low * prime64_1 + acc.high * prime64_4 + size * prime64_2);
+	return ret;
+}
+
+static Hash128 hash_0_to_16(const std::uint8_t *input, size_t size){
+	Hash128 ret;
+	if (size > 8){
+		auto flip_low = read64(secret + 32) ^ read64(secret + 40);
+		auto flip_high = read64(secret + 48) ^ read64(secret + 56);
+		auto input_low = read64(input);
+		auto input_high = read64(input + size - 8);
+		auto m = multiply(input_low ^ input_high ^ flip_low, prime64_1);
+		m.low += (std::uint64_t)(size - 1) << 54;
+		input_high ^= flip_high;
+		m.high += input_high + (std::uint64_t)(std::uint32_t)input_high * (prime32_2 - 1);
+		m.low ^= swap64(m.high);
+		ret = multiply(m.low, prime64_2);
+		ret.high += m.high * prime64_2;
+		ret.low = avalanche(ret.low);
+		ret.high = avalanche(ret.high);
+		return ret;
+	}
+	if (size >= 4){
+		auto input64 = read32(input) + ((std::uint64_t)read32(input + size - 4) << 32);
+		auto keyed = input64 ^ (read64(secret + 16) ^ read64(secret + 24));
+		auto m = multiply(keyed, prime64_1 + (size << 2));
+		m.high += m.low << 1;
+		m.low ^= m.high >> 3;
+		m.low ^= m.low >> 35;
+		m.low *= prime_mx2;
+		m.low ^= m.low >> 28;
+		ret.low = m.low;
+		ret.high = avalanche(m.high);
+		return ret;
+	}
+	if (size){
+		std::uint32_t combined_low = ((std::uint32_t)input[0] << 16) | ((std::uint32_t)input[size >> 1] << 24) | input[size - 1] | ((std::uint32_t)size << 8);
+		std::uint32_t combined_high = rotate_left32(swap32(combined_low), 13);
+		ret.low = xxh64_avalanche(combined_low ^ (std::uint64_t)(read32(secret) ^ read32(secret + 4)));
+		ret.high = xxh64_avalanche(combined_high ^ (std::uint64_t)(read32(secret + 8) ^ read32(secret + 12)));
+		return ret;
+	}
+	ret.low = xxh64_avalanche(read64(secret + 64) ^ read64(secret + 72));
+	ret.high = xxh64_avalanche(read64(secret + 80) ^ read64(secret + 88));
+	return ret;
+}
+
+static Hash128 hash_17_to_128(const std::uint8_t *input, size_t size){
+	Hash128 acc = { size * prime64_1, 0 };
+	if (size > 32){
+		if (size > 64){
+			if (size > 96)
+				mix32(acc, input + 48, input + size - 64, secret + 96);
+			mix32(acc, input + 32, input + size - 48, secret + 64);
+		}
+		mix32(acc, input + 16, input + size - 32, secret + 32);
+	}
+	mix32(acc, input, input + size - 16, secret);
+	return finish_mid_size(acc, size);
+}
+
+static Hash128 hash_129_to_240(const std::uint8_t *input, size_t size){
+	Hash128 acc = { size * prime64_1, 0 };
+	auto rounds = size / 32;
+	for (size_t i = 0; i < 4; i++)
+		mix32(acc, input + 32 * i, input + 32 * i + 16, secret + 32 * i);
+	acc.low = avalanche(acc.low);
+	acc.high = avalanche(acc.high);
+	for (size_t i = 4; i < rounds; i++)
+		mix32(acc, input + 32 * i, input + 32 * i + 16, secret + 3 + 32 * (i - 4));
+	mix32(acc, input + size - 16, input + size - 32, secret + 136 - 17 - 16);
+	return finish_mid_size(acc, size);
+}
+
+// SSE2 is always available on x64.
+static void accumulate_stripe(std::uint64_t accumulators[8], const std::uint8_t *input, const std::uint8_t *secret){
+	auto acc = (__m128i *)accumulators;
+	for (size_t i = 0; i < 4; i++){
+		auto data = _mm_loadu_si128((const __m128i *)input + i);
+		auto key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i *)secret + i));
+		auto product = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+		auto swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+		acc[i] = _mm_add_epi64(product, _mm_add_epi64(acc[i], swapped));
+	}
+}
+
+static void accumulate_stripes(std::uint64_t accumulators[8], const std::uint8_t *input, size_t stripes){
+	for (size_t i = 0; i < stripes; i++)
+		accumulate_stripe(accumulators, input + i * Xxh3_128::stripe_size, secret + i * 8);
+}
+
+static void scramble(std::uint64_t accumulators[8]){
+	auto acc = (__m128i *)accumulators;
+	auto prime = _mm_set1_epi32((int)prime32_1);
+	for (size_t i = 0; i < 4; i++){
+		auto data = _mm_xor_si128(acc[i], _mm_srli_epi64(acc[i], 47));
+		auto key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i *)(secret + secret_size - Xxh3_128::stripe_size) + i));
+		auto low = _mm_mul_epu32(key, prime);
+		auto high = _mm_mul_epu32(_mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+		acc[i] = _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+	}
+}
+
+static std::uint64_t merge_accumulators(const std::uint64_t accumulators[8], const std::uint8_t *secret, std::uint64_t start){
+	auto ret = start;
+	for (size_t i = 0; i < 4; i++)
+		ret += multiply_fold(accumulators[2 * i] ^ read64(secret + 16 * i), accumulators[2 * i + 1] ^ read64(secret + 16 * i + 8));
+	return avalanche(ret);
+}
+
+static void store_digest(std::uint8_t *dst, const Hash128 &hash){
+	for (int i = 0; i < 8; i++){
+		dst[i] = (std::uint8_t)(hash.high >> (56 - 8 * i));
+		dst[i + 8] = (std::uint8_t)(hash.low >> (56 - 8 * i));
+	}
+}
+
+void Xxh3_128::Restart(){
+	static const std::uint64_t initial[8] = { prime32_3, prime64_1, prime64_2, prime64_3, prime64_4, prime32_2, prime64_5, prime32_1 };
+	memcpy(this->accumulators, initial, sizeof(initial));
+	this->buffered = 0;
+	this->total_size = 0;
+}
+
+void Xxh3_128::consume_block(const std::uint8_t *block){
+	accumulate_stripes(this->accumulators, block, stripes_per_block);
+	scramble(this->accumulators);
+	memcpy(this->previous_stripe, block + block_size - stripe_size, stripe_size);
+}
+
+void Xxh3_128::Update(const std::uint8_t *data, size_t size){
+	this->total_size += size;
+	// The last block is held back until more data comes, because the final
+	// block isn't scrambled.
+	if (this->buffered + size <= block_size){
+		memcpy(this->buffer + this->buffered, data, size);
+		this->buffered += size;
+		return;
+	}
+	if (this->buffered){
+		auto n = block_size - this->buffered;
+		memcpy(this->buffer + this->buffered, data, n);
+		data += n;
+		size -= n;
+		this->consume_block(this->buffer);
+	}
+	for (; size > block_size; data += block_size, size -= block_size)
+		this->consume_block(data);
+	memcpy(this->buffer, data, size);
+	this->buffered = size;
+}
+
+void Xxh3_128::Final(std::uint8_t *digest){
+	auto size = this->total_size;
+	auto input = this->buffer;
+	Hash128 ret;
+	if (size <= 16)
+		ret = hash_0_to_16(input, (size_t)size);
+	else if (size <= 128)
+		ret = hash_17_to_128(input, (size_t)size);
+	else if (size <= 240)
+		ret = hash_129_to_240(input, (size_t)size);
+	else{
+		alignas(16) std::uint64_t acc[8];
+		memcpy(acc, this->accumulators, sizeof(acc));
+		accumulate_stripes(acc, input, (this->buffered - 1) / stripe_size);
+		std::uint8_t last_stripe[stripe_size];
+		if (this->buffered >= stripe_size)
+			memcpy(last_stripe, input + this->buffered - stripe_size, stripe_size);
+		else{
+			auto n = stripe_size - this->buffered;
+			memcpy(last_stripe, this->previous_stripe + this->buffered, n);
+			memcpy(last_stripe + n, input, this->buffered);
+		}
+		accumulate_stripe(acc, last_stripe, secret + secret_size - stripe_size - 7);
+		ret.low = merge_accumulators(acc, secret + 11, size * prime64_1);
+		ret.high = merge_accumulators(acc, secret + secret_size - stripe_size - 11, ~(size * prime64_2));
+	}
+	store_digest(digest, ret);
+	this->Restart();
+}
+
+void xxh3_128(fingerprint_t &dst, const void *data, size_t size){
+	Xxh3_128 hash;
+	hash.Update((const std::uint8_t *)data, size);
+	hash.Final(dst.data());
+}
@@ -0,0 +1,46 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#include "SimpleTypes.h"
+
+// XXH3 with 128-bit output and the default secret and seed, at several times
+// the speed of SHA-256. It's not a cryptographic hash: it makes no promises
+// against data crafted to collide, and for unrelated contents it only bounds
+// the chance of a collision to about 2^-128 per pair, well short of SHA-256.
+// It's only used to tell whether files have changed. SHA-256 is still what
+// guarantees the integrity of the archives.
+// The interface follows Crypto++'s, so that it can be used with HashSink and
+// HashSource. The digest is the canonical representation (big endian, high
+// half first).
+class Xxh3_128{
+public:
+	static const size_t DIGESTSIZE = fingerprint_length;
+	static const size_t stripe_size = 64;
+	static const size_t block_size = 1024;
+private:
+	alignas(16) std::uint64_t accumulators[8];
+	std::uint8_t buffer[block_size];
+	// The end of the last block that was consumed, for when less than a
+	// stripe follows it.
+	std::uint8_t previous_stripe[stripe_size];
+	size_t buffered;
+	std::uint64_t total_size;
+
+	void consume_block(const std::uint8_t *);
+public:
+	Xxh3_128(){
+		this->Restart();
+	}
+	void Restart();
+	void Update(const std::uint8_t *data, size_t size);
+	// Writes the digest and restarts.
+	void Final(std::uint8_t *digest);
+};
+
+void xxh3_128(fingerprint_t &dst, const void *data, size_t size);
@@ -0,0 +1,198 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "stdafx.h"
+#include "ZstdFilter.h"
+#include "Utility.h"
+#include "Exception.h"
+
+namespace zstreams{
+
+static size_t check_result(size_t result){
+	if (ZSTD_isError(result))
+		throw ZstdException(ZSTD_getErrorName(result));
+	return result;
+}
+
+ZstdSink::ZstdSink(Sink &stream, bool *multithreaded, int compression_level):
+		CompressorSink(stream),
+		context(ZSTD_createCCtx()){
+	if (!this->context)
+		throw ZstdException("Memory allocation failed.");
+	check_result(ZSTD_CCtx_setParameter(this->context, ZSTD_c_compressionLevel, compression_level));
+	if (*multithreaded){
+		int threads = this->acquire_threads();
+		// Fails if the library was built without multithreading support.
+		*multithreaded = threads && !ZSTD_isError(ZSTD_CCtx_setParameter(this->context, ZSTD_c_nbWorkers, threads));
+		if (!*multithreaded)
+			this->release_threads(threads);
+	}
+}
+
+ZstdSink::~ZstdSink(){
+	StreamProcessor::stop();
+	ZSTD_freeCCtx(this->context);
+}
+
+void ZstdSink::send_output(){
+	if (!this->output_offset)
+		return;
+	this->output_segment.trim_to_size(this->output_offset);
+	this->write_output(this->output_segment);
+	this->output_segment = Segment();
+	this->output_offset = 0;
+}
+
+size_t ZstdSink::code(ZSTD_inBuffer &input, ZSTD_EndDirective directive){
+	if (!this->output_segment){
+		this->output_segment = this->allocate_segment();
+		this->output_offset = 0;
+	}
+	auto data = this->output_segment.get_data();
+	ZSTD_outBuffer output = { data.data, data.size, this->output_offset };
+	auto ret = check_result(ZSTD_compressStream2(this->context, &output, &input, directive));
+	this->output_offset = output.pos;
+	if (output.pos == output.size)
+		this->send_output();
+	return ret;
+}
+
+void ZstdSink::compress(const std::uint8_t *&input, size_t &size){
+	ZSTD_inBuffer buffer = { input, size, 0 };
+	this->code(buffer, ZSTD_e_continue);
+	input += buffer.pos;
+	size -= buffer.pos;
+}
+
+void ZstdSink::end_block(){
+	ZSTD_inBuffer buffer = { nullptr, 0, 0 };
+	while (this->code(buffer, ZSTD_e_end));
+	this->send_output();
+}
+
+// Decodes frames until the input runs out. get_input() returns false at the
+// end of the input.
+template <typename F1, typename F2>
+static void decode(ZSTD_DCtx *context, StreamProcessor &processor, const F1 &get_input, const F2 &output, const DecodedBlock *block = nullptr){
+	ZSTD_inBuffer in = { nullptr, 0, 0 };
+	ZSTD_outBuffer out = { nullptr, 0, 0 };
+	Segment out_segment;
+	size_t hint = 0;
+	bool input_ended = false;
+	while (!block || !block->is_cancelled()){
+		if (in.pos == in.size && !input_ended){
+			SubSegment data;
+			if (get_input(data))
+				in = ZSTD_inBuffer{ data.data, data.size, 0 };
+			else
+				input_ended = true;
+		}
+		if (out.pos == out.size){
+			if (!!out_segment)
+				output(out_segment);
+			out_segment = processor.allocate_segment();
+			auto data = out_segment.get_data();
+			out = ZSTD_outBuffer{ data.data, data.size, 0 };
+		}
+		auto in_pos = in.pos;
+		auto out_pos = out.pos;
+		auto ret = check_result(ZSTD_decompressStream(context, &out, &in));
+		// A call that makes no progress after the end of a frame would report
+		// the size of the next frame's header.
+		if (in.pos != in_pos || out.pos != out_pos)
+			hint = ret;
+		// Once the input is over, the decoder is done when it stops filling
+		// the output.
+		if (input_ended && out.pos < out.size)
+			break;
+	}
+	if (hint && !(block && block->is_cancelled()))
+		throw ZstdException("Compressed data is truncated.");
+	if (out.pos){
+		out_segment.trim_to_size(out.pos);
+		output(out_segment);
+	}
+}
+
+static ZSTD_DCtx *create_decoder(){
+	auto ret = ZSTD_createDCtx();
+	if (!ret)
+		throw ZstdException("Memory allocation failed.");
+	return ret;
+}
+
+ZstdSource::ZstdSource(Source &stream, const std::vector<std::uint64_t> &block_sizes, std::uint64_t max_block_output):
+	DecompressorSource(stream, block_sizes, max_block_output),
+	context(create_decoder()){}
+
+ZstdSource::~ZstdSource(){
+	StreamProcessor::stop();
+	ZSTD_freeDCtx(this->context);
+}
+
+void ZstdSource::work_sequential(){
+	Segment in_segment;
+	decode(
+		this->context,
+		*this,
+		[this, &in_segment](SubSegment &data){
+			in_segment = this->read();
+			if (in_segment.get_type() == SegmentType::Eof)
+				return false;
+			data = in_segment.get_data();
+			return true;
+		},
+		[this](Segment &segment){
+			this->write(segment);
+		}
+	);
+	Segment eof(SegmentType::Eof);
+	this->write(eof);
+}
+
+void ZstdSource::decode_block(const std::vector<Segment> &input, DecodedBlock &output){
+	std::shared_ptr<ZSTD_DCtx> context(create_decoder(), ZSTD_freeDCtx);
+	size_t next_input = 0;
+	decode(
+		context.get(),
+		*this,
+		[&input, &next_input](SubSegment &data){
+			if (next_input == input.size())
+				return false;
+			data = input[next_input++].get_data();
+			return true;
+		},
+		[&output](Segment &segment){
+			output.push(std::move(segment));
+		},
+		&output
+	);
+}
+
+buffer_t zstd_compress_with_dictionary(int level, const buffer_t &data, const buffer_t &dictionary){
+	std::shared_ptr<ZSTD_CCtx> context(ZSTD_createCCtx(), ZSTD_freeCCtx);
+	if (!context)
+		throw ZstdException("Memory allocation failed.");
+	check_result(ZSTD_CCtx_setParameter(context.get(), ZSTD_c_compressionLevel, level));
+	// The prefix only applies to the next frame.
+	check_result(ZSTD_CCtx_refPrefix(context.get(), dictionary.data(), dictionary.size()));
+	buffer_t ret(ZSTD_compressBound(data.size()));
+	ret.resize(check_result(ZSTD_compress2(context.get(), ret.data(), ret.size(), data.data(), data.size())));
+	return ret;
+}
+
+buffer_t zstd_decompress_with_dictionary(const buffer_t &data, std::uint64_t size, const buffer_t &dictionary){
+	std::shared_ptr<ZSTD_DCtx> context(create_decoder(), ZSTD_freeDCtx);
+	check_result(ZSTD_DCtx_refPrefix(context.get(), dictionary.data(), dictionary.size()));
+	buffer_t ret((size_t)size);
+	auto decoded = check_result(ZSTD_decompressDCtx(context.get(), ret.data(), ret.size(), data.data(), data.size()));
+	if (decoded != ret.size())
+		throw ZstdException("Invalid data: A file compressed with a dictionary could not be decoded.");
+	return ret;
+}
+
+}
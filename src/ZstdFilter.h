@@ -0,0 +1,52 @@
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#pragma once
+
+#include "CompressionFilter.h"
+
+namespace zstreams{
+
+// Much faster than LzmaSink, at the cost of some compression ratio.
+class ZstdSink : public CompressorSink{
+	ZSTD_CCtx *context;
+	Segment output_segment;
+	size_t output_offset = 0;
+
+	size_t code(ZSTD_inBuffer &, ZSTD_EndDirective);
+	void send_output();
+	void begin_block() override{}
+	void compress(const std::uint8_t *&input, size_t &size) override;
+	void end_block() override;
+public:
+	// Each block is a separate zstd frame.
+	ZstdSink(Sink &stream, bool *multithreaded, int compression_level = 3);
+	~ZstdSink();
+	const char *class_name() const override{
+		return "ZstdOutputStream";
+	}
+};
+
+class ZstdSource : public DecompressorSource{
+	ZSTD_DCtx *context;
+
+	void work_sequential() override;
+	void decode_block(const std::vector<Segment> &input, DecodedBlock &output) override;
+public:
+	ZstdSource(Source &wrapped_stream, const std::vector<std::uint64_t> &block_sizes = std::vector<std::uint64_t>(), std::uint64_t max_block_output = 0);
+	~ZstdSource();
+	const char *class_name() const override{
+		return "ZstdInputStream";
+	}
+};
+
+// See compress_with_dictionary(). The output is a zstd frame that refers to
+// the dictionary as a prefix of raw content.
+buffer_t zstd_compress_with_dictionary(int level, const buffer_t &data, const buffer_t &dictionary);
+buffer_t zstd_decompress_with_dictionary(const buffer_t &data, std::uint64_t size, const buffer_t &dictionary);
+
+}
@@ -0,0 +1,5 @@
+public:
+	ArchiveBlockIndex(): block_size(0){}
+	// Returns the index of the block that contains the given offset into the
+	// uncompressed file data.
+	size_t find_block(std::uint64_t uncompressed_offset) const;
@@ -0,0 +1,4 @@
+public:
+	// The values are Codec values. Archives that don't store this use LZMA
+	// everywhere.
+	ArchiveCodecs(): file_data(0), base_objects(0){}
@@ -0,0 +1,5 @@
+public:
+	// mode is a CryptoMode value, and chunk_size is the number of plaintext
+	// bytes in each chunk (see CryptoSink::create()). Archives that don't
+	// store this use CBC mode.
+	ArchiveEncryption(): mode(0), chunk_size(0){}
@@ -0,0 +1,9 @@
+public:
+	// The fingerprints of the files in the version (see Xxh3_128), in
+	// increasing stream id order, fingerprint_length bytes each. They're kept
+	// here rather than in the FSOs so that the FSOs of older versions remain
+	// readable.
+	ArchiveFingerprints(){}
+	void add(stream_id_t, const fingerprint_t &);
+	// Returns false if the stream has no fingerprint.
+	bool find(fingerprint_t &dst, stream_id_t) const;
@@ -1,2 +1,16 @@
-public:
-	ArchiveMetadata(): entries_size_in_archive(0){}
+public:
+	ArchiveMetadata(): entries_size_in_archive(0){}
+	// These are stored separately after the manifest, so that archives that
+	// don't have them remain readable.
+	// Never null once the manifest has been read.
+	std::shared_ptr<ArchiveCodecs> codecs;
+	// Null if the file data is a single compressed stream.
+	std::shared_ptr<ArchiveBlockIndex> block_index;
+	// Null if every file is compressed.
+	std::shared_ptr<ArchiveStoredData> stored_data;
+	// Null if no file was primed with a dictionary.
+	std::shared_ptr<ArchivePrimedData> primed_data;
+	// Null if the archive isn't encrypted, or if it's encrypted in CBC mode.
+	std::shared_ptr<ArchiveEncryption> encryption;
+	// Null if the archive is older than fingerprints.
+	std::shared_ptr<ArchiveFingerprints> fingerprints;
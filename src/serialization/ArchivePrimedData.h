@@ -0,0 +1,14 @@
+public:
+	// Where the primed files begin, both in the file data section and in the
+	// sequence of streams. They come after the stored files, and are the last
+	// streams of the archive, in the order of the vectors. Each one is
+	// compressed on its own, primed with the contents of a stream from an
+	// earlier version (see compress_with_dictionary()). A dictionary version
+	// of invalid_version_number means the file was compressed without one.
+	ArchivePrimedData(): offset(0), uncompressed_offset(0){}
+	// The index into the vectors of the primed file that is the given stream
+	// of the archive, or -1 if that stream isn't primed.
+	std::int64_t find_file(size_t stream_index, size_t stream_count) const{
+		auto first = stream_count - this->compressed_sizes.size();
+		return stream_index >= first ? (std::int64_t)(stream_index - first) : -1;
+	}
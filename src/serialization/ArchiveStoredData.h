@@ -0,0 +1,4 @@
+public:
+	// Where the stored (uncompressed) files begin, both in the file data
+	// section and in the sequence of streams.
+	ArchiveStoredData(): offset(0), uncompressed_offset(0){}
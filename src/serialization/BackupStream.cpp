@@ -1,15 +1,23 @@
-/*
-Copyright (c), Helios
-All rights reserved.
-
-Distributed under a permissive license. See COPYING.txt for details.
-*/
-
-#include "../stdafx.h"
-#include "fso.generated.h"
-
-void UnmodifiedStream::get_dependencies(std::set<version_number_t> &dst) const{
-	dst.insert(this->containing_version);
-}
-
-void FullStream::get_dependencies(std::set<version_number_t> &dst) const{}
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "../stdafx.h"
+#include "fso.generated.h"
+
+void UnmodifiedStream::get_dependencies(std::set<version_number_t> &dst) const{
+	dst.insert(this->containing_version);
+}
+
+void FullStream::get_dependencies(std::set<version_number_t> &dst) const{}
+
+bool FullStream::get_previous_contents(version_number_t &version, stream_id_t &stream_id) const{
+	if (this->previous_version == invalid_version_number)
+		return false;
+	version = this->previous_version;
+	stream_id = this->previous_stream_id;
+	return true;
+}
@@ -1,13 +1,18 @@
-protected:
-	std::vector<FilishFso *> file_system_objects;
-public:
-	BackupStream(): unique_id(invalid_stream_id){}
-	void add_file_system_object(FilishFso *fso){
-		this->file_system_objects.push_back(fso);
-	}
-	DEFINE_INLINE_GETTER(file_system_objects)
-	DEFINE_INLINE_SETTER_GETTER(unique_id)
-	virtual bool has_data() const{
-		return true;
-	}
-	virtual void get_dependencies(std::set<version_number_t> &dst) const = 0;
+protected:
+	std::vector<FilishFso *> file_system_objects;
+public:
+	BackupStream(): unique_id(invalid_stream_id){}
+	void add_file_system_object(FilishFso *fso){
+		this->file_system_objects.push_back(fso);
+	}
+	DEFINE_INLINE_GETTER(file_system_objects)
+	DEFINE_INLINE_SETTER_GETTER(unique_id)
+	virtual bool has_data() const{
+		return true;
+	}
+	virtual void get_dependencies(std::set<version_number_t> &dst) const = 0;
+	// The version and the stream that held the file's previous contents, if
+	// they may be used to prime its compression.
+	virtual bool get_previous_contents(version_number_t &version, stream_id_t &stream_id) const{
+		return false;
+	}
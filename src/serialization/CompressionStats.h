@@ -0,0 +1,2 @@
+public:
+	// The vectors are parallel. See CompressionPolicy.
@@ -1,5 +1,13 @@
-public:
-	FullStream(): virtual_size(0), physical_size(0){}
-	DEFINE_INLINE_SETTER_GETTER(virtual_size)
-	DEFINE_INLINE_SETTER_GETTER(physical_size)
-	void get_dependencies(std::set<version_number_t> &dst) const;
+	// Not serialized. See BackupStream::get_previous_contents().
+	version_number_t previous_version;
+	stream_id_t previous_stream_id;
+public:
+	FullStream(): virtual_size(0), physical_size(0), previous_version(invalid_version_number), previous_stream_id(invalid_stream_id){}
+	DEFINE_INLINE_SETTER_GETTER(virtual_size)
+	DEFINE_INLINE_SETTER_GETTER(physical_size)
+	void get_dependencies(std::set<version_number_t> &dst) const;
+	void set_previous_contents(version_number_t version, stream_id_t stream_id){
+		this->previous_version = version;
+		this->previous_stream_id = stream_id;
+	}
+	bool get_previous_contents(version_number_t &version, stream_id_t &stream_id) const override;
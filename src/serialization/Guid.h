@@ -1,2 +1,2 @@
-public:
-	Guid(): valid(false){}
+public:
+	Guid(): valid(false){}
@@ -1,30 +1,61 @@
-/*
-Copyright (c), Helios
-All rights reserved.
-
-Distributed under a permissive license. See COPYING.txt for details.
-*/
-
-#include "../stdafx.h"
-#include "fso.generated.h"
-
-#define DEFINE_TRIVIAL_IMPLEMENTATIONS(x) x::~x(){} void x::rollback_deserialization(){}
-
-DEFINE_TRIVIAL_IMPLEMENTATIONS(Sha256Digest)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(Guid)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(FileSystemObject)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(DirectoryishFso)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(DirectoryFso)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(DirectorySymlinkFso)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(JunctionFso)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(FilishFso)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(RegularFileFso)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(FileHardlinkFso)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(FileSymlinkFso)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(FileReparsePointFso)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(ArchiveMetadata)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(VersionManifest)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(OpaqueTimestamp)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(BackupStream)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(UnmodifiedStream)
-DEFINE_TRIVIAL_IMPLEMENTATIONS(FullStream)
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "../stdafx.h"
+#include "fso.generated.h"
+#include "../Utility.h"
+
+#define DEFINE_TRIVIAL_IMPLEMENTATIONS(x) x::~x(){} void x::rollback_deserialization(){}
+
+DEFINE_TRIVIAL_IMPLEMENTATIONS(Sha256Digest)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(Guid)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(FileSystemObject)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(DirectoryishFso)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(DirectoryFso)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(DirectorySymlinkFso)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(JunctionFso)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(FilishFso)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(RegularFileFso)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(FileHardlinkFso)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(FileSymlinkFso)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(FileReparsePointFso)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(ArchiveCodecs)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(ArchiveBlockIndex)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(ArchiveStoredData)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(ArchivePrimedData)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(ArchiveEncryption)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(ArchiveFingerprints)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(ArchiveMetadata)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(VersionManifest)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(OpaqueTimestamp)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(BackupStream)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(UnmodifiedStream)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(FullStream)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(CompressionStats)
+DEFINE_TRIVIAL_IMPLEMENTATIONS(TuningSettings)
+
+size_t ArchiveBlockIndex::find_block(std::uint64_t uncompressed_offset) const{
+	auto it = std::upper_bound(this->uncompressed_offsets.begin(), this->uncompressed_offsets.end(), uncompressed_offset);
+	if (it == this->uncompressed_offsets.begin())
+		return 0;
+	return it - this->uncompressed_offsets.begin() - 1;
+}
+
+void ArchiveFingerprints::add(stream_id_t stream_id, const fingerprint_t &fingerprint){
+	zekvok_assert(this->stream_ids.empty() || this->stream_ids.back() < stream_id);
+	this->stream_ids.push_back(stream_id);
+	this->digests.insert(this->digests.end(), fingerprint.begin(), fingerprint.end());
+}
+
+bool ArchiveFingerprints::find(fingerprint_t &dst, stream_id_t stream_id) const{
+	auto it = std::lower_bound(this->stream_ids.begin(), this->stream_ids.end(), stream_id);
+	if (it == this->stream_ids.end() || *it != stream_id)
+		return false;
+	auto digest = this->digests.begin() + (it - this->stream_ids.begin()) * fingerprint_length;
+	std::copy(digest, digest + fingerprint_length, dst.begin());
+	return true;
+}
@@ -1,14 +1,14 @@
-/*
-Copyright (c), Helios
-All rights reserved.
-
-Distributed under a permissive license. See COPYING.txt for details.
-*/
-
-#include "../stdafx.h"
-
-#include "fso.generated.cpp"
-#include "fso.aux.generated.cpp"
-#include "../../serialization/postsrc/DeserializerStream.cpp"
-#include "../../serialization/postsrc/Serializable.cpp"
-#include "../../serialization/postsrc/SerializerStream.cpp"
+/*
+Copyright (c), Helios
+All rights reserved.
+
+Distributed under a permissive license. See COPYING.txt for details.
+*/
+
+#include "../stdafx.h"
+
+#include "fso.generated.cpp"
+#include "fso.aux.generated.cpp"
+#include "../../serialization/postsrc/DeserializerStream.cpp"
+#include "../../serialization/postsrc/Serializable.cpp"
+#include "../../serialization/postsrc/SerializerStream.cpp"
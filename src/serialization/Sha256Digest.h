@@ -1,2 +1,2 @@
-public:
-	Sha256Digest(): valid(false){}
+public:
+	Sha256Digest(): valid(false){}
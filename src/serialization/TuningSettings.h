@@ -0,0 +1,9 @@
+public:
+	// Written by autotune(). file_data_level is in the scale of the codec.
+	// Zeroes in the other members mean the built-in defaults.
+	TuningSettings():
+		file_data_codec(0),
+		file_data_level(0),
+		compression_threads(0),
+		read_segment_size(0),
+		queue_depth(0){}
@@ -1,8 +1,8 @@
-public:
-	UnmodifiedStream(): virtual_size(0), containing_version(invalid_version_number){}
-	void get_dependencies(std::set<version_number_t> &dst) const;
-	DEFINE_INLINE_SETTER(containing_version)
-	DEFINE_INLINE_SETTER(virtual_size)
-	virtual bool has_data() const override{
-		return false;
-	}
+public:
+	UnmodifiedStream(): virtual_size(0), containing_version(invalid_version_number){}
+	void get_dependencies(std::set<version_number_t> &dst) const;
+	DEFINE_INLINE_SETTER(containing_version)
+	DEFINE_INLINE_SETTER(virtual_size)
+	virtual bool has_data() const override{
+		return false;
+	}